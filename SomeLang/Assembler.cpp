@@ -4,6 +4,8 @@
 #include <sstream>
 #include <istream>
 #include <ostream>
+#include <stack>
+#include <cctype>
 
 #include "libSomeVM/Value.hpp"
 #include "libSomeVM/Function.hpp"
@@ -16,6 +18,14 @@ namespace
 {
     using namespace sl;
 
+    // a function that hasn't reached its "end" yet
+    struct PendingFunction
+    {
+        std::uint8_t numRets;
+        std::uint8_t numArgs;
+        svm::Bytecode code;
+    };
+
     // returns the index of the added value
     static std::uint64_t constant(std::istream& in, svm::Registry& constants)
     {
@@ -48,7 +58,18 @@ namespace
         {
             util::toLower(str);
 
-            if (util::isBool(str))
+            if (str.front() == '@')
+            {
+                auto idx = str.substr(1);
+
+                // labels and function names have been replaced with their index by now (see Assembler::resolveIndices)
+                if (idx.empty() || !util::isInt(idx))
+                    throw std::runtime_error("Unknown label or function \"" + str + '"');
+
+                // stored as the VM expects integers (see VM::getInteger)
+                constants.push_back(svm::Value::fromBits(0x3ff0000000000000u | std::stoull(idx)));
+            }
+            else if (util::isBool(str))
             {
                 constants.emplace_back(util::strToBool(str));
             }
@@ -114,6 +135,20 @@ namespace
         return{ type, one, two };
     }
 
+    // for instructions with two of the three short arguments (ie: Neg)
+    static svm::Instruction twoArgShort(std::istream& in, svm::Instruction::Type type)
+    {
+        std::string oneStr;
+        std::string twoStr;
+
+        in >> oneStr >> twoStr;
+
+        auto one = Assembler::toRegister(oneStr);
+        auto two = Assembler::toRegister(twoStr);
+
+        return{ type, one, two, std::uint16_t{ 0 } };
+    }
+
     static svm::Instruction twoArgOptConst(std::istream& in, svm::Instruction::Type type, svm::Instruction::Type constType, svm::Program& prog)
     {
         std::string one;
@@ -174,22 +209,24 @@ namespace sl
 
     void Assembler::run(std::istream& in, std::ostream& out, svm::Program& program)
     {
-        std::uint64_t lineNum = 1;
+        std::vector<std::string> lines;
         std::string line;
 
-        std::stack<svm::Function> codeStack;
+        while (std::getline(in, line))
+            lines.push_back(line);
+
+        resolveIndices(lines, program.functions.size());
+
+        std::stack<PendingFunction> codeStack;
 
         // top level function has no returns and 1 argument (an array of command-line parameters) (or, will at least)
-        codeStack.emplace(0, 1, svm::Bytecode{});
+        codeStack.push({ 0, 1, {} });
 
-        for (; std::getline(in, line); ++lineNum)
+        for (std::uint64_t lineNum = 1; lineNum <= lines.size(); ++lineNum)
         {
-            if (line.empty())
-                continue;
-
             std::string command;
 
-            std::istringstream iss(line);
+            std::istringstream iss(lines[lineNum - 1]);
             iss >> command;
 
             if (command.empty())
@@ -206,8 +243,8 @@ namespace sl
 
                 auto& top = codeStack.top();
 
-                // comment
-                if (command[0] == '#')
+                // comment, or label (already resolved)
+                if (command[0] == '#' || command[0] == '@')
                 {
                     continue;
                 }
@@ -219,8 +256,7 @@ namespace sl
                 // command
                 else if ((it = commands.find(command)) != commands.end())
                 {
-                    auto inst = it->second(iss, program);
-                    //top.code.push_back(inst);
+                    top.code.push_back(it->second(iss, program));
                 }
                 // start function
                 else if (command.back() == ':')
@@ -231,12 +267,12 @@ namespace sl
                     std::uint32_t numArgs = 0;
                     iss >> numRets >> numArgs;
 
-                    codeStack.emplace(static_cast<std::uint8_t>(numRets), static_cast<std::uint8_t>(numArgs), svm::Bytecode{});
+                    codeStack.push({ static_cast<std::uint8_t>(numRets), static_cast<std::uint8_t>(numArgs), {} });
                 }
                 // end function
                 else if (command == "end")
                 {
-                    program.functions.push_back(top);
+                    program.functions.emplace_back(top.numRets, top.numArgs, std::move(top.code));
                     codeStack.pop();
                 }
                 else
@@ -250,18 +286,120 @@ namespace sl
             catch (const std::exception& e)
             {
                 out << "\nError (line: " << lineNum << "): " << e.what() << std::endl;
-                throw e;
+                throw;
             }
         }
 
         // if the top-level function was not popped
         if (!codeStack.empty())
         {
-            program.functions.insert(program.functions.begin(), codeStack.top());
+            auto& top = codeStack.top();
+            program.functions.emplace(program.functions.begin(), top.numRets, top.numArgs, std::move(top.code));
             codeStack.pop();
         }
     }
 
+    void Assembler::resolveIndices(std::vector<std::string>& lines, std::uint64_t firstFunction)
+    {
+        // functions are numbered in the order they're started, the top level being 0
+        std::vector<std::unordered_map<std::string, std::uint64_t>> labels(1);
+        std::vector<std::uint64_t> lengths(1);
+        std::vector<std::string> names(1);
+
+        // the function each line is in
+        std::vector<std::uint64_t> lineFunctions(lines.size());
+
+        // index of each named function, once it ends, among the functions this adds to the program
+        std::unordered_map<std::string, std::uint64_t> functions;
+        std::uint64_t numEnded = 0;
+        bool topLevelEnded = false;
+
+        std::stack<std::uint64_t> open;
+        open.push(0);
+
+        for (std::uint64_t i = 0; i < lines.size() && !open.empty(); ++i)
+        {
+            std::string command;
+            std::istringstream(lines[i]) >> command;
+            util::toLower(command);
+
+            lineFunctions[i] = open.top();
+
+            if (command.empty() || command[0] == '#' || command == "const")
+                continue;
+
+            if (command[0] == '@' && command.back() == ':')
+            {
+                labels[open.top()][command.substr(1, command.size() - 2)] = lengths[open.top()];
+            }
+            else if (commands.count(command) != 0)
+            {
+                ++lengths[open.top()];
+            }
+            else if (command.back() == ':')
+            {
+                open.push(labels.size());
+                labels.emplace_back();
+                lengths.push_back(0);
+                names.push_back(command.substr(0, command.size() - 1));
+            }
+            else if (command == "end")
+            {
+                if (open.top() == 0)
+                    topLevelEnded = true;
+                else
+                    functions[names[open.top()]] = numEnded;
+
+                ++numEnded;
+                open.pop();
+            }
+        }
+
+        // a top level function that wasn't ended goes first (see run())
+        auto base = firstFunction + (topLevelEnded ? 0 : 1);
+
+        for (std::uint64_t i = 0; i < lines.size(); ++i)
+        {
+            auto& str = lines[i];
+            bool quoted = false;
+
+            for (std::uint64_t pos = 0; pos < str.size(); ++pos)
+            {
+                if (str[pos] == '"')
+                    quoted = !quoted;
+
+                if (quoted || str[pos] != '@' || (pos != 0 && !std::isspace(static_cast<unsigned char>(str[pos - 1]))))
+                    continue;
+
+                auto end = pos;
+                while (end < str.size() && !std::isspace(static_cast<unsigned char>(str[end])))
+                    ++end;
+
+                auto name = str.substr(pos + 1, end - pos - 1);
+                util::toLower(name);
+
+                // label definitions, and indices already given as numbers, are left as is
+                if (name.empty() || name.back() == ':' || std::isdigit(static_cast<unsigned char>(name[0])))
+                    continue;
+
+                auto& local = labels[lineFunctions[i]];
+                auto label = local.find(name);
+                auto function = functions.find(name);
+
+                std::uint64_t index;
+
+                if (label != local.end())
+                    index = label->second;
+                else if (function != functions.end())
+                    index = base + function->second;
+                else
+                    continue;
+
+                str.replace(pos, end - pos, "@" + std::to_string(index));
+            }
+        }
+    }
+
     bool Assembler::isRegister(const std::string& str)
     {
         if (str[0] != '$')
@@ -305,7 +443,7 @@ namespace sl
 		{"mult", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Mult); }},
 		{"div", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Div); }},
 		{"mod", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Mod); }},
-		{"neg", [](std::istream& in, svm::Program&) { return twoArg(in, svm::Instruction::Type::Neg); }},
+		{"neg", [](std::istream& in, svm::Program&) { return twoArgShort(in, svm::Instruction::Type::Neg); }},
 
 		/* comparison ops */
 		{"lt", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Lt); }},
@@ -317,7 +455,7 @@ namespace sl
 
 		/* logical ops */
 		{"not", [](std::istream& in, svm::Program&) { return twoArg(in, svm::Instruction::Type::Not); }},
-		{"and", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Add); }},
+		{"and", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::And); }},
 		{"or", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Or); }},
 		{"xor", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Xor); }},
 
@@ -334,6 +472,15 @@ namespace sl
 		{"jmp", [](std::istream& in, svm::Program& prog) { return oneArgConst(in, svm::Instruction::Type::Jmp, svm::Instruction::Type::JmpC, prog); }},
 		{"rjmp", [](std::istream& in, svm::Program& prog) { return oneArgConst(in, svm::Instruction::Type::RJmp, svm::Instruction::Type::RJmpC, prog); }},
 
+		/* tasks */
+		{"spawn", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Spawn); }},
+		{"join", [](std::istream& in, svm::Program&) { return twoArg(in, svm::Instruction::Type::Join); }},
+
+		/* coroutines */
+		{"coroutine", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Coroutine); }},
+		{"resume", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::Resume); }},
+		{"yield", [](std::istream& in, svm::Program&) { return twoArg(in, svm::Instruction::Type::Yield); }},
+
 		/* misc */
 		{"syscall", [](std::istream& in, svm::Program&) { return threeArg(in, svm::Instruction::Type::SysCall); }},
 		{"nop", [](std::istream&, svm::Program&) { return svm::Instruction(svm::Instruction::Type::Nop, 0); }},
@@ -2,6 +2,8 @@
 
 #include <iosfwd>
 #include <unordered_map>
+#include <vector>
+#include <string>
 
 #include "libSomeVM/Program.hpp"
 #include "libSomeVM/Instruction.hpp"
@@ -18,6 +20,8 @@ namespace sl
 		Assembler() = delete;
 		~Assembler() = delete;
 
+		// '@' marks an index, stored as an integer constant: "@3", a label in the same function ("@loop", defined by
+		// a line "@loop:" before the instruction it points to), or a function, by name ("@fib", for "fib: 1 1")
 		static svm::Program run(std::istream& in, std::ostream& out);
 
 		// adds to program, rather than creating a whole new Program
@@ -27,6 +31,9 @@ namespace sl
 		static std::uint16_t toRegister(const std::string& regStr);
 
 	private:
+		// replaces each label or function name following an '@' with its index
+		static void resolveIndices(std::vector<std::string>& lines, std::uint64_t firstFunction);
+
 		static const std::unordered_map<std::string, svm::Instruction(*)(std::istream&, svm::Program&)> commands;
 	};
 }
@@ -0,0 +1,217 @@
+#include "Frontend.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+namespace sl
+{
+    namespace
+    {
+        // pieces smaller than this aren't worth a thread's time
+        constexpr std::size_t MIN_PIECE = 64 << 10;
+
+        // a few pieces per worker, so one slow piece doesn't hold up the rest
+        constexpr std::size_t PIECES_PER_WORKER = 4;
+
+        struct Piece
+        {
+            std::string_view text;
+            std::uint32_t offset = 0;
+            std::uint32_t firstLine = 1;
+
+            // offsets and lines are the piece's own
+            std::vector<Lexeme> lexemes;
+        };
+
+        std::size_t numWorkers(std::size_t workers)
+        {
+            if (workers == 0)
+                workers = std::thread::hardware_concurrency();
+
+            return workers == 0 ? 1 : workers;
+        }
+
+        bool identifierPart(char ch)
+        {
+            return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ('0' <= ch && ch <= '9') || ch == '_';
+        }
+
+        // the first "func" at the start of a line, at or after 'from' (which must be past the start), or npos
+        std::size_t nextFunction(std::string_view source, std::size_t from)
+        {
+            for (auto at = source.find("\nfunc", from - 1); at != std::string_view::npos; at = source.find("\nfunc", at + 1))
+            {
+                auto after = at + 5;
+
+                // not ie: "function"
+                if (after == source.size() || !identifierPart(source[after]))
+                    return at + 1;
+            }
+
+            return std::string_view::npos;
+        }
+
+        // runs work(i) for each i below 'count' on up to 'workers' threads, the calling one included
+        // rethrows the first (lowest i) exception, once they're all done
+        template<typename Work>
+        void forEach(std::size_t count, std::size_t workers, Work work)
+        {
+            std::atomic<std::size_t> next{ 0 };
+            std::vector<std::exception_ptr> errors(count);
+
+            auto run = [&]()
+            {
+                for (std::size_t i; (i = next++) < count; )
+                {
+                    try
+                    {
+                        work(i);
+                    }
+                    catch (...)
+                    {
+                        errors[i] = std::current_exception();
+                    }
+                }
+            };
+
+            std::vector<std::thread> threads;
+            threads.reserve(workers);
+
+            for (std::size_t i = 1; i < workers && i < count; ++i)
+                threads.emplace_back(run);
+
+            run();
+
+            for (auto& t : threads)
+                t.join();
+
+            for (auto& e : errors)
+            {
+                if (e)
+                    std::rethrow_exception(e);
+            }
+        }
+
+        // a piece that was split inside a string
+        bool endsInString(const Piece& piece)
+        {
+            // every piece but the last ends on a newline, so its last token is a Newline, unless a string swallowed it
+            auto& lexemes = piece.lexemes;
+            return lexemes.size() < 2 || lexemes[lexemes.size() - 2].type != Token::Type::Newline;
+        }
+
+        std::vector<Piece> lexPieces(std::string_view source, std::size_t workers)
+        {
+            if (source.size() >= std::numeric_limits<std::uint32_t>::max())
+                throw std::runtime_error("Unable to lex 4 GiB or more of source");
+
+            auto texts = split(source, workers == 1 ? 1 : std::min(workers * PIECES_PER_WORKER, source.size() / MIN_PIECE + 1));
+
+            std::vector<Piece> pieces(texts.size());
+
+            for (std::size_t i = 0; i < texts.size(); ++i)
+            {
+                pieces[i].text = texts[i];
+                pieces[i].offset = static_cast<std::uint32_t>(texts[i].data() - source.data());
+            }
+
+            forEach(pieces.size(), workers, [&](std::size_t i)
+            {
+                pieces[i].lexemes = lex(pieces[i].text);
+            });
+
+            std::vector<Piece> ret;
+            ret.reserve(pieces.size());
+
+            std::uint32_t line = 1;
+
+            for (std::size_t i = 0; i < pieces.size(); ++i)
+            {
+                auto piece = std::move(pieces[i]);
+
+                // rare (a "func" at the start of a line in a string), so just lex it again along with the next piece
+                while (i + 1 < pieces.size() && endsInString(piece))
+                {
+                    ++i;
+                    piece.text = std::string_view(piece.text.data(), piece.text.size() + pieces[i].text.size());
+                    piece.lexemes = lex(piece.text);
+                }
+
+                piece.firstLine = line;
+
+                // the End token is on the last line
+                line += piece.lexemes.back().line - 1;
+
+                ret.push_back(std::move(piece));
+            }
+
+            return ret;
+        }
+    }
+
+    std::vector<std::string_view> split(std::string_view source, std::size_t pieces)
+    {
+        std::vector<std::string_view> ret;
+
+        std::size_t start = 0;
+
+        for (std::size_t i = 1; i < pieces; ++i)
+        {
+            // roughly even, and never before where the last piece started
+            auto target = std::max(static_cast<std::size_t>(static_cast<double>(source.size()) * i / pieces), start + 1);
+
+            if (target >= source.size())
+                break;
+
+            auto at = nextFunction(source, target);
+
+            if (at == std::string_view::npos)
+                break;
+
+            ret.push_back(source.substr(start, at - start));
+            start = at;
+        }
+
+        ret.push_back(source.substr(start));
+
+        return ret;
+    }
+
+    std::vector<Lexeme> lexParallel(std::string_view source, std::size_t workers)
+    {
+        workers = numWorkers(workers);
+
+        if (workers == 1)
+            return lex(source);
+
+        auto pieces = lexPieces(source, workers);
+
+        // where each piece's lexemes go, all but the last without their End
+        std::vector<std::size_t> starts(pieces.size() + 1);
+
+        for (std::size_t i = 0; i < pieces.size(); ++i)
+            starts[i + 1] = starts[i] + pieces[i].lexemes.size() - (i + 1 < pieces.size() ? 1 : 0);
+
+        std::vector<Lexeme> ret(starts.back());
+
+        forEach(pieces.size(), workers, [&](std::size_t i)
+        {
+            auto& piece = pieces[i];
+            auto out = ret.begin() + starts[i];
+
+            for (std::size_t l = 0; l < starts[i + 1] - starts[i]; ++l, ++out)
+            {
+                *out = piece.lexemes[l];
+                out->line += piece.firstLine - 1;
+                out->offset += piece.offset;
+            }
+        });
+
+        return ret;
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "Lexer.hpp"
+
+namespace sl
+{
+	/*
+		Lexing a large source on several threads.
+		The source is split where a line starts with "func" (outside of a string), which can only be a top level
+		function, so each piece lexes on its own. Line numbers and offsets are then shifted by where each piece
+		starts, so tokens come out as if it had all been done in one go.
+		Parsing isn't split yet: the parser doesn't finish on any input, so there'd be nothing to check it against.
+	*/
+
+	// about 'pieces' consecutive pieces of 'source' (fewer if there aren't enough functions), each but the first
+	// starting with a "func" at the start of a line. May split inside a multi line string, lexParallel() checks
+	// for that, and puts those pieces back together
+	std::vector<std::string_view> split(std::string_view source, std::size_t pieces);
+
+	// the same as lex(source), on 'workers' threads, counting the calling one. 0 is one per core
+	std::vector<Lexeme> lexParallel(std::string_view source, std::size_t workers = 0);
+}
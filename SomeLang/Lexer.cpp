@@ -1,36 +1,350 @@
 #include "Lexer.hpp"
 
 #include <istream>
-#include <sstream>
-#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SL_SSE2
+#endif
+
+// GCC and Clang compile the AVX2 scanner for it whatever they target, it's only used if the CPU has it (see available()).
+// Other compilers only have it if they target AVX2 to begin with
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SL_AVX2
+#define SL_AVX2_TARGET __attribute__((target("avx2")))
+#define SL_AVX2_FLATTEN __attribute__((target("avx2"), flatten))
+#define SL_AVX2_RUNTIME
+
+// the scanners' templates are instantiated for AVX2 blocks without AVX2 too, but those are only ever inlined into
+// scanAvx2(), never called across the ABI they warn about
+#ifndef __clang__
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define SL_AVX2
+#define SL_AVX2_TARGET
+#define SL_AVX2_FLATTEN
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace sl
 {
-    static sl::Token number(char first, std::istream& in, size_t line, size_t position);
-    static sl::Token string(char first, std::istream& in, size_t line, size_t position);
-    static sl::Token boolean(char first, std::istream& in, size_t line, size_t position);
-    static sl::Token func(char first, std::istream& in, size_t line, size_t position);
-    static sl::Token identifier(char first, std::istream& in, size_t line, size_t position);
+    namespace
+    {
+        bool alpha(char ch)
+        {
+            return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z');
+        }
 
-    std::vector<Token> lex(std::istream& in)
+        // 'bits' can't be 0
+        unsigned lowestBit(std::uint32_t bits)
+        {
+#ifdef _MSC_VER
+            unsigned long idx;
+            _BitScanForward(&idx, bits);
+            return idx;
+#else
+            return __builtin_ctz(bits);
+#endif
+        }
+
+        /*
+            How a block of bytes is compared, for each Scanner. Each comparison gives all ones in the bytes it's true of,
+            and mask() one bit per byte.
+            Comparisons are signed, which is fine for ASCII ranges: anything over 0x7f is negative, so never in them.
+        */
+        struct ScalarBlocks
+        {
+            // the byte, then 1 where a comparison is true of it
+            using Block = std::uint32_t;
+            static constexpr std::size_t WIDTH = 1;
+
+            static Block load(const char* ptr)
+            {
+                return static_cast<unsigned char>(*ptr);
+            }
+
+            static Block is(Block block, char ch)
+            {
+                return block == static_cast<unsigned char>(ch);
+            }
+
+            static Block between(Block block, char low, char high)
+            {
+                auto ch = static_cast<signed char>(block);
+                return low <= ch && ch <= high;
+            }
+
+            static Block either(Block a, Block b)
+            {
+                return a | b;
+            }
+
+            static std::uint32_t mask(Block block)
+            {
+                return block;
+            }
+        };
+
+#ifdef SL_SSE2
+        struct Sse2Blocks
+        {
+            using Block = __m128i;
+            static constexpr std::size_t WIDTH = 16;
+
+            static Block load(const char* ptr)
+            {
+                return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+            }
+
+            static Block is(Block block, char ch)
+            {
+                return _mm_cmpeq_epi8(block, _mm_set1_epi8(ch));
+            }
+
+            static Block between(Block block, char low, char high)
+            {
+                return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(low - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(high + 1), block));
+            }
+
+            static Block either(Block a, Block b)
+            {
+                return _mm_or_si128(a, b);
+            }
+
+            static std::uint32_t mask(Block block)
+            {
+                return static_cast<std::uint32_t>(_mm_movemask_epi8(block));
+            }
+        };
+#endif
+
+#ifdef SL_AVX2
+        struct Avx2Blocks
+        {
+            using Block = __m256i;
+            static constexpr std::size_t WIDTH = 32;
+
+            SL_AVX2_TARGET static Block load(const char* ptr)
+            {
+                return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+            }
+
+            SL_AVX2_TARGET static Block is(Block block, char ch)
+            {
+                return _mm256_cmpeq_epi8(block, _mm256_set1_epi8(ch));
+            }
+
+            SL_AVX2_TARGET static Block between(Block block, char low, char high)
+            {
+                return _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8(low - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), block));
+            }
+
+            SL_AVX2_TARGET static Block either(Block a, Block b)
+            {
+                return _mm256_or_si256(a, b);
+            }
+
+            SL_AVX2_TARGET static std::uint32_t mask(Block block)
+            {
+                return static_cast<std::uint32_t>(_mm256_movemask_epi8(block));
+            }
+        };
+#endif
+
+        // what each scan is looking for, a bit per byte of 'block' that's part of the run
+        struct Whitespace
+        {
+            template<typename Blocks>
+            static std::uint32_t in(const typename Blocks::Block& block)
+            {
+                return Blocks::mask(Blocks::either(Blocks::either(Blocks::is(block, ' '), Blocks::is(block, '\t')), Blocks::is(block, '\r')));
+            }
+        };
+
+        struct NotNewline
+        {
+            template<typename Blocks>
+            static std::uint32_t in(const typename Blocks::Block& block)
+            {
+                return ~Blocks::mask(Blocks::is(block, '\n'));
+            }
+        };
+
+        struct NotQuote
+        {
+            template<typename Blocks>
+            static std::uint32_t in(const typename Blocks::Block& block)
+            {
+                return ~Blocks::mask(Blocks::is(block, '"'));
+            }
+        };
+
+        struct IdentifierPart
+        {
+            template<typename Blocks>
+            static std::uint32_t in(const typename Blocks::Block& block)
+            {
+                auto letters = Blocks::either(Blocks::between(block, 'a', 'z'), Blocks::between(block, 'A', 'Z'));
+                auto rest = Blocks::either(Blocks::between(block, '0', '9'), Blocks::is(block, '_'));
+                return Blocks::mask(Blocks::either(letters, rest));
+            }
+        };
+
+        struct Digit
+        {
+            template<typename Blocks>
+            static std::uint32_t in(const typename Blocks::Block& block)
+            {
+                return Blocks::mask(Blocks::between(block, '0', '9'));
+            }
+        };
+
+        // advances while each byte is in the run, a block at a time, then a byte at a time for what's left
+        // (never reading past 'end', which may be the end of a mapping)
+        template<typename Blocks, typename Run>
+        const char* scanBlocks(const char* it, const char* end)
+        {
+            constexpr std::uint32_t ALL = static_cast<std::uint32_t>((std::uint64_t{ 1 } << Blocks::WIDTH) - 1);
+
+            while (static_cast<std::size_t>(end - it) >= Blocks::WIDTH)
+            {
+                auto run = Run::template in<Blocks>(Blocks::load(it)) & ALL;
+
+                if (run != ALL)
+                    return it + lowestBit(~run & ALL);
+
+                it += Blocks::WIDTH;
+            }
+
+            if constexpr (Blocks::WIDTH > 1)
+                return scanBlocks<ScalarBlocks, Run>(it, end);
+            else
+                return it;
+        }
+
+#ifdef SL_AVX2
+        // the only way into the AVX2 scanner: everything it calls is inlined here, and so compiled for AVX2 too,
+        // though they're templates shared with the other scanners
+        template<typename Run>
+        SL_AVX2_FLATTEN const char* scanAvx2(const char* it, const char* end)
+        {
+            return scanBlocks<Avx2Blocks, Run>(it, end);
+        }
+#endif
+
+        template<typename Blocks, typename Run>
+        const char* scan(const char* it, const char* end)
+        {
+#ifdef SL_AVX2
+            if constexpr (std::is_same_v<Blocks, Avx2Blocks>)
+                return scanAvx2<Run>(it, end);
+            else
+#endif
+                return scanBlocks<Blocks, Run>(it, end);
+        }
+
+        // each of these returns where what it's scanning stops, never past 'end'
+
+        template<typename Blocks>
+        const char* whitespaceEnd(const char* it, const char* end)
+        {
+            return scan<Blocks, Whitespace>(it, end);
+        }
+
+        // the newline itself is left, it's still a token
+        template<typename Blocks>
+        const char* lineEnd(const char* it, const char* end)
+        {
+            return scan<Blocks, NotNewline>(it, end);
+        }
+
+        template<typename Blocks>
+        const char* identifierEnd(const char* it, const char* end)
+        {
+            return scan<Blocks, IdentifierPart>(it, end);
+        }
+
+        // digits, with at most one period
+        template<typename Blocks>
+        const char* numberEnd(const char* it, const char* end)
+        {
+            it = scan<Blocks, Digit>(it, end);
+
+            if (it != end && *it == '.')
+                it = scan<Blocks, Digit>(it + 1, end);
+
+            return it;
+        }
+
+        // just past the closing quote, or the end, if there isn't one
+        template<typename Blocks>
+        const char* stringEnd(const char* it, const char* end)
+        {
+            it = scan<Blocks, NotQuote>(it, end);
+
+            return it == end ? it : it + 1;
+        }
+
+        Token::Type keyword(std::string_view word)
+        {
+            if (word == "true" || word == "false")
+                return Token::Type::Bool;
+
+            if (word == "func")
+                return Token::Type::Func;
+
+            return Token::Type::Identifier;
+        }
+    }
+
+    std::string_view Lexeme::value(std::string_view source) const
     {
-        if(!in)
-            throw std::runtime_error("Unable to read input stream");
+        return source.substr(offset, length);
+    }
 
-        std::vector<Token> ret;
+    std::uint32_t Lexeme::column(std::string_view source) const
+    {
+        auto newline = source.substr(0, offset).rfind('\n');
+        auto lineStart = newline == std::string_view::npos ? 0 : newline + 1;
+
+        return static_cast<std::uint32_t>(offset - lineStart + 1);
+    }
 
-        size_t lineNumber = 1;
-        size_t position = 0;
+    template<typename Blocks>
+    static std::vector<Lexeme> lexWith(std::string_view source)
+    {
+        std::vector<Lexeme> ret;
 
-        //std::streampos lineStart = in.tellg();
-        //std::streampos lineEnd = lineStart;
+        // tokens are usually a few characters, with some space between them
+        ret.reserve(source.size() / 4 + 1);
 
-        char ch;
-        while (in.get(ch))
+        const char* begin = source.data();
+        const char* end = begin + source.size();
+        const char* it = begin;
+
+        std::uint32_t line = 1;
+
+        auto add = [&](Token::Type type, const char* start, const char* stop)
         {
-            ++position;
+            ret.push_back({ type, line, static_cast<std::uint32_t>(start - begin), static_cast<std::uint32_t>(stop - start) });
+        };
 
-            switch (ch)
+        while (it != end)
+        {
+            const char* start = it;
+
+            switch (*it)
             {
                 // number literal
                 case '+':
@@ -45,276 +359,177 @@ namespace sl
                 case '7':
                 case '8':
                 case '9':
-                    ret.push_back(number(ch, in, lineNumber, position));
-                    position += ret.back().value.length();
+                    it = numberEnd<Blocks>(it + 1, end);
+                    add(Token::Type::Number, start, it);
                     break;
 
-                // start of string
                 case '"':
-                    ret.push_back(string(ch, in, lineNumber, position));
-                    position += ret.back().value.length();
-                    break;
-
-                // possible start of boolean literal
-                case 't':
-                case 'f':
-                {
-                    auto t = boolean(ch, in, lineNumber, position);
-                    if (t.valid())
-                    {
-                        ret.push_back(t);
-                    }
-                    else
-                    {
-                        t = func(ch, in, lineNumber, position);
-                        if (t.valid())
-                            ret.push_back(t);
-                        else
-                            ret.push_back(identifier(ch, in, lineNumber, position));
-                    }
-
-                    position += ret.back().value.length();
+                    it = stringEnd<Blocks>(it + 1, end);
+                    add(Token::Type::String, start, it);
 
+                    // the token is on the line it starts on, but anything after it isn't
+                    line += static_cast<std::uint32_t>(std::count(start, it, '\n'));
                     break;
-                }
 
                 case '#':
-                    // for comments, skip until we find a newline
-                    while (in.get(ch) && ch != '\n');
-                    ++lineNumber;
-                    position = 0;
+                    it = lineEnd<Blocks>(it + 1, end);
                     break;
 
                 case '$':
-                    ret.emplace_back("$", Token::Type::Dollar, lineNumber, position);
-                    //ret.push_back(variable(ch, in, lineNumber, position));
+                    add(Token::Type::Dollar, start, ++it);
                     break;
 
                 case ';':
-                    ret.emplace_back(";", Token::Type::Semicolon, lineNumber, position);
+                    add(Token::Type::Semicolon, start, ++it);
                     break;
 
                 case ':':
-                    ret.emplace_back(":", Token::Type::Colon, lineNumber, position);
+                    add(Token::Type::Colon, start, ++it);
                     break;
 
                 case ',':
-                    ret.emplace_back(",", Token::Type::Comma, lineNumber, position);
+                    add(Token::Type::Comma, start, ++it);
                     break;
 
                 case '(':
-                    ret.emplace_back("(", Token::Type::ParenLeft, lineNumber, position);
+                    add(Token::Type::ParenLeft, start, ++it);
                     break;
 
                 case ')':
-                    ret.emplace_back(")", Token::Type::ParenRight, lineNumber, position);
+                    add(Token::Type::ParenRight, start, ++it);
                     break;
 
-                // whitespace
+                // on the line it ends
                 case '\n':
-                    ++lineNumber;
-                    position = 0;
-                    ret.emplace_back("", Token::Type::Newline, lineNumber, position);
+                    add(Token::Type::Newline, start, start);
+                    ++line;
+                    ++it;
                     break;
 
                 case '\r':
                 case '\t':
                 case ' ':
+                    it = whitespaceEnd<Blocks>(it + 1, end);
                     break;
 
-                // if it's not one of the above, it's likely an identifier
                 default:
-                    ret.push_back(identifier(ch, in, lineNumber, position));
-                    position += ret.back().value.length();
-                    break;
-            }
-        }
-
-        ret.emplace_back("\0", Token::Type::End, lineNumber, position + 1);
-
-        return ret;
-    }
-
-    sl::Token number(char first, std::istream& in, size_t line, size_t position)
-    {
-        sl::Token ret{ line, position };
-
-        bool hasPeriod = first == '.';
-
-        auto start = in.tellg();
-        bool done = false;
-        char ch;
-
-        while (!done && in.get(ch))
-        {
-            switch (ch)
-            {
-                case '.':
-                    if (!hasPeriod)
+                    if (alpha(*it))
                     {
-                        hasPeriod = true;
+                        it = identifierEnd<Blocks>(it + 1, end);
+                        add(keyword(std::string_view(start, it - start)), start, it);
                     }
                     else
                     {
-                        done = true;
-                        in.unget();
+                        add(Token::Type::Unknown, start, ++it);
                     }
                     break;
-
-                case '0':
-                case '1':
-                case '2':
-                case '3':
-                case '4':
-                case '5':
-                case '6':
-                case '7':
-                case '8':
-                case '9':
-                    // don't need to do anything!
-                    break;
-
-                default:
-                    done = true;
-                    in.unget();
-                    break;
             }
         }
 
-        auto end = in.tellg();
-
-        auto length = end - start;
-
-        // 'start' is actually the character after 'first'
-        ret.value.resize(length + 1);
-
-        ret.value[0] = first;
-        in.seekg(start);
-        in.read(&ret.value[1], length);
-
-        ret.type = sl::Token::Type::Number;
+        add(Token::Type::End, end, end);
 
         return ret;
     }
 
-    Token string(char first, std::istream& in, size_t line, size_t position)
+    bool available(Scanner scanner)
     {
-        Token ret{ line, position };
-
-        auto start = in.tellg();
-
-        // simply loop until we find the close quote
-        char ch;
-        while (in.get(ch) && ch != '"');
-
-        auto end = in.tellg();
-        auto length = end - start;
-
-        // 'start' is actually the character after 'first'
-        ret.value.resize(length + 1);
-        ret.value[0] = first;
+        switch (scanner)
+        {
+            case Scanner::Scalar:
+                return true;
+
+#ifdef SL_SSE2
+            case Scanner::Sse2:
+                return true;
+#endif
+
+#ifdef SL_AVX2
+            case Scanner::Avx2:
+#ifdef SL_AVX2_RUNTIME
+                return __builtin_cpu_supports("avx2");
+#else
+                return true;
+#endif
+#endif
+
+            default:
+                return false;
+        }
+    }
 
-        in.seekg(start);
-        in.read(&ret.value[1], length);
+    Scanner bestScanner()
+    {
+        // asking the CPU each time is a few instructions, next to lexing anything
+        if (available(Scanner::Avx2))
+            return Scanner::Avx2;
 
-        ret.type = Token::Type::String;
+        if (available(Scanner::Sse2))
+            return Scanner::Sse2;
 
-        return ret;
+        return Scanner::Scalar;
     }
 
-    Token boolean(char first, std::istream& in, size_t line, size_t position)
+    std::vector<Lexeme> lex(std::string_view source)
     {
-        Token ret{ line, position };
+        return lex(source, bestScanner());
+    }
 
-        if (first == 't')
-        {
-            char rue[3] = { '\0' };
-            in.read(rue, sizeof(rue));
+    std::vector<Lexeme> lex(std::string_view source, Scanner scanner)
+    {
+        if (source.size() >= std::numeric_limits<std::uint32_t>::max())
+            throw std::runtime_error("Unable to lex 4 GiB or more of source");
 
-            if (std::strncmp(rue, "rue", sizeof(rue)) == 0)
-            {
-                ret.value = "true";
-                ret.type = Token::Type::Bool;
-            }
-            else
-            {
-                in.seekg(-3, std::ios::cur);
-            }
-        }
-        else
+        switch (scanner)
         {
-            char alse[4] = { '\0' };
-            in.read(alse, sizeof(alse));
+            case Scanner::Scalar:
+                return lexWith<ScalarBlocks>(source);
 
-            if (std::strncmp(alse, "alse", sizeof(alse)) == 0)
-            {
-                ret.value = "false";
-                ret.type = Token::Type::Bool;
-            }
-            else
-            {
-                in.seekg(-4, std::ios::cur);
-            }
-        }
+#ifdef SL_SSE2
+            case Scanner::Sse2:
+                return lexWith<Sse2Blocks>(source);
+#endif
 
-        return ret;
-    }
+#ifdef SL_AVX2
+            case Scanner::Avx2:
+                if (!available(scanner))
+                    throw std::invalid_argument("This CPU doesn't have AVX2");
 
-    bool alpha(char ch)
-    {
-        return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z');
-    }
+                return lexWith<Avx2Blocks>(source);
+#endif
 
-    bool validIdentifier(char ch)
-    {
-        return alpha(ch) || ('0' <= ch && ch <= '9') || ch == '_';
+            default:
+                throw std::invalid_argument("That scanner isn't available in this build");
+        }
     }
 
-    Token func(char /*first*/, std::istream& in, size_t line, size_t position)
+    std::vector<Token> lex(std::istream& in)
     {
-        Token ret{ line, position };
-
-        char unc[3] = { '\0' };
-        in.read(unc, sizeof(unc));
+        if (!in)
+            throw std::runtime_error("Unable to read input stream");
 
-        if (std::strncmp(unc, "unc", sizeof(unc)) == 0)
-        {
-            ret.value = "func";
-            ret.type = Token::Type::Func;
-        }
-        else
-        {
-            in.seekg(-3, std::ios::cur);
-        }
+        std::string source{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
 
-        return ret;
+        return toTokens(source, lex(source));
     }
 
-    Token identifier(char first, std::istream& in, size_t line, size_t position)
+    std::vector<Token> toTokens(std::string_view source, const std::vector<Lexeme>& lexemes)
     {
-        Token ret{ line, position };
-
-        if (alpha(first))
-        {
-            auto start = in.tellg();
-
-            // greedy grab
-            char ch = 0;
-            size_t adv = 1;
-            while (in.get(ch) && validIdentifier(ch))
-                ++adv;
+        std::vector<Token> ret;
+        ret.reserve(lexemes.size());
 
-            // remove trailing failed character
-            if(adv > 1)
-                in.unget();
+        // same as Lexeme::column(), but without looking back over the line for every token
+        std::size_t scanned = 0;
+        std::size_t lineStart = 0;
 
-            // 'start' is the character after 'first'
-            ret.value.resize(adv + 1);
-            ret.value[0] = first;
-            in.seekg(start);
-            in.read(&ret.value[1], adv);
+        for (auto& l : lexemes)
+        {
+            for (; scanned < l.offset; ++scanned)
+            {
+                if (source[scanned] == '\n')
+                    lineStart = scanned + 1;
+            }
 
-            ret.type = Token::Type::Identifier;
+            ret.emplace_back(std::string(l.value(source)), l.type, l.line, l.offset - lineStart + 1);
         }
 
         return ret;
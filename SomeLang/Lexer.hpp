@@ -1,12 +1,56 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <iosfwd>
 
 #include "Token.hpp"
 
 namespace sl
 {
+	// a token as a slice of the source it was lexed from, see lex(std::string_view)
+	struct Lexeme
+	{
+		Token::Type type;
+		std::uint32_t line;
+		std::uint32_t offset;
+		std::uint32_t length;
+
+		// newlines and the end are empty
+		std::string_view value(std::string_view source) const;
+
+		// 1 based, found by looking back for the start of its line, so best left to diagnostics
+		std::uint32_t column(std::string_view source) const;
+	};
+
+	static_assert(sizeof(Lexeme) == 16, "Lexemes are meant to be small, there's one every few bytes of source");
+
+	// how runs of whitespace, comments, identifiers, numbers and strings are scanned: a byte at a time,
+	// or 16 (SSE2) or 32 (AVX2) at a time. SSE2 is there if the compiler targets it (always on x86-64).
+	// GCC and Clang build AVX2 in regardless, for when the CPU has it, other compilers need to target it (ie: /arch:AVX2)
+	enum class Scanner
+	{
+		Scalar,
+		Sse2,
+		Avx2,
+	};
+
+	// in this build, on this CPU
+	bool available(Scanner scanner);
+
+	// the widest available
+	Scanner bestScanner();
+
+	// the tokens of 'source', without copying any of it, so they're only valid as long as it is
+	// throws if 'source' is 4 GiB or more, or 'scanner' isn't available
+	std::vector<Lexeme> lex(std::string_view source);
+	std::vector<Lexeme> lex(std::string_view source, Scanner scanner);
+
+	// reads all of 'in', and copies each token's value out of it
 	std::vector<Token> lex(std::istream& in);
+
+	// copies each of the 'lexemes' of 'source' out of it
+	std::vector<Token> toTokens(std::string_view source, const std::vector<Lexeme>& lexemes);
 }
@@ -60,6 +60,11 @@ namespace sl
     static const char* toString(ParseLevel pl) noexcept;
 
     std::vector<Statement> parse(const std::string& streamName, std::istream& stream, const std::vector<Token>& tokens)
+    {
+        return parse(streamName, stream, tokens, std::cout);
+    }
+
+    std::vector<Statement> parse(const std::string& streamName, std::istream& stream, const std::vector<Token>& tokens, std::ostream& errors)
     {
         std::stack<ParseLevel> state;
         std::vector<Statement> ret;
@@ -184,7 +189,7 @@ namespace sl
             }
             catch (const ParseError& pe)
             {
-                std::cout << pe.what() << std::flush;
+                errors << pe.what() << std::flush;
                 // TODO attempt to recover
             }
         }
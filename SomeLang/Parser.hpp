@@ -13,6 +13,9 @@ namespace sl
 {
     std::vector<Statement> parse(const std::string& streamName, std::istream& stream, const std::vector<Token>& tokens);
 
+    // errors that are recovered from are written to 'errors' (std::cout above)
+    std::vector<Statement> parse(const std::string& streamName, std::istream& stream, const std::vector<Token>& tokens, std::ostream& errors);
+
     class ParseError : public std::exception
     {
     public:
@@ -0,0 +1,104 @@
+#include "Source.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace sl
+{
+    Source::Source(const std::string& file)
+    {
+#ifdef __linux__
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+            throw std::runtime_error("Unable to open source file: " + file);
+
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void* addr = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (addr != MAP_FAILED)
+            {
+                // read front to back, once
+                ::madvise(addr, info.st_size, MADV_SEQUENTIAL);
+
+                mapped = static_cast<const char*>(addr);
+                mappedSize = info.st_size;
+            }
+        }
+
+        ::close(fd);
+
+        // empty, or not something that can be mapped (a pipe...), so read it like anywhere else
+        if (mapped)
+            return;
+#endif
+
+        std::ifstream fin(file, std::ios::binary);
+
+        if (!fin)
+            throw std::runtime_error("Unable to open source file: " + file);
+
+        std::ostringstream oss;
+        oss << fin.rdbuf();
+        owned = oss.str();
+    }
+
+    Source Source::inMemory(std::string text)
+    {
+        Source ret;
+        ret.owned = std::move(text);
+        return ret;
+    }
+
+    Source::Source(Source&& other) noexcept
+        : mapped(std::exchange(other.mapped, nullptr)),
+        mappedSize(std::exchange(other.mappedSize, 0)),
+        owned(std::move(other.owned))
+    {}
+
+    Source& Source::operator=(Source&& other) noexcept
+    {
+        if (this != &other)
+        {
+            unmap();
+
+            mapped = std::exchange(other.mapped, nullptr);
+            mappedSize = std::exchange(other.mappedSize, 0);
+            owned = std::move(other.owned);
+        }
+
+        return *this;
+    }
+
+    Source::~Source()
+    {
+        unmap();
+    }
+
+    std::string_view Source::text() const
+    {
+        return mapped ? std::string_view(mapped, mappedSize) : std::string_view(owned);
+    }
+
+    void Source::unmap()
+    {
+#ifdef __linux__
+        if (mapped)
+            ::munmap(const_cast<char*>(mapped), mappedSize);
+#endif
+
+        mapped = nullptr;
+        mappedSize = 0;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace sl
+{
+	// a source file's text, memory mapped where possible (Linux), otherwise read in whole
+	class Source
+	{
+	public:
+		// throws if 'file' can't be opened
+		explicit Source(const std::string& file);
+
+		// text that's already in memory, ie: generated
+		static Source inMemory(std::string text);
+
+		Source(Source&& other) noexcept;
+		Source& operator=(Source&& other) noexcept;
+
+		Source(const Source&) = delete;
+		Source& operator=(const Source&) = delete;
+
+		~Source();
+
+		// valid for as long as we are
+		std::string_view text() const;
+
+	private:
+		Source() = default;
+
+		void unmap();
+
+		// null unless mapped, then 'owned' is empty
+		const char* mapped = nullptr;
+		std::size_t mappedSize = 0;
+
+		std::string owned;
+	};
+}
@@ -0,0 +1,23 @@
+#include "TraceDump.hpp"
+
+#include <ostream>
+#include <iomanip>
+
+#include "libSomeVM/Trace.hpp"
+
+namespace sl
+{
+	void printTrace(std::istream& input, std::ostream& output)
+	{
+		auto entries = svm::Trace::read(input);
+
+		output << entries.size() << " instructions, oldest first\n";
+
+		for (auto& e : entries)
+		{
+			output << std::setw(8) << ('f' + std::to_string(e.function))
+				<< std::setw(8) << ('+' + std::to_string(e.offset))
+				<< "  " << svm::Instruction::name(e.type) << '\n';
+		}
+	}
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <iosfwd>
+
+namespace sl
+{
+	// prints a trace file written by svm::Trace, one instruction per line, oldest first
+	void printTrace(std::istream& input, std::ostream& output);
+}
@@ -1,6 +1,7 @@
 #include "Util.hpp"
 
 #include <locale>
+#include <limits>
 #include <algorithm>
 
 namespace sl
@@ -42,7 +43,7 @@ namespace sl
 
         bool isInt(const std::string& str)
         {
-            std::uint64_t idx = 0;
+            std::uint64_t idx = std::numeric_limits<std::uint64_t>::max();
 
             while ((idx = str.find_first_not_of("0123456789", idx + 1)) != std::string::npos)
             {
@@ -1,18 +1,73 @@
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <string>
 
 #include "Lexer.hpp"
 #include "Token.hpp"
 #include "Parser.hpp"
+#include "Frontend.hpp"
+#include "Source.hpp"
 #include "Assembler.hpp"
+#include "TraceDump.hpp"
 
 int main(int argc, char** argv) try
 {
     // argv[1] is a filename to compile
-    if (argc < 1)
+    if (argc < 2)
         throw std::runtime_error("Not enough arguments, must provide a filename to compile.");
 
+    // print a trace dumped by the VM (see svm::Trace)
+    if (std::string(argv[1]) == "--trace")
+    {
+        if (argc < 3)
+            throw std::runtime_error("--trace expects a trace file");
+
+        std::ifstream trace{ argv[2], std::ios::binary };
+
+        if (!trace)
+            throw std::runtime_error(std::string("Unable to open trace file: ") + argv[2]);
+
+        sl::printTrace(trace, std::cout);
+        return 0;
+    }
+
+    // assemble a source file (see sl::Assembler) into a binary SomeVM can run
+    if (std::string(argv[1]) == "--assemble")
+    {
+        if (argc < 4)
+            throw std::runtime_error("--assemble expects a source file, and a binary to write");
+
+        std::ifstream source{ argv[2] };
+
+        if (!source)
+            throw std::runtime_error(std::string("Unable to open source file: ") + argv[2]);
+
+        auto program = sl::Assembler::run(source, std::cerr);
+
+        std::ofstream binary{ argv[3], std::ios::binary };
+
+        if (!binary)
+            throw std::runtime_error(std::string("Unable to write binary: ") + argv[3]);
+
+        program.write(binary);
+        return 0;
+    }
+
+    // lex on several threads, a piece of the file each (see sl::lexParallel), ie: SomeLang big.sl -j 8
+    // only lexes, the parser doesn't finish on any input yet
+    if (argc >= 4 && std::string(argv[2]) == "-j")
+    {
+        sl::Source source{ argv[1] };
+
+        auto lexemes = sl::lexParallel(source.text(), std::stoul(argv[3]));
+
+        for (auto& t : sl::toTokens(source.text(), lexemes))
+            std::cout << t << '\n';
+
+        return 0;
+    }
+
     std::ifstream fin{ argv[1] };
 
     auto tokens = sl::lex(fin);
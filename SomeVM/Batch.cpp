@@ -0,0 +1,119 @@
+#include "Batch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "libSomeVM/Module.hpp"
+
+namespace svm
+{
+	Batch::Batch(std::uint64_t numWorkers, VM::Dispatch dispatch)
+		: numWorkers(std::max<std::uint64_t>(numWorkers, 1)),
+		dispatch(dispatch),
+		lastWallTime(0)
+	{}
+
+	void Batch::add(Job job)
+	{
+		jobs.push_back(std::move(job));
+	}
+
+	std::vector<Batch::Result> Batch::run()
+	{
+		using Clock = std::chrono::steady_clock;
+
+		std::vector<Result> results(jobs.size());
+
+		// the only thing workers share: which job to take next
+		std::atomic<std::uint64_t> nextJob{ 0 };
+
+		auto work = [&]()
+		{
+			VM vm(256, dispatch);
+
+			for (auto idx = nextJob++; idx < jobs.size(); idx = nextJob++)
+			{
+				auto& job = jobs[idx];
+				auto& result = results[idx];
+
+				auto start = Clock::now();
+
+				try
+				{
+					vm.reset();
+					vm.load(job.module);
+
+					for (std::uint64_t i = 0; i < job.inputs.size(); ++i)
+						vm.write(job.inputs[i]);
+
+					vm.run();
+				}
+				catch (const std::exception& e)
+				{
+					result.error = e.what();
+				}
+
+				result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			}
+		};
+
+		auto start = Clock::now();
+
+		// the calling thread is a worker too
+		std::vector<std::thread> workers;
+		workers.reserve(numWorkers - 1);
+
+		for (std::uint64_t i = 1; i < numWorkers; ++i)
+			workers.emplace_back(work);
+
+		work();
+
+		for (auto& w : workers)
+			w.join();
+
+		lastWallTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+		return results;
+	}
+
+	void Batch::report(std::ostream& output, const std::vector<Result>& results) const
+	{
+		double busy = 0;
+		std::uint64_t failed = 0;
+
+		for (std::uint64_t i = 0; i < results.size() && i < jobs.size(); ++i)
+		{
+			auto& result = results[i];
+
+			output << std::fixed << std::setprecision(3) << std::setw(10) << result.seconds * 1000 << " ms  " << jobs[i].name;
+
+			if (!result.error.empty())
+			{
+				output << "  (failed: " << result.error << ')';
+				++failed;
+			}
+
+			output << '\n';
+
+			busy += result.seconds;
+		}
+
+		output << results.size() << " jobs (" << failed << " failed) on " << numWorkers << " workers in " << lastWallTime * 1000 << " ms\n";
+
+		if (lastWallTime > 0)
+		{
+			// utilization near 1 means the workers were never idle, ie: throughput scaled with the workers
+			output << "throughput: " << std::setprecision(1) << results.size() / lastWallTime << " jobs/s, "
+				<< "utilization: " << std::setprecision(2) << busy / (lastWallTime * numWorkers) << '\n';
+		}
+	}
+
+	double Batch::wallTime() const
+	{
+		return lastWallTime;
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <iosfwd>
+
+#include "libSomeVM/Value.hpp"
+#include "libSomeVM/VM.hpp"
+
+namespace svm
+{
+	class Module;
+
+	/*
+		Runs many jobs across a fixed pool of worker threads, each with its own VM.
+		Jobs only share their (immutable) Module, and each worker only writes to the results
+		of the jobs it took, so workers never wait on each other.
+	*/
+	class Batch
+	{
+	public:
+		struct Job
+		{
+			std::string name;
+			std::shared_ptr<const Module> module;
+
+			// written to registers 0, 1, ... before running
+			std::vector<Value> inputs;
+		};
+
+		struct Result
+		{
+			// wall time of just the run, not waiting to be picked up
+			double seconds;
+
+			// empty if the job ran successfully
+			std::string error;
+		};
+
+		Batch(std::uint64_t numWorkers, VM::Dispatch dispatch = VM::Dispatch::Decoded);
+
+		void add(Job job);
+
+		// runs every job added so far, returning their results in the order they were added
+		std::vector<Result> run();
+
+		// per-job times, followed by totals. Expects the results from the last run()
+		void report(std::ostream& output, const std::vector<Result>& results) const;
+
+		// seconds the last run() took
+		double wallTime() const;
+
+	private:
+		std::uint64_t numWorkers;
+		VM::Dispatch dispatch;
+
+		std::vector<Job> jobs;
+		double lastWallTime;
+	};
+}
@@ -0,0 +1,47 @@
+// in instrumented builds, counts every allocation of the process into libSomeVM's Counters (see libSomeVM/Counters.hpp)
+// here rather than in the library, so loading the library never replaces a program's operator new
+
+#ifdef SVM_INSTRUMENT
+
+#include <new>
+#include <cstdlib>
+
+#include "libSomeVM/Counters.hpp"
+
+// the other forms (nothrow, arrays, aligned) come back to these, or free with free() themselves
+void* operator new(std::size_t size)
+{
+	svm::Counters::allocation(size);
+
+	if (void* ptr = std::malloc(size != 0 ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return ::operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+#endif
@@ -1,22 +1,370 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
 
 #include "libSomeVM/VM.hpp"
 #include "libSomeVM/Program.hpp"
+#include "libSomeVM/Snapshot.hpp"
+#include "libSomeVM/Module.hpp"
+#include "libSomeVM/Scheduler.hpp"
+#include "libSomeVM/EventLoop.hpp"
+#include "libSomeVM/Profiler.hpp"
+#include "libSomeVM/PerfMap.hpp"
+#include "libSomeVM/HardwareCounters.hpp"
+#include "libSomeVM/Trace.hpp"
+#include "libSomeVM/Debugger.hpp"
+#include "libSomeVM/Metrics.hpp"
+
+#include "Batch.hpp"
+
+namespace
+{
+    std::shared_ptr<const svm::Module> loadModule(const std::string& file)
+    {
+        // read it all up front, so workers never have to take turns loading from the file
+        std::ifstream fin(file, std::ios::binary);
+
+        svm::Program program;
+        program.load(fin);
+
+        return std::make_shared<const svm::Module>(program);
+    }
+
+    // each line is a job, whose whitespace separated numbers are written to registers 0, 1, ...
+    std::vector<std::vector<svm::Value>> readInputs(const std::string& file)
+    {
+        std::ifstream fin(file);
+
+        if (!fin)
+            throw std::runtime_error("Unable to open inputs file: " + file);
+
+        std::vector<std::vector<svm::Value>> inputs;
+
+        std::string line;
+        while (std::getline(fin, line))
+        {
+            std::istringstream iss(line);
+            std::vector<svm::Value> values;
+
+            svm::Float f;
+            while (iss >> f)
+                values.emplace_back(f);
+
+            if (!values.empty())
+                inputs.push_back(std::move(values));
+        }
+
+        return inputs;
+    }
+}
 
 int main(int argc, char** argv) try
 {
-    if (argc == 2)
+    // a binary writing to a closed pipe gets false back (see SysCall.hpp), rather than killing us
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::string> args;
+    auto dispatch = svm::VM::Dispatch::Decoded;
+
+    std::string snapshotFile;
+    std::string restoreFile;
+    bool prerun = false;
+
+    bool batch = false;
+    bool events = false;
+    std::string inputsFile;
+    std::string profileFile;
+    std::string countersFile;
+    bool cycles = false;
+    bool perf = false;
+    bool quiet = false;
+    bool hardwareCounters = false;
+    std::string traceFile;
+    std::vector<svm::Breakpoint> breakpoints;
+    std::string metricsFile;
+    svm::Metrics metrics;
+    bool watching = false;
+    std::uint64_t numWorkers = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+
+        // unpack each instruction as it's run, rather than each function when it's first called
+        if (arg == "--packed")
+            dispatch = svm::VM::Dispatch::Packed;
+        else if (arg == "--snapshot" && i + 1 < argc)
+            snapshotFile = argv[++i];
+        else if (arg == "--restore" && i + 1 < argc)
+            restoreFile = argv[++i];
+        else if (arg == "--prerun")
+            prerun = true;
+        else if (arg == "--batch")
+            batch = true;
+        else if (arg == "--events")
+            events = true;
+        else if (arg == "--inputs" && i + 1 < argc)
+            inputsFile = argv[++i];
+        else if (arg == "--profile" && i + 1 < argc)
+            profileFile = argv[++i];
+        else if (arg == "--counters" && i + 1 < argc)
+            countersFile = argv[++i];
+        else if (arg == "--cycles")
+            cycles = true;
+        else if (arg == "--perf")
+            perf = true;
+        else if (arg == "--quiet")
+            quiet = true;
+        else if (arg == "--hw-counters")
+            hardwareCounters = true;
+        else if (arg == "--trace" && i + 1 < argc)
+            traceFile = argv[++i];
+        else if (arg == "--break" && i + 1 < argc)
+        {
+            // <function>:<instruction>
+            std::string where = argv[++i];
+            auto colon = where.find(':');
+
+            if (colon == std::string::npos)
+                throw std::runtime_error("--break expects <function>:<instruction>");
+
+            breakpoints.push_back({ std::stoull(where.substr(0, colon)), std::stoull(where.substr(colon + 1)) });
+        }
+        else if (arg == "--metrics" && i + 1 < argc)
+            metricsFile = argv[++i];
+        else if (arg == "--watch" && i + 1 < argc)
+        {
+            // <function>[=<name>]
+            std::string what = argv[++i];
+            auto equals = what.find('=');
+
+            metrics.watch(std::stoull(what.substr(0, equals)), equals == std::string::npos ? "" : what.substr(equals + 1));
+            watching = true;
+        }
+        else if (arg == "-j" && i + 1 < argc)
+            numWorkers = std::stoull(argv[++i]);
+        else
+            args.push_back(arg);
+    }
+
+#ifndef SVM_INSTRUMENT
+    if (!countersFile.empty())
+        throw std::runtime_error("--counters needs an instrumented build (make instrument)");
+#endif
+
+    if (cycles && countersFile.empty())
+        throw std::runtime_error("--cycles only goes with --counters");
+
+    // options that only some ways of running use, rather than quietly running without them
+    bool watched = !profileFile.empty() || !countersFile.empty() || perf || hardwareCounters || !traceFile.empty()
+        || !metricsFile.empty() || !breakpoints.empty();
+
+    if (batch && (watched || !snapshotFile.empty() || !restoreFile.empty()))
+        throw std::runtime_error("--batch doesn't go with --profile, --counters, --perf, --hw-counters, --trace, --metrics, --break, --snapshot or --restore");
+
+    if (!batch && (events || !inputsFile.empty()))
+        throw std::runtime_error("--events and --inputs only go with --batch");
+
+    if (!snapshotFile.empty() && (watched || !restoreFile.empty()))
+        throw std::runtime_error("--snapshot doesn't go with --profile, --counters, --perf, --hw-counters, --trace, --metrics, --break or --restore");
+
+    if (prerun && snapshotFile.empty())
+        throw std::runtime_error("--prerun only goes with --snapshot");
+
+    if (!restoreFile.empty() && !args.empty())
+        throw std::runtime_error("--restore runs a snapshot instead of a binary, so it doesn't take one");
+
+    if (!breakpoints.empty() && !profileFile.empty())
+        throw std::runtime_error("--break doesn't go with --profile");
+
+    if (watching && metricsFile.empty())
+        throw std::runtime_error("--watch only goes with --metrics");
+
+    if (batch && !args.empty())
+    {
+        std::vector<svm::Batch::Job> jobs;
+
+        if (!inputsFile.empty())
+        {
+            if (args.size() != 1)
+                throw std::runtime_error("--inputs expects a single binary");
+
+            auto module = loadModule(args[0]);
+            auto inputs = readInputs(inputsFile);
+
+            for (std::uint64_t i = 0; i < inputs.size(); ++i)
+                jobs.push_back({ args[0] + " #" + std::to_string(i), module, std::move(inputs[i]) });
+        }
+        else
+        {
+            for (auto& file : args)
+                jobs.push_back({ file, loadModule(file), {} });
+        }
+
+        if (events)
+        {
+            svm::EventLoop loop(256, dispatch);
+
+            for (auto& job : jobs)
+                loop.add(job.module, std::move(job.inputs));
+
+            auto start = std::chrono::steady_clock::now();
+            loop.run();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+            for (std::uint64_t i = 0; i < jobs.size(); ++i)
+            {
+                if (!loop.error(i).empty())
+                    std::cout << jobs[i].name << " failed: " << loop.error(i) << '\n';
+            }
+
+            auto stats = loop.stats();
+            std::cout << jobs.size() << " jobs (" << stats.failed << " failed) on one thread in " << elapsed.count() << " ms, "
+                      << stats.suspensions << " waits on I/O, at most " << stats.maxWaiting << " waiting at once\n";
+        }
+        else
+        {
+            svm::Batch pool(numWorkers, dispatch);
+
+            for (auto& job : jobs)
+                pool.add(std::move(job));
+
+            auto results = pool.run();
+            pool.report(std::cout, results);
+        }
+
+        // meant to be scripted, so don't wait for <Enter>
+        return 0;
+    }
+    else if (args.size() == 1 || !restoreFile.empty())
     {
         svm::Program program;
-        std::ifstream fin{ argv[1] };
-        auto bytes = program.load(fin);
+        svm::VM vm(256, dispatch);
+        vm.setWorkers(numWorkers);
+
+        if (!restoreFile.empty())
+            vm.restore(std::make_shared<svm::Snapshot>(restoreFile));
+        else
+        {
+            // function bytecode is read from the file as it's called, so the program keeps the file open
+            auto fin = std::make_shared<std::ifstream>(args[0], std::ios::binary);
+            auto bytes = program.load(fin);
+
+            if (!quiet)
+                std::cout << "Loaded " << bytes << " bytes.\n";
+
+            vm.load(program);
+        }
+
+#ifdef SVM_INSTRUMENT
+        vm.counters().countCycles(cycles);
+#endif
+
+        std::unique_ptr<svm::PerfMap> perfMap;
+        if (perf)
+        {
+            perfMap = std::make_unique<svm::PerfMap>();
+            vm.setPerfMap(perfMap.get());
 
-        std::cout << "Loaded " << bytes << " bytes.\n";
+            std::cout << "Writing perf symbols to " << perfMap->path() << ".\n";
+        }
 
-        svm::VM vm;
-        vm.load(program);
-        vm.run();
+        std::unique_ptr<svm::Trace> trace;
+        if (!traceFile.empty())
+        {
+            trace = std::make_unique<svm::Trace>(1 << 16, traceFile);
+            vm.setTrace(trace.get());
+
+            svm::Trace::dumpOnSignal(SIGUSR1);
+            std::cout << "Tracing, the last instructions are written to " << traceFile << " on an error, or SIGUSR1.\n";
+        }
+
+        if (!metricsFile.empty())
+            vm.setMetrics(&metrics);
+
+        std::unique_ptr<svm::HardwareCounters> counters;
+        if (hardwareCounters)
+        {
+            counters = std::make_unique<svm::HardwareCounters>();
+            vm.setHardwareCounters(counters.get());
+        }
+
+        if (!snapshotFile.empty())
+        {
+            if (prerun)
+                vm.run();
+
+            std::ofstream fout{ snapshotFile, std::ios::binary };
+            vm.snapshot(fout);
+
+            std::cout << "Wrote snapshot to " << snapshotFile << ".\n";
+        }
+        else if (!breakpoints.empty())
+        {
+            svm::Debugger debugger(vm);
+            debugger.run(breakpoints, std::cin, std::cout);
+        }
+        else if (!profileFile.empty())
+        {
+            svm::Profiler profiler;
+            vm.setProfiler(&profiler);
+
+            profiler.start();
+            vm.run();
+            profiler.stop();
+
+            std::ofstream fout{ profileFile };
+            profiler.writeFolded(fout);
+            profiler.writeTable(std::cout);
+
+            std::cout << "Wrote " << profiler.samples() << " samples to " << profileFile << ".\n";
+        }
+        else
+        {
+            vm.run();
+
+            auto* scheduler = vm.scheduler();
+
+            if (scheduler && !quiet)
+            {
+                auto stats = scheduler->stats();
+
+                std::cout << "Tasks: " << stats.spawned << " spawned, " << stats.executed << " run on " << scheduler->workers()
+                          << " workers, " << stats.steals << " stolen, " << stats.idle << " idle\n";
+            }
+        }
+
+        if (counters)
+            counters->writeTable(std::cout);
+
+        if (!metricsFile.empty())
+        {
+            metrics.save(metricsFile);
+
+            if (!quiet)
+                std::cout << "Wrote metrics to " << metricsFile << ".\n";
+        }
+
+#ifdef SVM_INSTRUMENT
+        if (!countersFile.empty())
+        {
+            std::ofstream fout{ countersFile };
+            vm.counters().writeJson(fout);
+
+            auto sum = vm.counters().sum();
+
+            if (!quiet)
+                std::cout << "Ran " << vm.counters().total() << " instructions, " << sum.calls << " calls, " << sum.allocations
+                          << " allocations of " << sum.bytes << " bytes" << (cycles ? ", in " + std::to_string(sum.cycles) + " cycles" : "") << ".\n"
+                          << "Wrote counts per function to " << countersFile << ".\n";
+        }
+#endif
     }
     else
     {
@@ -24,8 +372,30 @@ int main(int argc, char** argv) try
         std::cout << "0 args: repl mode\n";
         std::cout << "1 arg:  binary to execute\n";
         std::cout << "2 args: input file to assemble, and output file to create\n";
+        std::cout << "options:\n";
+        std::cout << "--packed: unpack instructions as they're run, instead of once per function\n";
+        std::cout << "--snapshot <file>: write a snapshot of the loaded binary to <file>, instead of running it (run the snapshot with --restore to profile, trace, etc.)\n";
+        std::cout << "--prerun: with --snapshot, run the binary before writing the snapshot\n";
+        std::cout << "--restore <file>: run from a snapshot, instead of a binary, with any of the options below that --batch doesn't take\n";
+        std::cout << "--batch <binaries...>: run every binary, on a pool of threads, and report their times (none of --profile, --counters, --perf, --hw-counters, --trace, --metrics or --break)\n";
+        std::cout << "--events: with --batch, run every job on one thread, switching between them while they wait on I/O\n";
+        std::cout << "--inputs <file>: with --batch and one binary, run it once per line of numbers in <file>\n";
+        std::cout << "--profile <file>: sample the binary's call stack as it runs, writing folded stacks (for flame graphs) to <file>\n";
+        std::cout << "--counters <file>: write how often each instruction ran, and the calls and allocations of each function, to <file>, as JSON (only in builds from \"make instrument\")\n";
+        std::cout << "--cycles: with --counters, also count the rdtsc cycles each function's instructions take (x86 only, and not deterministic)\n";
+        std::cout << "--quiet: only print what the binary does, not when it's loaded or task statistics, and don't wait for <Enter> at exit\n";
+        std::cout << "--perf: name functions for Linux perf (\"perf record -g\"), in /tmp/perf-<pid>.map\n";
+        std::cout << "--hw-counters: count cycles, instructions, branch and cache misses per function, and print them at exit\n";
+        std::cout << "--trace <file>: keep the last instructions run, writing them to <file> on an error, or SIGUSR1 (read with \"SomeLang --trace <file>\")\n";
+        std::cout << "--metrics <file>: write the run's latency, and instruction and allocation counts, to <file>, as JSON if it ends in .json, otherwise for Prometheus\n";
+        std::cout << "--watch <function>[=<name>]: with --metrics, also time every call to <function>, may be repeated\n";
+        std::cout << "--break <function>:<instruction>: stop there and take debugger commands, may be repeated\n";
+        std::cout << "-j <n>: the number of threads to run batch jobs, or spawned tasks, on (default: one per core)\n";
     }
 
+    if (quiet)
+        return 0;
+
     std::cout << "Press <Enter> to continue...";
     std::cin.get();
 
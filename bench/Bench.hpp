@@ -0,0 +1,264 @@
+#pragma once
+
+// shared by the benchmark programs: timing and reporting (Suite), and building bytecode by hand (Builder)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+
+#include "libSomeVM/VM.hpp"
+#include "libSomeVM/Module.hpp"
+#include "libSomeVM/Program.hpp"
+#include "libSomeVM/SysCall.hpp"
+
+namespace bench
+{
+	using Clock = std::chrono::steady_clock;
+
+	// integers are stored in the mantissa, with an exponent of +1 (see VM::getInteger)
+	inline svm::Value integer(std::uint64_t i)
+	{
+		return svm::Value::fromBits(0x3ff0000000000000u | i);
+	}
+
+	inline double seconds(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	// keeps the compiler from optimizing away what's being measured
+	template<typename T>
+	inline void keep(const T& value)
+	{
+		asm volatile("" : : "g"(&value) : "memory");
+	}
+
+	/*
+		Times each benchmark over a number of runs, after some warm-up runs that aren't counted,
+		and reports the median and percentiles of the time per item (instruction, byte, value...).
+
+		Every benchmark program takes:
+			--runs <n>		timed runs of each benchmark (default 15)
+			--warmup <n>	untimed runs first (default 3)
+			--filter <str>	only benchmarks with <str> in their name
+			--json <file>	also write the results, with every run's time, as JSON
+	*/
+	class Suite
+	{
+	public:
+		struct Result
+		{
+			std::string name;
+			std::string unit;
+			std::uint64_t items;
+
+			// nanoseconds per item, one per run, sorted
+			std::vector<double> samples;
+
+			// 'p' in [0, 1], nearest rank
+			double percentile(double p) const
+			{
+				auto rank = static_cast<std::size_t>(p * (samples.size() - 1) + 0.5);
+				return samples[rank];
+			}
+		};
+
+		Suite(std::string name, int argc, char** argv)
+			: name(std::move(name)),
+			runs(15),
+			warmup(3)
+		{
+			for (int i = 1; i + 1 < argc; i += 2)
+			{
+				std::string arg = argv[i];
+
+				if (arg == "--runs")
+					runs = std::max(std::atoi(argv[i + 1]), 1);
+				else if (arg == "--warmup")
+					warmup = std::max(std::atoi(argv[i + 1]), 0);
+				else if (arg == "--filter")
+					filter = argv[i + 1];
+				else if (arg == "--json")
+					jsonFile = argv[i + 1];
+			}
+
+			std::printf("%-36s %12s %12s %12s %12s  %s\n", this->name.c_str(), "median", "p10", "p90", "per second", "per");
+		}
+
+		// times 'run', which does 'items' of whatever's being measured, ie: runs a VM 'items' instructions long
+		// false if --filter leaves it out
+		bool selected(const std::string& benchmark) const
+		{
+			return filter.empty() || benchmark.find(filter) != std::string::npos;
+		}
+
+		template<typename F>
+		void add(const std::string& benchmark, const std::string& unit, std::uint64_t items, F run)
+		{
+			if (!selected(benchmark))
+				return;
+
+			for (int i = 0; i < warmup; ++i)
+				run();
+
+			Result result{ benchmark, unit, items, {} };
+
+			for (int i = 0; i < runs; ++i)
+			{
+				auto start = Clock::now();
+				run();
+				result.samples.push_back(seconds(start) * 1e9 / items);
+			}
+
+			std::sort(result.samples.begin(), result.samples.end());
+
+			auto median = result.percentile(0.5);
+			std::printf("%-36s %12s %12s %12s %12.4g  %s\n", benchmark.c_str(), duration(median).c_str(),
+						duration(result.percentile(0.1)).c_str(), duration(result.percentile(0.9)).c_str(), 1e9 / median, unit.c_str());
+
+			results.push_back(std::move(result));
+		}
+
+		// writes the JSON file, if asked for. Returns what main() should
+		int finish() const
+		{
+			if (jsonFile.empty())
+				return 0;
+
+			std::ofstream fout{ jsonFile };
+
+			if (!fout)
+			{
+				std::fprintf(stderr, "Unable to write %s\n", jsonFile.c_str());
+				return 1;
+			}
+
+			// enough to compare runs of whole programs down to the ns
+			fout.precision(12);
+
+			fout << "{\n\t\"suite\": \"" << name << "\",\n\t\"runs\": " << runs << ",\n\t\"warmup\": " << warmup << ",\n\t\"results\": [";
+
+			for (std::size_t i = 0; i < results.size(); ++i)
+			{
+				auto& r = results[i];
+
+				fout << (i == 0 ? "\n" : ",\n") << "\t\t{ \"name\": \"" << r.name << "\", \"unit\": \"" << r.unit << "\", \"items\": " << r.items
+					 << ", \"median_ns\": " << r.percentile(0.5) << ", \"p10_ns\": " << r.percentile(0.1) << ", \"p90_ns\": " << r.percentile(0.9)
+					 << ", \"min_ns\": " << r.samples.front() << ", \"max_ns\": " << r.samples.back() << ", \"samples_ns\": [";
+
+				for (std::size_t s = 0; s < r.samples.size(); ++s)
+					fout << (s == 0 ? "" : ", ") << r.samples[s];
+
+				fout << "] }";
+			}
+
+			fout << "\n\t]\n}\n";
+			return 0;
+		}
+
+	private:
+		// in the largest unit that keeps it over 1
+		static std::string duration(double ns)
+		{
+			static const char* units[] = { "ns", "us", "ms", "s" };
+
+			int unit = 0;
+			for (; unit < 3 && ns >= 1000; ++unit)
+				ns /= 1000;
+
+			char str[32];
+			std::snprintf(str, sizeof(str), "%.2f %s", ns, units[unit]);
+			return str;
+		}
+
+		std::string name;
+		int runs;
+		int warmup;
+		std::string filter;
+		std::string jsonFile;
+
+		std::vector<Result> results;
+	};
+
+	// just enough of an assembler to write benchmarks with, one function at a time
+	struct Builder
+	{
+		using Type = svm::Instruction::Type;
+
+		svm::Program program;
+		svm::Bytecode code;
+
+		std::uint32_t constant(svm::Value val)
+		{
+			program.constants.push_back(val);
+			return static_cast<std::uint32_t>(program.constants.size() - 1);
+		}
+
+		void load(std::uint32_t reg, svm::Value val)
+		{
+			code.emplace_back(Type::LoadC, reg, constant(val));
+		}
+
+		void op(Type type, std::uint16_t one, std::uint16_t two, std::uint16_t three)
+		{
+			code.emplace_back(type, one, two, three);
+		}
+
+		std::uint64_t here() const
+		{
+			return code.size();
+		}
+
+		// returns the constant holding the target, for patching forward jumps
+		std::uint32_t jumpIfFalse(std::uint32_t reg, std::uint64_t target = 0)
+		{
+			auto c = constant(integer(target));
+			code.emplace_back(Type::JmpFC, reg, c);
+			return c;
+		}
+
+		std::uint32_t jumpIfTrue(std::uint32_t reg, std::uint64_t target = 0)
+		{
+			auto c = constant(integer(target));
+			code.emplace_back(Type::JmpTC, reg, c);
+			return c;
+		}
+
+		void jump(std::uint64_t target)
+		{
+			code.emplace_back(Type::JmpC, std::uint64_t{ constant(integer(target)) });
+		}
+
+		// syscall with its arguments starting at register 10
+		void sysCall(svm::SysCall call, std::uint64_t nargs)
+		{
+			load(20, integer(nargs));
+			load(21, integer(10));
+			load(22, integer(static_cast<std::uint64_t>(call)));
+			op(Type::SysCall, 20, 21, 22);
+		}
+
+		// ends the function being written, and starts on the next one
+		void endFunction(std::uint8_t numReturns = 0, std::uint8_t numArgs = 0)
+		{
+			// jumps to the end need an instruction to land on
+			code.emplace_back(Type::Nop, std::uint64_t{ 0 });
+			program.functions.emplace_back(numReturns, numArgs, code);
+			code.clear();
+		}
+
+		std::shared_ptr<const svm::Module> finish()
+		{
+			if (!code.empty() || program.functions.empty())
+				endFunction();
+
+			return std::make_shared<const svm::Module>(program);
+		}
+	};
+}
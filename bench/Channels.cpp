@@ -0,0 +1,187 @@
+// channel throughput: raw Channel operations between threads, then a 3 stage pipeline of VMs on separate threads
+
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+#include "libSomeVM/Channel.hpp"
+
+#include "Bench.hpp"
+
+namespace
+{
+	using namespace svm;
+	using namespace bench;
+	using Type = Instruction::Type;
+
+	void raw(Channel::Kind kind, std::uint64_t producers, std::uint64_t consumers, std::uint64_t count)
+	{
+		auto handle = Channel::create(1024, kind);
+		auto* chan = Channel::get(handle);
+		auto perProducer = count / producers;
+
+		std::vector<std::thread> threads;
+		std::vector<double> sums(consumers);
+
+		for (std::uint64_t p = 0; p < producers; ++p)
+		{
+			threads.emplace_back([=]()
+			{
+				for (std::uint64_t i = 0; i < perProducer; ++i)
+				{
+					Value v{ static_cast<Float>(i) };
+
+					while (!chan->trySend(v))
+						std::this_thread::yield();
+				}
+			});
+		}
+
+		for (std::uint64_t c = 0; c < consumers; ++c)
+		{
+			threads.emplace_back([&, c]()
+			{
+				Value v;
+
+				while (true)
+				{
+					if (chan->tryRecv(v))
+						sums[c] += static_cast<Float>(v);
+					else if (chan->closed() && !chan->tryRecv(v))
+						break;
+					else
+						std::this_thread::yield();
+				}
+			});
+		}
+
+		for (std::uint64_t p = 0; p < producers; ++p)
+			threads[p].join();
+
+		chan->close();
+
+		for (std::uint64_t c = 0; c < consumers; ++c)
+			threads[producers + c].join();
+	}
+
+	// r0: channel, r1: count. sends 0 to count - 1, then closes
+	std::shared_ptr<const Module> producer()
+	{
+		Builder b;
+		b.load(2, Float(0));
+		b.load(3, Float(1));
+
+		auto top = b.here();
+		b.op(Type::Lt, 4, 2, 1);
+		auto end = b.jumpIfFalse(4);
+
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 0 });
+		b.code.emplace_back(Type::Load, std::uint32_t{ 11 }, std::uint32_t{ 2 });
+		b.sysCall(SysCall::Send, 2);
+
+		b.op(Type::Add, 2, 2, 3);
+		b.jump(top);
+
+		b.program.constants[end] = integer(b.here());
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 0 });
+		b.sysCall(SysCall::CloseChannel, 1);
+
+		return b.finish();
+	}
+
+	// r0: in, r1: out. doubles everything from 'in', sends it to 'out', and closes 'out' once 'in' is done
+	std::shared_ptr<const Module> stage()
+	{
+		Builder b;
+
+		auto top = b.here();
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 0 });
+		b.sysCall(SysCall::Recv, 1);
+		auto end = b.jumpIfFalse(11);
+
+		b.op(Type::Add, 11, 10, 10);
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 1 });
+		b.sysCall(SysCall::Send, 2);
+		b.jump(top);
+
+		b.program.constants[end] = integer(b.here());
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 1 });
+		b.sysCall(SysCall::CloseChannel, 1);
+
+		return b.finish();
+	}
+
+	// r0: in. sums everything into r5
+	std::shared_ptr<const Module> consumer()
+	{
+		Builder b;
+		b.load(5, Float(0));
+
+		auto top = b.here();
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 0 });
+		b.sysCall(SysCall::Recv, 1);
+		auto end = b.jumpIfFalse(11);
+
+		b.op(Type::Add, 5, 5, 10);
+		b.jump(top);
+
+		b.program.constants[end] = integer(b.here());
+
+		return b.finish();
+	}
+
+	void pipeline(Channel::Kind kind, std::uint64_t count)
+	{
+		auto first = Channel::create(1024, kind);
+		auto second = Channel::create(1024, kind);
+
+		VM source(32), middle(32), sink(32);
+
+		source.load(producer());
+		source.write(0, first);
+		source.write(1, Float(count));
+
+		middle.load(stage());
+		middle.write(0, first);
+		middle.write(1, second);
+
+		sink.load(consumer());
+		sink.write(0, second);
+
+		std::thread a([&]() { source.run(); });
+		std::thread b([&]() { middle.run(); });
+		sink.run();
+
+		a.join();
+		b.join();
+
+		auto expected = static_cast<Float>(count) * (count - 1);
+
+		if (static_cast<Float>(sink.read(5)) != expected)
+			throw std::runtime_error("Pipeline gave the wrong result");
+	}
+}
+
+int main(int argc, char** argv) try
+{
+	std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+
+	bench::Suite suite("channels", argc, argv);
+
+	constexpr std::uint64_t COUNT = 1000000;
+
+	suite.add("single 1p/1c", "value", COUNT, []() { raw(Channel::Kind::Single, 1, 1, COUNT); });
+	suite.add("multi 1p/1c", "value", COUNT, []() { raw(Channel::Kind::Multi, 1, 1, COUNT); });
+	suite.add("multi 2p/2c", "value", COUNT, []() { raw(Channel::Kind::Multi, 2, 2, COUNT); });
+	suite.add("multi 4p/4c", "value", COUNT, []() { raw(Channel::Kind::Multi, 4, 4, COUNT); });
+
+	suite.add("single 3 VMs", "value", COUNT / 10, []() { pipeline(Channel::Kind::Single, COUNT / 10); });
+	suite.add("multi 3 VMs", "value", COUNT / 10, []() { pipeline(Channel::Kind::Multi, COUNT / 10); });
+
+	return suite.finish();
+}
+catch (const std::exception& ex)
+{
+	std::fprintf(stderr, "%s\n", ex.what());
+	return 1;
+}
@@ -0,0 +1,463 @@
+// compares two result files, old then new: either both from a benchmark's --json (see Bench.hpp), or both from SomeVM's --counters
+// exits with 1 if anything got slower (or bigger) by more than the threshold, 2 if the files couldn't be compared
+//
+// timings go through a Mann-Whitney U test on every run's time, and their change is the Hodges-Lehmann estimate
+// (the median of the differences between every pair of old and new runs), with its distribution-free confidence interval
+// counts are deterministic, so their change is exact, and any change past the threshold counts. Cycles are only reported
+//
+//	--threshold <percent>	how much slower is a regression (default 2)
+//	--alpha <p>				significance level of the test, and 1 - the confidence of the intervals (default 0.05)
+
+#include <cmath>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "Stats.hpp"
+
+namespace
+{
+	// just enough JSON for what Bench.hpp and Counters write
+	struct Json
+	{
+		enum class Type
+		{
+			Null,
+			Bool,
+			Number,
+			String,
+			Array,
+			Object,
+		};
+
+		Type type = Type::Null;
+		double number = 0;
+		std::string string;
+		std::vector<Json> array;
+		std::vector<std::pair<std::string, Json>> object;
+
+		// nullptr if missing
+		const Json* find(const std::string& key) const
+		{
+			for (auto& member : object)
+			{
+				if (member.first == key)
+					return &member.second;
+			}
+
+			return nullptr;
+		}
+
+		const Json& at(const std::string& key) const
+		{
+			if (auto* member = find(key))
+				return *member;
+
+			throw std::runtime_error("Missing \"" + key + "\"");
+		}
+	};
+
+	class Parser
+	{
+	public:
+		explicit Parser(std::string text)
+			: text(std::move(text)),
+			pos(0)
+		{}
+
+		Json parse()
+		{
+			auto ret = value();
+			skip();
+
+			if (pos != text.size())
+				error("trailing characters");
+
+			return ret;
+		}
+
+	private:
+		std::string text;
+		std::size_t pos;
+
+		[[noreturn]] void error(const std::string& what) const
+		{
+			throw std::runtime_error("Invalid JSON at " + std::to_string(pos) + ": " + what);
+		}
+
+		void skip()
+		{
+			while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+				++pos;
+		}
+
+		bool consume(char c)
+		{
+			skip();
+
+			if (pos < text.size() && text[pos] == c)
+			{
+				++pos;
+				return true;
+			}
+
+			return false;
+		}
+
+		void expect(char c)
+		{
+			if (!consume(c))
+				error(std::string("expected '") + c + "'");
+		}
+
+		bool keyword(const char* word)
+		{
+			auto len = std::char_traits<char>::length(word);
+
+			if (text.compare(pos, len, word) != 0)
+				return false;
+
+			pos += len;
+			return true;
+		}
+
+		// neither writer escapes anything but quotes and backslashes
+		std::string string()
+		{
+			expect('"');
+
+			std::string ret;
+			while (pos < text.size() && text[pos] != '"')
+			{
+				if (text[pos] == '\\' && pos + 1 < text.size())
+					++pos;
+
+				ret += text[pos++];
+			}
+
+			expect('"');
+			return ret;
+		}
+
+		Json value()
+		{
+			skip();
+
+			if (pos == text.size())
+				error("unexpected end");
+
+			Json ret;
+			char c = text[pos];
+
+			if (c == '{')
+			{
+				ret.type = Json::Type::Object;
+				++pos;
+
+				if (consume('}'))
+					return ret;
+
+				do
+				{
+					skip();
+					auto key = string();
+					expect(':');
+					ret.object.emplace_back(std::move(key), value());
+				} while (consume(','));
+
+				expect('}');
+			}
+			else if (c == '[')
+			{
+				ret.type = Json::Type::Array;
+				++pos;
+
+				if (consume(']'))
+					return ret;
+
+				do
+					ret.array.push_back(value());
+				while (consume(','));
+
+				expect(']');
+			}
+			else if (c == '"')
+			{
+				ret.type = Json::Type::String;
+				ret.string = string();
+			}
+			else if (keyword("true") || keyword("false"))
+			{
+				ret.type = Json::Type::Bool;
+				ret.number = c == 't';
+			}
+			else if (keyword("null"))
+			{
+				ret.type = Json::Type::Null;
+			}
+			else
+			{
+				char* end;
+				ret.type = Json::Type::Number;
+				ret.number = std::strtod(text.c_str() + pos, &end);
+
+				if (end == text.c_str() + pos)
+					error("unexpected character");
+
+				pos = end - text.c_str();
+			}
+
+			return ret;
+		}
+	};
+
+	Json readJson(const std::string& file)
+	{
+		std::ifstream fin(file);
+
+		if (!fin)
+			throw std::runtime_error("Unable to open " + file);
+
+		std::ostringstream oss;
+		oss << fin.rdbuf();
+
+		try
+		{
+			return Parser(oss.str()).parse();
+		}
+		catch (const std::exception& ex)
+		{
+			throw std::runtime_error(file + ": " + ex.what());
+		}
+	}
+
+	double percent(double delta, double base)
+	{
+		return base == 0 ? (delta == 0 ? 0 : INFINITY) : 100 * delta / base;
+	}
+
+	struct Report
+	{
+		double threshold;
+		std::uint64_t regressions = 0;
+		std::uint64_t improvements = 0;
+		std::uint64_t unmatched = 0;
+
+		void heading(const char* what)
+		{
+			std::printf("%-40s %14s %14s %9s %21s %8s\n", what, "old", "new", "delta", "interval", "p");
+		}
+
+		// 'significant' is whether the change is real, whatever its size
+		void row(const std::string& name, double old, double now, double delta, double low, double high, double p, bool significant, bool gated)
+		{
+			const char* verdict = "";
+
+			if (significant && gated && delta > threshold)
+			{
+				verdict = "REGRESSION";
+				++regressions;
+			}
+			else if (significant && gated && delta < -threshold)
+			{
+				verdict = "improved";
+				++improvements;
+			}
+
+			char interval[64];
+			std::snprintf(interval, sizeof(interval), "[%+.2f%%, %+.2f%%]", low, high);
+
+			char probability[16];
+			if (p < 0)
+				std::snprintf(probability, sizeof(probability), "-");
+			else
+				std::snprintf(probability, sizeof(probability), "%.3f", p);
+
+			std::printf("%-40s %14.10g %14.10g %+8.2f%% %21s %8s  %s\n", name.c_str(), old, now, delta, interval, probability, verdict);
+		}
+
+		void missing(const std::string& name, const char* where)
+		{
+			std::printf("%-40s only in the %s file\n", name.c_str(), where);
+			++unmatched;
+		}
+	};
+
+	std::vector<double> samples(const Json& result)
+	{
+		std::vector<double> ret;
+
+		for (auto& s : result.at("samples_ns").array)
+			ret.push_back(s.number);
+
+		if (ret.empty())
+			throw std::runtime_error("\"" + result.at("name").string + "\" has no samples");
+
+		return ret;
+	}
+
+	double median(std::vector<double> values)
+	{
+		std::sort(values.begin(), values.end());
+
+		auto n = values.size();
+		return n % 2 == 1 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+	}
+
+	void compareBenchmarks(const Json& old, const Json& now, double alpha, Report& report)
+	{
+		auto& oldResults = old.at("results").array;
+		auto& newResults = now.at("results").array;
+
+		report.heading(("ns per item, " + old.at("suite").string).c_str());
+
+		for (auto& o : oldResults)
+		{
+			auto& name = o.at("name").string;
+			auto match = std::find_if(newResults.begin(), newResults.end(), [&](const Json& n) { return n.at("name").string == name; });
+
+			if (match == newResults.end())
+			{
+				report.missing(name, "old");
+				continue;
+			}
+
+			auto a = samples(o);
+			auto b = samples(*match);
+			auto base = median(a);
+			auto test = bench::mannWhitney(a, b, alpha);
+
+			report.row(name, base, median(b), percent(test.shift, base), percent(test.low, base), percent(test.high, base), test.p, test.p < alpha, true);
+		}
+
+		for (auto& n : newResults)
+		{
+			auto& name = n.at("name").string;
+
+			if (std::none_of(oldResults.begin(), oldResults.end(), [&](const Json& o) { return o.at("name").string == name; }))
+				report.missing(name, "new");
+		}
+	}
+
+	void compareCounts(const std::string& name, const Json& old, const Json& now, Report& report)
+	{
+		static const char* counts[] = { "instructions", "calls", "allocations", "bytes", "cycles" };
+
+		for (auto* count : counts)
+		{
+			auto* a = old.find(count);
+			auto* b = now.find(count);
+
+			if (!a && !b)
+				continue;
+
+			double before = a ? a->number : 0;
+			double after = b ? b->number : 0;
+			double delta = percent(after - before, before);
+
+			// cycles are measured, not counted, and only there when asked for
+			bool exact = std::string(count) != "cycles";
+
+			report.row(name + " " + count, before, after, delta, delta, delta, -1, exact, exact);
+		}
+	}
+
+	void compareCounters(const Json& old, const Json& now, Report& report)
+	{
+		report.heading("counts");
+		compareCounts("total", old, now, report);
+
+		auto& oldFunctions = old.at("functions").array;
+		auto& newFunctions = now.at("functions").array;
+
+		auto find = [](const std::vector<Json>& functions, double index) -> const Json*
+		{
+			for (auto& f : functions)
+			{
+				if (f.at("function").number == index)
+					return &f;
+			}
+
+			return nullptr;
+		};
+
+		// functions that ran in only one are compared against nothing, so any counts show up as a change
+		Json none;
+		none.type = Json::Type::Object;
+
+		for (auto& o : oldFunctions)
+		{
+			auto index = o.at("function").number;
+			auto* n = find(newFunctions, index);
+			compareCounts("f" + std::to_string(static_cast<std::uint64_t>(index)), o, n ? *n : none, report);
+		}
+
+		for (auto& n : newFunctions)
+		{
+			auto index = n.at("function").number;
+
+			if (!find(oldFunctions, index))
+				compareCounts("f" + std::to_string(static_cast<std::uint64_t>(index)), none, n, report);
+		}
+	}
+}
+
+int main(int argc, char** argv) try
+{
+	double threshold = 2;
+	double alpha = 0.05;
+	std::vector<std::string> files;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--threshold" && i + 1 < argc)
+			threshold = std::stod(argv[++i]);
+		else if (arg == "--alpha" && i + 1 < argc)
+			alpha = std::stod(argv[++i]);
+		else
+			files.push_back(arg);
+	}
+
+	if (files.size() != 2 || alpha <= 0 || alpha >= 1)
+	{
+		std::fprintf(stderr, "usage: %s [--threshold <percent>] [--alpha <p>] <old.json> <new.json>\n", argv[0]);
+		return 2;
+	}
+
+	auto old = readJson(files[0]);
+	auto now = readJson(files[1]);
+
+	Report report;
+	report.threshold = threshold;
+
+	if (old.find("results") && now.find("results"))
+		compareBenchmarks(old, now, alpha, report);
+	else if (old.find("functions") && now.find("functions"))
+		compareCounters(old, now, report);
+	else
+		throw std::runtime_error("Both files need to be from a benchmark's --json, or both from SomeVM's --counters");
+
+	std::printf("\n%llu regressions, %llu improvements past %g%%", static_cast<unsigned long long>(report.regressions),
+		static_cast<unsigned long long>(report.improvements), threshold);
+
+	if (report.unmatched != 0)
+		std::printf(", %llu only in one file", static_cast<unsigned long long>(report.unmatched));
+
+	std::printf("\n");
+
+	return report.regressions != 0 ? 1 : 0;
+}
+catch (const std::exception& ex)
+{
+	std::fprintf(stderr, "%s\n", ex.what());
+	return 2;
+}
@@ -0,0 +1,146 @@
+// interpreter throughput: each family of instructions in a tight loop, and calls, in both dispatch modes
+
+#include <functional>
+
+#include "Bench.hpp"
+
+namespace
+{
+	using namespace svm;
+	using Type = Instruction::Type;
+
+	// instructions per loop iteration, besides the loop's own 4 (Lt, JmpFC, Add, JmpC)
+	constexpr std::uint64_t UNROLL = 16;
+
+	// r0: counter, r1: iterations, r2: 1, r3: condition. 'prologue' sets up registers 10 and up, 'body' writes one instruction
+	std::shared_ptr<const Module> loop(std::uint64_t iterations, const std::function<void(bench::Builder&)>& prologue,
+									   const std::function<void(bench::Builder&, std::uint64_t)>& body,
+									   const std::function<void(bench::Builder&)>& more = nullptr)
+	{
+		bench::Builder b;
+		b.load(0, Float(0));
+		b.load(1, Float(iterations));
+		b.load(2, Float(1));
+		prologue(b);
+
+		auto top = b.here();
+		b.op(Type::Lt, 3, 0, 1);
+		auto end = b.jumpIfFalse(3);
+
+		for (std::uint64_t i = 0; i < UNROLL; ++i)
+			body(b, i);
+
+		b.op(Type::Add, 0, 0, 2);
+		b.jump(top);
+
+		b.program.constants[end] = bench::integer(b.here());
+		b.endFunction();
+
+		if (more)
+			more(b);
+
+		return b.finish();
+	}
+
+	void floats(bench::Builder& b)
+	{
+		b.load(10, Float(1.5));
+		b.load(11, Float(2.25));
+		b.load(12, Float(0));
+	}
+
+	void bools(bench::Builder& b)
+	{
+		b.load(10, Bool(true));
+		b.load(11, Bool(false));
+		b.load(12, Bool(false));
+	}
+
+	// returns immediately
+	void callee(bench::Builder& b)
+	{
+		b.code.emplace_back(Type::Ret, std::uint32_t{ 0 }, std::uint32_t{ 0 });
+		b.endFunction();
+	}
+
+	void add(bench::Suite& suite, VM::Dispatch dispatch, const std::string& name, const std::string& unit, std::uint64_t items,
+			 std::shared_ptr<const Module> module)
+	{
+		VM vm(64, dispatch);
+		vm.load(module);
+
+		auto mode = dispatch == VM::Dispatch::Decoded ? "decoded/" : "packed/";
+		suite.add(mode + name, unit, items, [&]() { vm.run(); });
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::Suite suite("interpreter", argc, argv);
+
+	constexpr std::uint64_t N = 100000;
+	constexpr std::uint64_t PER = UNROLL + 4;
+
+	static const Type math[] = { Type::Add, Type::Sub, Type::Mult, Type::Div, Type::Mod };
+	static const Type comparison[] = { Type::Lt, Type::LtEq, Type::Gt, Type::GtEq, Type::Eq, Type::Neq };
+	static const Type logic[] = { Type::And, Type::Or, Type::Xor };
+
+	for (auto dispatch : { VM::Dispatch::Decoded, VM::Dispatch::Packed })
+	{
+		add(suite, dispatch, "nop", "instruction", N * PER, loop(N, [](bench::Builder&) {}, [](bench::Builder& b, std::uint64_t)
+		{
+			b.code.emplace_back(Type::Nop, std::uint64_t{ 0 });
+		}));
+
+		add(suite, dispatch, "memory", "instruction", N * PER, loop(N, floats, [](bench::Builder& b, std::uint64_t i)
+		{
+			if (i % 2 == 0)
+				b.code.emplace_back(Type::Load, std::uint32_t{ 12 }, std::uint32_t{ 10 });
+			else
+				b.code.emplace_back(Type::LoadC, std::uint32_t{ 12 }, std::uint32_t{ 0 });
+		}));
+
+		add(suite, dispatch, "math", "instruction", N * PER, loop(N, floats, [](bench::Builder& b, std::uint64_t i)
+		{
+			if (i % 6 == 5)
+				b.op(Type::Neg, 12, 10, 0);
+			else
+				b.op(math[i % 6], 12, 10, 11);
+		}));
+
+		add(suite, dispatch, "comparison", "instruction", N * PER, loop(N, floats, [](bench::Builder& b, std::uint64_t i)
+		{
+			b.op(comparison[i % 6], 12, 10, 11);
+		}));
+
+		add(suite, dispatch, "logic", "instruction", N * PER, loop(N, bools, [](bench::Builder& b, std::uint64_t i)
+		{
+			if (i % 4 == 3)
+				b.code.emplace_back(Type::Not, std::uint32_t{ 12 }, std::uint32_t{ 10 });
+			else
+				b.op(logic[i % 4], 12, 10, 11);
+		}));
+
+		// alternately taken (to the next instruction) and not taken
+		add(suite, dispatch, "branch", "instruction", N * PER, loop(N, bools, [](bench::Builder& b, std::uint64_t i)
+		{
+			if (i % 2 == 0)
+				b.jumpIfTrue(10, b.here() + 1);
+			else
+				b.jumpIfTrue(11, b.here() + 1);
+		}));
+
+		// a Call, and the callee's Ret
+		add(suite, dispatch, "call", "call", N * UNROLL, loop(N, [](bench::Builder& b)
+		{
+			b.load(20, bench::integer(0));
+			b.load(21, bench::integer(0));
+			b.load(22, bench::integer(1));
+		}, [](bench::Builder& b, std::uint64_t)
+		{
+			b.op(Type::Call, 20, 21, 22);
+		}, callee));
+	}
+
+	return suite.finish();
+}
@@ -0,0 +1,209 @@
+// compiler throughput: lexing and assembling, per byte of source
+// (no parsing yet, the parser is still a work in progress, and doesn't finish on any input)
+// the lexer is also run on a few MB of synthetic source of each kind, with each of its scanners this CPU has
+// (AVX2 is built in with GCC and Clang), and the generated one on 2, 4... threads, up to the cores there are
+
+#include <sstream>
+#include <thread>
+
+#include "SomeLang/Lexer.hpp"
+#include "SomeLang/Frontend.hpp"
+#include "SomeLang/Assembler.hpp"
+
+#include "Bench.hpp"
+
+namespace
+{
+	// tests/helloWorld.svml
+	const std::string helloWorld = R"(# this is a comment
+
+func () hello (): print "hello, world" ;
+
+func () bye (): print "goodbye, world" ;
+
+# flag
+loadc $0 $5
+
+# number of arguments
+loadc $1 $0
+
+# first jump offset
+loadc $2 $2
+
+# second jump offset
+loadc $3 $1
+
+print $0
+
+if $0:
+	call hello
+else:
+	call bye
+;
+
+print $0
+)";
+
+	std::string repeat(const std::string& str, std::uint64_t times)
+	{
+		std::string ret;
+		ret.reserve(str.size() * times);
+
+		for (std::uint64_t i = 0; i < times; ++i)
+			ret += str;
+
+		return ret;
+	}
+
+	// about 'bytes' of what each line makes, repeated
+	template<typename Line>
+	std::string synthetic(std::uint64_t bytes, Line line)
+	{
+		std::string ret;
+		ret.reserve(bytes + 256);
+
+		for (std::uint64_t i = 0; ret.size() < bytes; ++i)
+			ret += line(i);
+
+		return ret;
+	}
+
+	// the kinds of source the lexer's scanners each spend their time on
+	std::vector<std::pair<std::string, std::string>> largeSources()
+	{
+		constexpr std::uint64_t BYTES = 4 << 20;
+
+		std::vector<std::pair<std::string, std::string>> ret;
+
+		// like a generated program: many small functions
+		ret.emplace_back("generated", synthetic(BYTES, [](std::uint64_t i)
+		{
+			auto n = std::to_string(i);
+			return "# function " + n + "\nfunc () f" + n + " (a, b):\n\tloadc $1 $" + n + "\n\tadd $2 $1 $0\n\tprint $2 \"done " + n + "\"\n;\n\n";
+		}));
+
+		ret.emplace_back("comments", synthetic(BYTES, [](std::uint64_t i)
+		{
+			return "# " + std::to_string(i) + " a long line of commentary about what the next few instructions do, and why\nnop\n";
+		}));
+
+		ret.emplace_back("identifiers", synthetic(BYTES, [](std::uint64_t i)
+		{
+			return "some_rather_long_generated_identifier_" + std::to_string(i) + " another_long_name_for_something_else\n";
+		}));
+
+		ret.emplace_back("whitespace", synthetic(BYTES, [](std::uint64_t i)
+		{
+			return std::string(i % 6 + 1, '\t') + "                x $" + std::to_string(i % 256) + "\n";
+		}));
+
+		ret.emplace_back("strings", synthetic(BYTES, [](std::uint64_t i)
+		{
+			return "print \"message number " + std::to_string(i) + ", which is long enough to be worth scanning quickly\"\n";
+		}));
+
+		ret.emplace_back("numbers", synthetic(BYTES, [](std::uint64_t i)
+		{
+			return "load $1 " + std::to_string(i * 7919) + "." + std::to_string(i * 104729) + " -" + std::to_string(i * 15485863) + "\n";
+		}));
+
+		return ret;
+	}
+
+	const char* name(sl::Scanner scanner)
+	{
+		switch (scanner)
+		{
+		case sl::Scanner::Scalar:
+			return "scalar";
+
+		case sl::Scanner::Sse2:
+			return "sse2";
+
+		case sl::Scanner::Avx2:
+			return "avx2";
+		}
+
+		return "?";
+	}
+
+	// functions of loads, math, and comparisons, as written by hand
+	std::string assembly(std::uint64_t numFunctions)
+	{
+		std::ostringstream oss;
+
+		for (std::uint64_t f = 0; f < numFunctions; ++f)
+		{
+			oss << "# function " << f << "\nf" << f << ": 0 0\n";
+			oss << "\tload $1 " << f << ".5\n\tload $2 2\n";
+
+			for (int i = 0; i < 8; ++i)
+				oss << "\tadd $3 $1 $2\n\tmult $4 $3 $3\n\tlt $5 $4 $1\n\tload $1 $4\n";
+
+			oss << "end\n\n";
+		}
+
+		return oss.str();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::Suite suite("pipeline", argc, argv);
+
+	auto source = repeat(helloWorld, 1000);
+
+	// from a stream, copying each token's value out
+	suite.add("lex", "byte", source.size(), [&]()
+	{
+		std::istringstream iss(source);
+		bench::keep(sl::lex(iss).size());
+	});
+
+	// straight from memory, tokens only pointing into it
+	suite.add("lex view", "byte", source.size(), [&]()
+	{
+		bench::keep(sl::lex(std::string_view(source)).size());
+	});
+
+	for (auto& large : largeSources())
+	{
+		for (auto scanner : { sl::Scanner::Scalar, sl::Scanner::Sse2, sl::Scanner::Avx2 })
+		{
+			if (!sl::available(scanner))
+				continue;
+
+			auto& text = large.second;
+
+			suite.add("lex " + large.first + " " + name(scanner), "byte", text.size(), [&]()
+			{
+				bench::keep(sl::lex(std::string_view(text), scanner).size());
+			});
+		}
+
+		// split at its functions, and lexed a piece per thread (see sl::lexParallel)
+		if (large.first == "generated")
+		{
+			auto& text = large.second;
+
+			for (unsigned workers = 2; workers <= std::thread::hardware_concurrency(); workers *= 2)
+			{
+				suite.add("lex generated " + std::to_string(workers) + " threads", "byte", text.size(), [&]()
+				{
+					bench::keep(sl::lexParallel(text, workers).size());
+				});
+			}
+		}
+	}
+
+	auto code = assembly(1000);
+
+	suite.add("assemble", "byte", code.size(), [&]()
+	{
+		std::istringstream iss(code);
+		std::ostringstream errors;
+		bench::keep(sl::Assembler::run(iss, errors).functions.size());
+	});
+
+	return suite.finish();
+}
@@ -0,0 +1,95 @@
+// (de)serialization throughput: writing and loading a Program, in each encoding
+
+#include <sstream>
+
+#include "Bench.hpp"
+
+namespace
+{
+	using namespace svm;
+	using Type = Instruction::Type;
+
+	// a mix of what a compiler would emit: loads, math, comparisons, and jumps, mostly on low registers
+	Program generate(std::uint64_t numFunctions, std::uint64_t length)
+	{
+		Program program;
+
+		for (std::uint64_t i = 0; i < 256; ++i)
+			program.constants.emplace_back(Float(i) * 0.5);
+
+		static const Type types[] = { Type::Add, Type::Sub, Type::Mult, Type::Lt, Type::Eq, Type::And };
+
+		for (std::uint64_t f = 0; f < numFunctions; ++f)
+		{
+			Bytecode code;
+
+			for (std::uint64_t i = 0; i < length; ++i)
+			{
+				auto reg = static_cast<std::uint16_t>((f + i) % 16);
+
+				switch (i % 4)
+				{
+				case 0:
+					code.emplace_back(Type::LoadC, std::uint32_t{ reg }, static_cast<std::uint32_t>(i % 256));
+					break;
+
+				case 3:
+					code.emplace_back(Type::JmpFC, std::uint32_t{ reg }, static_cast<std::uint32_t>(i % 256));
+					break;
+
+				default:
+					code.emplace_back(types[i % 6], reg, static_cast<std::uint16_t>(reg + 1), static_cast<std::uint16_t>(reg + 2));
+					break;
+				}
+			}
+
+			code.emplace_back(Type::Ret, std::uint32_t{ 0 }, std::uint32_t{ 0 });
+			program.functions.emplace_back(0, 0, code);
+		}
+
+		return program;
+	}
+
+	void add(bench::Suite& suite, const Program& program, Encoding encoding, const std::string& name)
+	{
+		std::ostringstream out;
+		auto size = program.write(out, encoding);
+		auto bytes = out.str();
+
+		suite.add("write/" + name, "byte", size, [&]()
+		{
+			std::ostringstream oss;
+			program.write(oss, encoding);
+			bench::keep(oss.tellp());
+		});
+
+		suite.add("load/" + name, "byte", size, [&]()
+		{
+			std::istringstream iss(bytes);
+			Program loaded;
+			bench::keep(loaded.load(iss));
+		});
+
+		// reads the constants and function table up front, then each function as it would be when first called
+		suite.add("lazy load/" + name, "byte", size, [&]()
+		{
+			Program loaded;
+			loaded.load(std::make_shared<std::istringstream>(bytes));
+
+			for (auto& function : loaded.functions)
+				function.load();
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::Suite suite("program", argc, argv);
+
+	auto program = generate(1000, 256);
+
+	add(suite, program, Encoding::Fixed, "fixed");
+	add(suite, program, Encoding::Compact, "compact");
+
+	return suite.finish();
+}
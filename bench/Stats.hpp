@@ -0,0 +1,165 @@
+#pragma once
+
+// the statistics Compare runs on timings: a Mann-Whitney U test, and the Hodges-Lehmann estimate of the shift with its interval
+// in a header of its own so the tests can check them against known values
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace bench
+{
+	// the z for which P(|Z| > z) = alpha, for a standard normal Z
+	inline double criticalValue(double alpha)
+	{
+		double low = 0, high = 40;
+
+		for (int i = 0; i < 200; ++i)
+		{
+			double mid = (low + high) / 2;
+
+			if (std::erfc(mid / std::sqrt(2.0)) > alpha)
+				low = mid;
+			else
+				high = mid;
+		}
+
+		return low;
+	}
+
+	// the largest c for which P(U <= c) <= alpha / 2, for the U of 'm' and 'n' runs with no difference between them
+	// (-1 if there's none, too few runs to tell anything apart). What tables of U's critical values list
+	inline std::int64_t criticalU(std::uint64_t m, std::uint64_t n, double alpha)
+	{
+		// exactly, from the number of orderings giving each U: the coefficients of the Gaussian binomial (m + n choose m)
+		// built up one old run at a time, each step multiplying by (1 - q^(n + i)) and dividing by (1 - q^i)
+		if (m * n <= 10000)
+		{
+			std::vector<double> ways(m * n + 1, 0);
+			ways[0] = 1;
+
+			for (std::uint64_t i = 1; i <= m; ++i)
+			{
+				for (auto k = i * n; k >= n + i; --k)
+					ways[k] -= ways[k - n - i];
+
+				for (auto k = i; k <= i * n; ++k)
+					ways[k] += ways[k - i];
+			}
+
+			// every ordering of the m + n runs, (m + n choose m)
+			double total = 0;
+			for (auto w : ways)
+				total += w;
+
+			double below = 0;
+			std::int64_t c = -1;
+
+			for (std::uint64_t u = 0; u <= m * n; ++u)
+			{
+				below += ways[u];
+
+				if (below / total > alpha / 2)
+					break;
+
+				c = static_cast<std::int64_t>(u);
+			}
+
+			return c;
+		}
+
+		// the normal approximation, with a continuity correction
+		auto mn = static_cast<double>(m * n);
+		return static_cast<std::int64_t>(std::floor(mn / 2 - 0.5 - criticalValue(alpha) * std::sqrt(mn * (m + n + 1) / 12)));
+	}
+
+	struct Test
+	{
+		double p;
+
+		// the new runs' shift from the old, in the same units as the runs
+		double shift;
+		double low;
+		double high;
+	};
+
+	// two sided. p uses the normal approximation (with a correction for ties), which is fine from ~8 runs each
+	inline Test mannWhitney(const std::vector<double>& old, const std::vector<double>& now, double alpha)
+	{
+		auto m = static_cast<double>(old.size());
+		auto n = static_cast<double>(now.size());
+
+		// rank everything together, ties getting the average of their ranks
+		std::vector<std::pair<double, bool>> all;
+
+		for (auto v : old)
+			all.emplace_back(v, false);
+		for (auto v : now)
+			all.emplace_back(v, true);
+
+		std::sort(all.begin(), all.end());
+
+		double oldRanks = 0;
+		double ties = 0;
+
+		for (std::size_t i = 0; i < all.size();)
+		{
+			auto j = i;
+			while (j < all.size() && all[j].first == all[i].first)
+				++j;
+
+			double rank = (i + 1 + j) / 2.0;
+			double t = static_cast<double>(j - i);
+			ties += t * t * t - t;
+
+			for (auto k = i; k < j; ++k)
+			{
+				if (!all[k].second)
+					oldRanks += rank;
+			}
+
+			i = j;
+		}
+
+		double u = oldRanks - m * (m + 1) / 2;
+		double mean = m * n / 2;
+		double variance = m * n / 12 * ((m + n + 1) - ties / ((m + n) * (m + n - 1)));
+
+		Test ret;
+
+		if (variance <= 0)
+			ret.p = 1;
+		else
+		{
+			double z = std::max(std::abs(u - mean) - 0.5, 0.0) / std::sqrt(variance);
+			ret.p = std::erfc(z / std::sqrt(2.0));
+		}
+
+		// Hodges-Lehmann: the median of every pairwise difference. The interval leaves out the C smallest
+		// and C largest differences, C being U's critical value: from index C to index m * n - C - 1
+		std::vector<double> diffs;
+		diffs.reserve(old.size() * now.size());
+
+		for (auto a : old)
+		{
+			for (auto b : now)
+				diffs.push_back(b - a);
+		}
+
+		std::sort(diffs.begin(), diffs.end());
+
+		auto count = diffs.size();
+		ret.shift = count % 2 == 1 ? diffs[count / 2] : (diffs[count / 2 - 1] + diffs[count / 2]) / 2;
+
+		// with too few runs for any C, the interval is as wide as the differences go
+		auto c = std::max<std::int64_t>(criticalU(old.size(), now.size(), alpha), 0);
+		auto lowIdx = std::min(static_cast<std::size_t>(c), (count - 1) / 2);
+
+		ret.low = diffs[lowIdx];
+		ret.high = diffs[count - lowIdx - 1];
+
+		return ret;
+	}
+}
@@ -0,0 +1,68 @@
+// Value construction and destruction, and allocating arrays
+
+#include <vector>
+
+#include "Bench.hpp"
+
+namespace
+{
+	using namespace svm;
+
+	constexpr std::uint64_t N = 100000;
+
+	template<typename F>
+	void repeat(F make)
+	{
+		for (std::uint64_t i = 0; i < N; ++i)
+		{
+			Value v = make(i);
+			bench::keep(v);
+		}
+	}
+
+	// arrays of 'length' bytes, freed as soon as they're made
+	void arrays(bench::Suite& suite, std::uint64_t length)
+	{
+		Array<char> source(length);
+
+		suite.add("array/" + std::to_string(length) + "B", "value", N, [&]()
+		{
+			repeat([&](std::uint64_t) { return Value{ source }; });
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bench::Suite suite("values", argc, argv);
+
+	suite.add("nil", "value", N, []() { repeat([](std::uint64_t) { return Value{}; }); });
+	suite.add("bool", "value", N, []() { repeat([](std::uint64_t i) { return Value{ Bool(i & 1) }; }); });
+	suite.add("float", "value", N, []() { repeat([](std::uint64_t i) { return Value{ Float(i) }; }); });
+	suite.add("from bits", "value", N, []() { repeat([](std::uint64_t i) { return bench::integer(i); }); });
+
+	suite.add("move", "value", N, []()
+	{
+		Value v{ Float(1) };
+
+		for (std::uint64_t i = 0; i < N; ++i)
+		{
+			Value w{ std::move(v) };
+			v = std::move(w);
+			bench::keep(v);
+		}
+	});
+
+	arrays(suite, 16);
+	arrays(suite, 256);
+
+	// what a VM does to grow its registry
+	suite.add("registry resize", "value", N, []()
+	{
+		std::vector<Value> registry(256);
+		registry.resize(N);
+		bench::keep(registry.data());
+	});
+
+	return suite.finish();
+}
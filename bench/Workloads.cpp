@@ -0,0 +1,123 @@
+// whole programs: assembles each one in workloads/, runs it under SomeVM, checks what it prints against its .out file, and times it
+// times are of the whole process, so include starting it, and loading the binary (a few ms)
+// takes what any benchmark does (see Bench.hpp), and --vm-args "<options>" to pass on to SomeVM (ie: --packed)
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+
+#include "Bench.hpp"
+
+namespace
+{
+	namespace fs = std::filesystem;
+
+	// where the workloads' sources are, and where SomeLang and SomeVM were built. See the Makefile
+	const fs::path sourceDir = SVM_WORKLOADS;
+	const fs::path buildDir = SVM_BUILD;
+
+	std::string quote(const fs::path& path)
+	{
+		return "'" + path.string() + "'";
+	}
+
+	// everything 'command' writes to stdout. Throws if it doesn't exit with 0
+	std::string run(const std::string& command)
+	{
+		auto* pipe = ::popen(command.c_str(), "r");
+
+		if (!pipe)
+			throw std::runtime_error("Unable to run: " + command);
+
+		std::string output;
+		char buffer[4096];
+
+		std::size_t read;
+		while ((read = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+			output.append(buffer, read);
+
+		if (::pclose(pipe) != 0)
+			throw std::runtime_error("Failed: " + command + "\n" + output);
+
+		return output;
+	}
+
+	std::string readFile(const fs::path& path)
+	{
+		std::ifstream fin(path);
+
+		if (!fin)
+			throw std::runtime_error("Unable to open " + path.string());
+
+		std::ostringstream oss;
+		oss << fin.rdbuf();
+		return oss.str();
+	}
+}
+
+int main(int argc, char** argv) try
+{
+	std::string vmArgs;
+
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		if (std::string(argv[i]) == "--vm-args")
+			vmArgs = argv[i + 1];
+	}
+
+	// SomeLang and SomeVM aren't installed anywhere, so need to be told where libSomeVM is
+	auto* libraryPath = std::getenv("LD_LIBRARY_PATH");
+	auto paths = buildDir.string() + (libraryPath ? std::string(":") + libraryPath : "");
+	::setenv("LD_LIBRARY_PATH", paths.c_str(), 1);
+
+	std::vector<fs::path> sources;
+
+	for (auto& entry : fs::directory_iterator(sourceDir))
+	{
+		if (entry.path().extension() == ".svml")
+			sources.push_back(entry.path());
+	}
+
+	std::sort(sources.begin(), sources.end());
+
+	auto binaryDir = buildDir / "bench" / "workloads";
+	fs::create_directories(binaryDir);
+
+	bench::Suite suite("workloads", argc, argv);
+	int failed = 0;
+
+	for (auto& source : sources)
+	{
+		auto name = source.stem().string();
+
+		if (!suite.selected(name))
+			continue;
+
+		auto binary = binaryDir / (name + ".svm");
+		run(quote(buildDir / "SomeLang") + " --assemble " + quote(source) + " " + quote(binary));
+
+		auto command = quote(buildDir / "SomeVM") + " --quiet " + vmArgs + " " + quote(binary) + " < /dev/null";
+		auto expected = readFile(fs::path(source).replace_extension(".out"));
+		auto output = run(command);
+
+		if (output != expected)
+		{
+			std::fprintf(stderr, "%s: wrong output\nexpected:\n%sgot:\n%s", name.c_str(), expected.c_str(), output.c_str());
+			++failed;
+			continue;
+		}
+
+		suite.add(name, "run", 1, [&]() { run(command); });
+	}
+
+	auto ret = suite.finish();
+	return failed != 0 ? 1 : ret;
+}
+catch (const std::exception& ex)
+{
+	std::fprintf(stderr, "%s\n", ex.what());
+	return 1;
+}
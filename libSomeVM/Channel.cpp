@@ -0,0 +1,271 @@
+#include "Channel.hpp"
+
+#include <condition_variable>
+
+namespace svm
+{
+	Channel::Waiter::Waiter(std::function<void()> wake)
+		: wake(std::move(wake))
+	{}
+
+	void Channel::Waiter::cancel()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		wake = nullptr;
+	}
+
+	void Channel::Waiter::fire()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (wake)
+		{
+			auto call = std::move(wake);
+			wake = nullptr;
+			call();
+		}
+	}
+
+	Value Channel::create(std::uint64_t capacity, Kind kind)
+	{
+		std::unique_ptr<Channel> chan(new Channel(capacity, kind));
+
+		auto ret = Value::object(chan.get(), [](void* object)
+		{
+			delete static_cast<Channel*>(object);
+		});
+
+		chan.release();
+		return ret;
+	}
+
+	Channel* Channel::get(const Value& value)
+	{
+		// every object is a channel, for now
+		return static_cast<Channel*>(value.object());
+	}
+
+	Channel::Channel(std::uint64_t capacity, Kind kind)
+		: type(kind),
+		isClosed(false),
+		sendPos(0),
+		cachedRecvPos(0),
+		recvPos(0),
+		cachedSendPos(0),
+		numWaiters(0)
+	{
+		std::uint64_t size = 2;
+		while (size < capacity)
+			size *= 2;
+
+		cells.reset(new Cell[size]);
+		mask = size - 1;
+
+		for (std::uint64_t i = 0; i < size; ++i)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	bool Channel::trySend(Value& val)
+	{
+		if (isClosed.load(std::memory_order_relaxed))
+			return false;
+
+		if (type == Kind::Single)
+		{
+			auto pos = sendPos.load(std::memory_order_relaxed);
+
+			// only look at the receiver's position when we seem to be full
+			if (pos - cachedRecvPos > mask)
+			{
+				cachedRecvPos = recvPos.load(std::memory_order_acquire);
+
+				if (pos - cachedRecvPos > mask)
+					return false;
+			}
+
+			cells[pos & mask].value = std::move(val);
+			sendPos.store(pos + 1, std::memory_order_release);
+			wakeUp(false);
+			return true;
+		}
+
+		auto pos = sendPos.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			auto& cell = cells[pos & mask];
+			auto seq = cell.sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<std::int64_t>(seq - pos);
+
+			if (diff == 0)
+			{
+				if (sendPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell.value = std::move(val);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					wakeUp(false);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				// still holding a value from the last lap
+				return false;
+			}
+			else
+			{
+				pos = sendPos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool Channel::tryRecv(Value& out)
+	{
+		if (type == Kind::Single)
+		{
+			auto pos = recvPos.load(std::memory_order_relaxed);
+
+			if (pos == cachedSendPos)
+			{
+				cachedSendPos = sendPos.load(std::memory_order_acquire);
+
+				if (pos == cachedSendPos)
+					return false;
+			}
+
+			out = std::move(cells[pos & mask].value);
+			recvPos.store(pos + 1, std::memory_order_release);
+			wakeUp(true);
+			return true;
+		}
+
+		auto pos = recvPos.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			auto& cell = cells[pos & mask];
+			auto seq = cell.sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<std::int64_t>(seq - (pos + 1));
+
+			if (diff == 0)
+			{
+				if (recvPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					out = std::move(cell.value);
+
+					// ready for the next lap
+					cell.sequence.store(pos + mask + 1, std::memory_order_release);
+					wakeUp(true);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = recvPos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void Channel::close()
+	{
+		isClosed.store(true, std::memory_order_release);
+
+		wakeUp(true);
+		wakeUp(false);
+	}
+
+	bool Channel::closed() const
+	{
+		return isClosed.load(std::memory_order_acquire);
+	}
+
+	void Channel::whenReady(bool send, std::shared_ptr<Waiter> waiter)
+	{
+		{
+			std::lock_guard<std::mutex> guard(waitLock);
+			(send ? sendWaiters : recvWaiters).push_back(std::move(waiter));
+			numWaiters.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// pairs with the one in wakeUp(): either the other end sees us waiting, or we see what it did
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (ready(send) || closed())
+			wakeUp(send);
+	}
+
+	void Channel::wait(bool send)
+	{
+		std::mutex lock;
+		std::condition_variable woken;
+		bool done = false;
+
+		// notifies under the lock, so we can't return (destroying 'woken') before it's done with it
+		auto waiter = std::make_shared<Waiter>([&]()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			done = true;
+			woken.notify_one();
+		});
+
+		whenReady(send, waiter);
+
+		std::unique_lock<std::mutex> guard(lock);
+		woken.wait(guard, [&]() { return done; });
+	}
+
+	bool Channel::ready(bool send) const
+	{
+		if (type == Kind::Single)
+		{
+			auto sent = sendPos.load(std::memory_order_acquire);
+			auto received = recvPos.load(std::memory_order_acquire);
+
+			return send ? sent - received <= mask : sent != received;
+		}
+
+		// the cell at the position, rather than the positions, as a claimed cell may not be written (or emptied) yet
+		if (send)
+		{
+			auto pos = sendPos.load(std::memory_order_relaxed);
+			return cells[pos & mask].sequence.load(std::memory_order_acquire) == pos;
+		}
+
+		auto pos = recvPos.load(std::memory_order_relaxed);
+		return cells[pos & mask].sequence.load(std::memory_order_acquire) == pos + 1;
+	}
+
+	void Channel::wakeUp(bool send)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (numWaiters.load(std::memory_order_relaxed) == 0)
+			return;
+
+		std::vector<std::shared_ptr<Waiter>> woken;
+
+		{
+			std::lock_guard<std::mutex> guard(waitLock);
+			woken.swap(send ? sendWaiters : recvWaiters);
+			numWaiters.fetch_sub(woken.size(), std::memory_order_relaxed);
+		}
+
+		// outside the lock, as they may well wait on us again
+		for (auto& w : woken)
+			w->fire();
+	}
+
+	std::uint64_t Channel::capacity() const
+	{
+		return mask + 1;
+	}
+
+	Channel::Kind Channel::kind() const
+	{
+		return type;
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "Value.hpp"
+
+namespace svm
+{
+	/*
+		A bounded queue of Values, for handing data between VMs on different threads without locking.
+		Values are moved in and out, so Arrays change owner instead of being copied.
+
+		A script holds a channel as a Value (see Value::object()), copying and passing it around like any other,
+		and the channel is freed along with the last Value holding it. A channel sent through itself is never freed.
+
+		Sends and receives never block. Whoever can't go on yet asks to be woken once they might (see whenReady()),
+		which costs the other end a fence and a load while nobody is waiting.
+	*/
+	class Channel
+	{
+	public:
+		enum class Kind
+		{
+			// one sending thread, one receiving thread. No atomic read-modify-writes
+			Single,
+
+			// any number of senders and receivers (Vyukov's bounded MPMC queue)
+			Multi,
+		};
+
+		// someone waiting on a channel, see whenReady()
+		class Waiter
+		{
+		public:
+			explicit Waiter(std::function<void()> wake);
+
+			// after this returns, 'wake' won't be called (and isn't being called)
+			void cancel();
+
+		private:
+			friend class Channel;
+
+			// calls 'wake', unless it was already called or cancelled
+			void fire();
+
+			std::mutex lock;
+			std::function<void()> wake;
+		};
+
+		// 'capacity' is rounded up to a power of 2. Returns the Value holding it
+		static Value create(std::uint64_t capacity, Kind kind);
+
+		// null if 'value' isn't a channel
+		static Channel* get(const Value& value);
+
+		Channel(const Channel&) = delete;
+		Channel& operator=(const Channel&) = delete;
+
+		// false if full, leaving 'val' as it was
+		bool trySend(Value& val);
+
+		// false if empty
+		bool tryRecv(Value& out);
+
+		// sends start failing, receives carry on until it's empty
+		void close();
+		bool closed() const;
+
+		// fires 'waiter' once a send (or a receive) might go through, or the channel is closed. Right away if it
+		// already might, possibly on this thread. Otherwise from whichever thread makes room, or sends, or closes
+		void whenReady(bool send, std::shared_ptr<Waiter> waiter);
+
+		// blocks the calling thread until a send (or a receive) might go through, or the channel is closed
+		void wait(bool send);
+
+		std::uint64_t capacity() const;
+		Kind kind() const;
+
+	private:
+		Channel(std::uint64_t capacity, Kind kind);
+
+		// a send (or a receive) wouldn't fail for lack of room (or values), if nobody else got in first
+		bool ready(bool send) const;
+
+		// fires the send (or receive) waiters, if there are any
+		void wakeUp(bool send);
+
+		struct Cell
+		{
+			// Multi only: which lap of the ring the cell is ready for
+			std::atomic<std::uint64_t> sequence;
+			Value value;
+		};
+
+		std::unique_ptr<Cell[]> cells;
+		std::uint64_t mask;
+		Kind type;
+		std::atomic<bool> isClosed;
+
+		// senders and receivers each get their own cache lines
+		alignas(64) std::atomic<std::uint64_t> sendPos;
+		std::uint64_t cachedRecvPos;
+
+		alignas(64) std::atomic<std::uint64_t> recvPos;
+		std::uint64_t cachedSendPos;
+
+		// only looked at by senders and receivers while someone's waiting
+		alignas(64) std::atomic<std::uint64_t> numWaiters;
+		std::mutex waitLock;
+		std::vector<std::shared_ptr<Waiter>> sendWaiters;
+		std::vector<std::shared_ptr<Waiter>> recvWaiters;
+	};
+}
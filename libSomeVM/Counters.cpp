@@ -0,0 +1,154 @@
+#include "Counters.hpp"
+
+#include <ostream>
+#include <numeric>
+#include <stdexcept>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define SVM_HAS_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SVM_HAS_RDTSC
+#endif
+
+namespace
+{
+	thread_local svm::Counters::Allocations threadAllocations;
+}
+
+namespace svm
+{
+	Counters::Counters()
+		: types{},
+		cycles(false)
+	{}
+
+	void Counters::countCycles(bool enable)
+	{
+#ifndef SVM_HAS_RDTSC
+		if (enable)
+			throw std::runtime_error("Counting cycles needs rdtsc, which this CPU doesn't have");
+#endif
+
+		cycles = enable;
+	}
+
+	Counters::Allocations Counters::allocated()
+	{
+		return threadAllocations;
+	}
+
+	void Counters::allocation(std::uint64_t bytes)
+	{
+		++threadAllocations.count;
+		threadAllocations.bytes += bytes;
+	}
+
+	std::uint64_t Counters::timestamp()
+	{
+#ifdef SVM_HAS_RDTSC
+		return __rdtsc();
+#else
+		return 0;
+#endif
+	}
+
+	void Counters::clear()
+	{
+		types.fill(0);
+		functions.clear();
+	}
+
+	std::uint64_t Counters::total() const
+	{
+		return std::accumulate(types.begin(), types.end(), std::uint64_t{ 0 });
+	}
+
+	Counters::Function Counters::sum() const
+	{
+		Function ret;
+
+		for (auto& f : functions)
+		{
+			ret.calls += f.calls;
+			ret.allocations += f.allocations;
+			ret.bytes += f.bytes;
+			ret.cycles += f.cycles;
+		}
+
+		return ret;
+	}
+
+	const std::array<std::uint64_t, Counters::NUM_TYPES>& Counters::byType() const
+	{
+		return types;
+	}
+
+	const std::vector<Counters::Function>& Counters::byFunction() const
+	{
+		return functions;
+	}
+
+	void Counters::writeJson(std::ostream& output) const
+	{
+		auto costs = [&](const Function& f)
+		{
+			output << ", \"calls\": " << f.calls << ", \"allocations\": " << f.allocations << ", \"bytes\": " << f.bytes;
+
+			if (cycles)
+				output << ", \"cycles\": " << f.cycles;
+		};
+
+		output << "{\n\t\"instructions\": " << total();
+		costs(sum());
+		output << ",\n\t\"types\": {";
+
+		bool first = true;
+		for (std::uint64_t i = 0; i < NUM_TYPES; ++i)
+		{
+			if (types[i] == 0)
+				continue;
+
+			output << (first ? "\n" : ",\n") << "\t\t\"" << Instruction::name(static_cast<Instruction::Type>(i)) << "\": " << types[i];
+			first = false;
+		}
+
+		output << "\n\t},\n\t\"functions\": [";
+
+		first = true;
+		for (std::uint64_t f = 0; f < functions.size(); ++f)
+		{
+			auto& function = functions[f];
+			auto executed = std::accumulate(function.hits.begin(), function.hits.end(), std::uint64_t{ 0 });
+
+			if (executed == 0)
+				continue;
+
+			output << (first ? "\n" : ",\n") << "\t\t{ \"function\": " << f << ", \"instructions\": " << executed;
+			costs(function);
+			output << ", \"hits\": [";
+			first = false;
+
+			bool firstHit = true;
+			for (std::uint64_t i = 0; i < function.hits.size(); ++i)
+			{
+				if (function.hits[i] == 0)
+					continue;
+
+				output << (firstHit ? "\n" : ",\n") << "\t\t\t{ \"offset\": " << i
+					<< ", \"type\": \"" << Instruction::name(function.types[i]) << "\", \"count\": " << function.hits[i];
+				firstHit = false;
+
+				if (i < function.branches.size() && function.branches[i].taken + function.branches[i].notTaken != 0)
+					output << ", \"taken\": " << function.branches[i].taken << ", \"notTaken\": " << function.branches[i].notTaken;
+
+				output << " }";
+			}
+
+			output << "\n\t\t] }";
+		}
+
+		output << "\n\t]\n}\n";
+	}
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <iosfwd>
+
+#include "Instruction.hpp"
+
+namespace svm
+{
+	/*
+		Execution counts gathered by a VM built with SVM_INSTRUMENT defined (see "make instrument"):
+		per instruction type, and per instruction of each function, with taken/not taken counts for conditional jumps.
+		Each function also gets the calls made to it, and the allocations (and their bytes) made while running
+		its instructions, and optionally the rdtsc cycles spent in them.
+
+		Except for cycles, the counts only depend on the program and the library, not on the machine or
+		how busy it is, so two builds running the same program can be compared exactly.
+
+		Allocations are counted per thread, so only what the VM's own thread allocates is seen. Spawned
+		tasks it runs itself while joining count as the Join's, so with more than one worker (-j) those
+		counts depend on scheduling. Value's arrays are counted by the library, but everything else only
+		if the program calls allocation() from its own global operator new: the library doesn't replace
+		it, as that would replace it for every program loading the library. SomeVM does, in CountingNew.cpp.
+
+		Without SVM_INSTRUMENT the counters are still there (so VM is the same in every build), but stay
+		empty, and no time is spent on them.
+	*/
+	class Counters
+	{
+	public:
+		static constexpr std::uint64_t NUM_TYPES = static_cast<std::uint64_t>(Instruction::Type::Trap) + 1;
+
+		struct Branch
+		{
+			std::uint64_t taken = 0;
+			std::uint64_t notTaken = 0;
+		};
+
+		struct Function
+		{
+			// indexed by instruction, sized to the function when it's first run
+			std::vector<std::uint64_t> hits;
+			std::vector<Instruction::Type> types;
+
+			// only sized once a conditional jump is run
+			std::vector<Branch> branches;
+
+			std::uint64_t calls = 0;
+			std::uint64_t allocations = 0;
+			std::uint64_t bytes = 0;
+			std::uint64_t cycles = 0;
+		};
+
+		// what the current thread has allocated so far
+		struct Allocations
+		{
+			std::uint64_t count = 0;
+			std::uint64_t bytes = 0;
+		};
+
+		// attributes what is allocated (and the cycles taken) while it's alive to 'function'
+		class Scope
+		{
+		public:
+			Scope(Counters& counters, std::uint64_t function)
+				: counters(counters),
+				function(function),
+				start(allocated()),
+				cycles(counters.countingCycles() ? timestamp() : 0)
+			{}
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+
+			~Scope()
+			{
+				auto end = allocated();
+				auto& f = counters.functions[function];
+
+				f.allocations += end.count - start.count;
+				f.bytes += end.bytes - start.bytes;
+
+				if (counters.countingCycles())
+					f.cycles += timestamp() - cycles;
+			}
+
+		private:
+			Counters& counters;
+			std::uint64_t function;
+			Allocations start;
+			std::uint64_t cycles;
+		};
+
+		Counters();
+
+		// 'offset' is the instruction's index in the function, 'length' the number of instructions in it
+		void count(Instruction::Type type, std::uint64_t function, std::uint64_t offset, std::uint64_t length)
+		{
+			++types[static_cast<std::uint8_t>(type)];
+
+			if (function >= functions.size())
+				functions.resize(function + 1);
+
+			auto& f = functions[function];
+
+			if (f.hits.size() < length)
+			{
+				f.hits.resize(length);
+				f.types.resize(length, Instruction::Type::Nop);
+			}
+
+			++f.hits[offset];
+			f.types[offset] = type;
+		}
+
+		// only after count() for the same instruction
+		void branch(std::uint64_t function, std::uint64_t offset, bool taken)
+		{
+			auto& f = functions[function];
+
+			if (f.branches.size() < f.hits.size())
+				f.branches.resize(f.hits.size());
+
+			if (taken)
+				++f.branches[offset].taken;
+			else
+				++f.branches[offset].notTaken;
+		}
+
+		// only after count() for an instruction of the caller, so 'function' may not have been run yet
+		void call(std::uint64_t function)
+		{
+			if (function >= functions.size())
+				functions.resize(function + 1);
+
+			++functions[function].calls;
+		}
+
+		// reading the time stamp counter around every instruction slows them down a lot, so it's off by default
+		// throws if the CPU has no time stamp counter (only x86 has one)
+		void countCycles(bool enable);
+		bool countingCycles() const
+		{
+			return cycles;
+		}
+
+		static Allocations allocated();
+
+		// for allocations that don't go through operator new
+		static void allocation(std::uint64_t bytes);
+
+		static std::uint64_t timestamp();
+
+		void clear();
+
+		std::uint64_t total() const;
+
+		// of every function
+		Function sum() const;
+
+		// indexed by Instruction::Type
+		const std::array<std::uint64_t, NUM_TYPES>& byType() const;
+
+		// indexed by function index. Functions that were never run may be missing, or empty
+		const std::vector<Function>& byFunction() const;
+
+		/*
+			{
+				"instructions": total, "calls": count, "allocations": count, "bytes": count, "cycles": count,
+				"types": { "add": count, ... },
+				"functions": [ { "function": index, "instructions": count, "calls": count, "allocations": count, "bytes": count, "cycles": count,
+					"hits": [ { "offset": index, "type": "jmptc", "count": count, "taken": count, "notTaken": count }, ... ] }, ... ]
+			}
+			Only what was run is included, "taken" and "notTaken" only for conditional jumps, "cycles" only if counted.
+		*/
+		void writeJson(std::ostream& output) const;
+
+	private:
+		std::array<std::uint64_t, NUM_TYPES> types;
+		std::vector<Function> functions;
+		bool cycles;
+	};
+}
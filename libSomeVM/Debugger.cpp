@@ -1,60 +1,230 @@
 #include "Debugger.hpp"
 
+#include <string>
+#include <cstring>
+#include <sstream>
+#include <istream>
+#include <ostream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "VM.hpp"
+#include "Module.hpp"
+
 namespace svm
 {
-	Debugger::Debugger()
-	{}
+	Debugger::Debugger(VM& vm)
+		: vm(vm)
+	{
+		if (!vm.module)
+			throw std::logic_error("No program loaded");
+
+		if (!vm.callStack.empty() || vm.waiting() || vm.paused())
+			throw std::logic_error("Can't attach a debugger to a running VM");
+
+		vm.module->loadAll();
+		module = std::make_shared<Module>(vm.module->constants(), vm.module->functions());
+
+		// leaving its taskModule be, so tasks it spawns get the original
+		vm.module = module;
+	}
 
 	Debugger::~Debugger()
-	{}
-
-	void Debugger::run(const std::vector<Breakpoint>& breakpoints)
-	{
-		breakpoints;
-		//callStack.emplace(functions.front(), 0, 0);
-
-		//std::uint64_t nextBreakpoint = 0;
-
-		//while(!callStack.empty())
-		//{
-		//	Frame& frame = callStack.top();
-
-		//	if(!frame.complete())
-		//	{
-		//		auto next = frame.next();
-
-		//		if(nextBreakpoint < breakpoints.size())
-		//		{
-		//			const Breakpoint& bp = breakpoints[nextBreakpoint++];
-
-		//			if(bp.functionIndex == frame.functionIndex)
-		//			{
-		//				std::uint64_t instIdx = std::distance(frame.begin(), next);
-
-		//				if(bp.instructionIndex == instIdx)
-		//				{
-		//					// May want a different design.
-		//					// Debugger class, which takes a VM as an argument
-		//					// and runs from there.
-
-		//					std::string input;
-		//					do
-		//					{
-		//						outStream << "> ";
-
-		//						std::getline(inStream, input);
-		//					}
-		//					while(input != "c");
-		//				}
-		//			}
-		//		}
-
-		//		interpret(*next, frame);
-		//	}
-		//	else
-		//	{
-		//		callStack.pop();
-		//	}
-		//}
+	{
+		for (auto& patch : patches)
+			module->patch(patch.where.functionIndex, patch.where.instructionIndex, patch.original);
+	}
+
+	void Debugger::add(Breakpoint breakpoint)
+	{
+		if (find(breakpoint) != patches.size())
+			return;
+
+		if (breakpoint.functionIndex >= module->numFunctions() || breakpoint.instructionIndex >= module->function(breakpoint.functionIndex).length())
+			throw std::out_of_range("Breakpoint out of range");
+
+		auto original = module->patch(breakpoint.functionIndex, breakpoint.instructionIndex, Instruction(Instruction::Type::Trap, 0));
+
+		patches.push_back({ breakpoint, original });
+		points.push_back(breakpoint);
+	}
+
+	void Debugger::remove(Breakpoint breakpoint)
+	{
+		auto idx = find(breakpoint);
+
+		if (idx == patches.size())
+			return;
+
+		module->patch(breakpoint.functionIndex, breakpoint.instructionIndex, patches[idx].original);
+
+		patches.erase(patches.begin() + idx);
+		points.erase(points.begin() + idx);
+	}
+
+	const std::vector<Breakpoint>& Debugger::breakpoints() const
+	{
+		return points;
+	}
+
+	bool Debugger::resume()
+	{
+		if (vm.paused())
+		{
+			// get past the breakpoint we're on first, or we'd stop right back at it
+			stepOver();
+
+			if (vm.paused())
+				vm.resumeRun();
+		}
+		else
+		{
+			vm.run();
+		}
+
+		return vm.paused();
+	}
+
+	bool Debugger::step()
+	{
+		if (!vm.paused())
+		{
+			// start paused at the first instruction, breakpoint or not
+			bool temporary = find({ 0, 0 }) == patches.size();
+
+			if (temporary)
+				add({ 0, 0 });
+
+			vm.run();
+
+			if (temporary)
+				remove({ 0, 0 });
+
+			return vm.paused();
+		}
+
+		stepOver();
+		return vm.paused();
+	}
+
+	std::vector<Breakpoint> Debugger::backtrace() const
+	{
+		std::vector<Breakpoint> ret;
+
+		for (auto& frame : vm.parked.frames())
+			ret.push_back({ frame.functionIndex, frame.index() });
+
+		return ret;
+	}
+
+	void Debugger::run(const std::vector<Breakpoint>& breakpoints, std::istream& input, std::ostream& output)
+	{
+		for (auto& b : breakpoints)
+			add(b);
+
+		auto where = [&]()
+		{
+			auto bt = backtrace();
+			auto& top = bt.back();
+			auto instr = module->function(top.functionIndex).bytecode()[top.instructionIndex];
+
+			// a breakpoint we're on shows as the instruction it stands in for
+			auto idx = find(top);
+			if (idx != patches.size())
+				instr = patches[idx].original;
+
+			output << "f" << top.functionIndex << " +" << top.instructionIndex << ": " << Instruction::name(instr.type()) << '\n';
+		};
+
+		bool stopped = resume();
+
+		while (stopped)
+		{
+			where();
+			output << "> " << std::flush;
+
+			std::string line;
+			if (!std::getline(input, line))
+				break;
+
+			std::istringstream command(line);
+			std::string name;
+			command >> name;
+
+			if (name == "c")
+			{
+				stopped = resume();
+			}
+			else if (name == "s")
+			{
+				stopped = step();
+			}
+			else if (name == "bt")
+			{
+				for (auto& frame : backtrace())
+					output << "  f" << frame.functionIndex << " +" << frame.instructionIndex << '\n';
+			}
+			else if (name == "r")
+			{
+				std::uint64_t idx = 0;
+				command >> idx;
+
+				// there's no telling what type it is, so it's shown as a Float and as raw bits
+				auto bits = vm.read(idx).bits();
+
+				Float f;
+				std::memcpy(&f, &bits, sizeof(f));
+
+				output << "  r" << idx << " = " << f << " (0x" << std::hex << bits << std::dec << ")\n";
+			}
+			else if (name == "b" || name == "d")
+			{
+				Breakpoint b{ 0, 0 };
+				command >> b.functionIndex >> b.instructionIndex;
+
+				if (name == "b")
+					add(b);
+				else
+					remove(b);
+			}
+			else if (name == "q")
+			{
+				while (!patches.empty())
+					remove(patches.back().where);
+
+				stopped = resume();
+			}
+			else
+			{
+				output << "c: continue, s: step, bt: backtrace, r <register>, b <function> <instruction>: break, d <function> <instruction>: delete, q: quit\n";
+			}
+		}
+	}
+
+	std::uint64_t Debugger::find(Breakpoint where) const
+	{
+		std::uint64_t i = 0;
+		while (i < patches.size() && (patches[i].where.functionIndex != where.functionIndex || patches[i].where.instructionIndex != where.instructionIndex))
+			++i;
+
+		return i;
+	}
+
+	void Debugger::stepOver()
+	{
+		auto bt = backtrace();
+		auto idx = bt.empty() ? patches.size() : find(bt.back());
+
+		if (idx == patches.size())
+		{
+			vm.step();
+			return;
+		}
+
+		auto where = patches[idx].where;
+
+		module->patch(where.functionIndex, where.instructionIndex, patches[idx].original);
+		vm.step();
+		module->patch(where.functionIndex, where.instructionIndex, Instruction(Instruction::Type::Trap, 0));
 	}
 }
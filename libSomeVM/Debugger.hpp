@@ -2,21 +2,78 @@
 
 #include <cstdint>
 #include <vector>
+#include <memory>
+#include <iosfwd>
+
+#include "Instruction.hpp"
 
 namespace svm
 {
+	class VM;
+	class Module;
+
 	struct Breakpoint
 	{
 		std::uint64_t functionIndex;
 		std::uint64_t instructionIndex;
 	};
 
+	/*
+		Breaks on instructions by swapping them for a Trap, which pauses the VM (see VM::paused()) just before it.
+		Nothing else is checked as the VM runs, so code without breakpoints runs at full speed.
+
+		The VM is given its own copy of its module on attaching, which only it runs. Other VMs sharing the module,
+		and tasks it spawns (see VM::taskModule), keep running the original: they never break, and patching
+		never races with them on other threads. Coroutines run on the VM itself, so they do break.
+	*/
 	class Debugger
 	{
 	public:
-		Debugger();
+		// must be before 'vm' starts running
+		explicit Debugger(VM& vm);
+
+		Debugger(const Debugger&) = delete;
+		Debugger& operator=(const Debugger&) = delete;
+
+		// takes out any breakpoints, the VM may carry on without us
 		~Debugger();
 
-		void run(const std::vector<Breakpoint>& breakpoints);
+		void add(Breakpoint breakpoint);
+		void remove(Breakpoint breakpoint);
+
+		const std::vector<Breakpoint>& breakpoints() const;
+
+		// runs, or carries on running, until a breakpoint or the end. Returns true if stopped at a breakpoint
+		bool resume();
+
+		// runs one instruction, and any returns it leads to. Returns true if there's more to run
+		bool step();
+
+		// where the VM is paused, innermost last
+		std::vector<Breakpoint> backtrace() const;
+
+		// reads commands from 'input' whenever the VM stops at one of 'breakpoints':
+		//	c: continue, s: step, bt: backtrace, r <register>: print a register,
+		//	b <function> <instruction>: add a breakpoint, d <function> <instruction>: delete one, q: run to the end without breaking
+		void run(const std::vector<Breakpoint>& breakpoints, std::istream& input, std::ostream& output);
+
+	private:
+		struct Patch
+		{
+			Breakpoint where;
+			Instruction original;
+		};
+
+		// index of the patch at 'where', or the number of patches if there isn't one
+		std::uint64_t find(Breakpoint where) const;
+
+		// with the breakpoint the VM is paused at (if any) taken out while running it
+		void stepOver();
+
+		VM& vm;
+		std::shared_ptr<Module> module;
+
+		std::vector<Patch> patches;
+		std::vector<Breakpoint> points;
 	};
 }
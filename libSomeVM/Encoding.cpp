@@ -0,0 +1,245 @@
+#include "Encoding.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	using namespace svm;
+
+	constexpr std::uint8_t ESCAPE = 0xff;
+
+	// which arguments an instruction type uses, matching how VM::interpret reads them
+	enum class Layout
+	{
+		None,		// no arguments
+		Arg56,		// arg1_56
+		Arg24_32,	// arg1_24, arg2_32
+		Arg16x3,	// arg1_16, arg2_16, arg3_16
+	};
+
+	Layout layout(Instruction::Type type)
+	{
+		switch (type)
+		{
+		case Instruction::Type::Nop:
+			return Layout::None;
+
+		case Instruction::Type::Jmp:
+		case Instruction::Type::RJmp:
+		case Instruction::Type::JmpC:
+		case Instruction::Type::RJmpC:
+			return Layout::Arg56;
+
+		case Instruction::Type::Load:
+		case Instruction::Type::LoadC:
+		case Instruction::Type::Not:
+		case Instruction::Type::JmpT:
+		case Instruction::Type::JmpF:
+		case Instruction::Type::JmpTC:
+		case Instruction::Type::JmpFC:
+		case Instruction::Type::RJmpT:
+		case Instruction::Type::RJmpF:
+		case Instruction::Type::RJmpTC:
+		case Instruction::Type::RJmpFC:
+		case Instruction::Type::Ret:
+		case Instruction::Type::Join:
+		case Instruction::Type::Yield:
+			return Layout::Arg24_32;
+
+		default:
+			return Layout::Arg16x3;
+		}
+	}
+
+	void writeVarint(std::uint64_t value, std::vector<char>& out)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+			value >>= 7;
+		}
+
+		out.push_back(static_cast<char>(value));
+	}
+
+	std::uint64_t readVarint(const char*& it, const char* end)
+	{
+		// register numbers are almost always a single byte
+		if (it != end && static_cast<std::uint8_t>(*it) < 0x80)
+			return static_cast<std::uint8_t>(*it++);
+
+		std::uint64_t value = 0;
+
+		for (unsigned shift = 0; shift < 64; shift += 7)
+		{
+			if (it == end)
+				throw std::runtime_error("Unexpected end of compact bytecode");
+
+			auto byte = static_cast<std::uint8_t>(*it++);
+			value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+
+			if ((byte & 0x80) == 0)
+				return value;
+		}
+
+		throw std::runtime_error("Malformed varint in compact bytecode");
+	}
+
+	void encodeCompact(Instruction instr, std::vector<char>& out)
+	{
+		auto type = instr.type();
+
+		// rebuild the instruction from only the arguments we'd write, to make sure we don't lose anything
+		std::uint64_t args[3] = { 0 };
+		std::size_t numArgs = 0;
+		Instruction rebuilt;
+
+		switch (layout(type))
+		{
+		case Layout::None:
+			rebuilt = { type, std::uint64_t{ 0 } };
+			break;
+
+		case Layout::Arg56:
+			args[numArgs++] = instr.arg1_56();
+			rebuilt = { type, instr.arg1_56() };
+			break;
+
+		case Layout::Arg24_32:
+			args[numArgs++] = instr.arg1_24();
+			args[numArgs++] = instr.arg2_32();
+			rebuilt = { type, instr.arg1_24(), instr.arg2_32() };
+			break;
+
+		case Layout::Arg16x3:
+			args[numArgs++] = instr.arg1_16();
+			args[numArgs++] = instr.arg2_16();
+			args[numArgs++] = instr.arg3_16();
+			rebuilt = { type, instr.arg1_16(), instr.arg2_16(), instr.arg3_16() };
+			break;
+		}
+
+		if (!instr.valid() || std::memcmp(&rebuilt, &instr, sizeof(Instruction)) != 0)
+		{
+			out.push_back(static_cast<char>(ESCAPE));
+			out.insert(out.end(), reinterpret_cast<const char*>(&instr), reinterpret_cast<const char*>(&instr) + sizeof(Instruction));
+			return;
+		}
+
+		out.push_back(static_cast<char>(type));
+
+		for (std::size_t i = 0; i < numArgs; ++i)
+			writeVarint(args[i], out);
+	}
+
+	Instruction decodeCompact(const char*& it, const char* end)
+	{
+		auto typeByte = static_cast<std::uint8_t>(*it++);
+
+		if (typeByte == ESCAPE)
+		{
+			if (static_cast<std::uint64_t>(end - it) < sizeof(Instruction))
+				throw std::runtime_error("Unexpected end of compact bytecode");
+
+			Instruction instr;
+			std::memcpy(&instr, it, sizeof(Instruction));
+			it += sizeof(Instruction);
+			return instr;
+		}
+
+		auto type = static_cast<Instruction::Type>(typeByte);
+
+		switch (layout(type))
+		{
+		case Layout::None:
+			return{ type, std::uint64_t{ 0 } };
+
+		case Layout::Arg56:
+			return{ type, readVarint(it, end) };
+
+		case Layout::Arg24_32:
+		{
+			auto one = static_cast<std::uint32_t>(readVarint(it, end));
+			auto two = static_cast<std::uint32_t>(readVarint(it, end));
+			return{ type, one, two };
+		}
+
+		case Layout::Arg16x3:
+		default:
+		{
+			auto one = static_cast<std::uint16_t>(readVarint(it, end));
+			auto two = static_cast<std::uint16_t>(readVarint(it, end));
+			auto three = static_cast<std::uint16_t>(readVarint(it, end));
+			return{ type, one, two, three };
+		}
+		}
+	}
+}
+
+namespace svm
+{
+	void encode(const Bytecode& code, Encoding encoding, std::vector<char>& out)
+	{
+		switch (encoding)
+		{
+		case Encoding::Fixed:
+			out.insert(out.end(), reinterpret_cast<const char*>(code.data()), reinterpret_cast<const char*>(code.data() + code.size()));
+			break;
+
+		case Encoding::Compact:
+			// no reserve() here: 'out' is usually shared by every function of a program, so reserving a little more
+			// for each one would copy everything before it each time. Callers reserve once, for all of them
+			for (auto& instr : code)
+				encodeCompact(instr, out);
+			break;
+
+		default:
+			throw std::runtime_error("Unknown bytecode encoding");
+		}
+	}
+
+	Bytecode decode(const char* data, std::uint64_t size, std::uint64_t count, Encoding encoding)
+	{
+		// every instruction takes at least a byte, checked before 'count' (which may be made up) is allocated
+		if (count > size)
+			throw std::runtime_error("Bytecode size does not match instruction count");
+
+		Bytecode code(count);
+
+		switch (encoding)
+		{
+		case Encoding::Fixed:
+			// divided, as 'count' * 8 may wrap
+			if (size % sizeof(Instruction) != 0 || size / sizeof(Instruction) != count)
+				throw std::runtime_error("Bytecode size does not match instruction count");
+
+			std::memcpy(code.data(), data, size);
+			break;
+
+		case Encoding::Compact:
+		{
+			const char* it = data;
+			const char* end = data + size;
+
+			for (auto& instr : code)
+			{
+				if (it == end)
+					throw std::runtime_error("Unexpected end of compact bytecode");
+
+				instr = decodeCompact(it, end);
+			}
+
+			if (it != end)
+				throw std::runtime_error("Trailing bytes after compact bytecode");
+
+			break;
+		}
+
+		default:
+			throw std::runtime_error("Unknown bytecode encoding");
+		}
+
+		return code;
+	}
+}
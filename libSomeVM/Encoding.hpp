@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Instruction.hpp"
+
+namespace svm
+{
+	/*
+		How bytecode is stored in a binary.
+
+		Fixed: each instruction as-is, 8 bytes.
+
+		Compact: 1 byte instruction type, followed by each argument as an unsigned LEB128 varint.
+		Which arguments are written depends on the instruction type (see Encoding.cpp).
+		Most instructions only use small register numbers, and end up 2-4 bytes.
+		Any instruction that can't be represented that way is written as the ESCAPE byte, followed by the fixed 8 bytes.
+	 */
+	enum class Encoding : std::uint8_t
+	{
+		Fixed = 0,
+		Compact = 1,
+	};
+
+	// appends the encoded form of 'code' to 'out'. Leaves reserving to the caller, once for everything it encodes
+	void encode(const Bytecode& code, Encoding encoding, std::vector<char>& out);
+
+	// decodes exactly 'count' instructions from the 'size' bytes at 'data'
+	Bytecode decode(const char* data, std::uint64_t size, std::uint64_t count, Encoding encoding);
+}
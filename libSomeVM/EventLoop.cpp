@@ -0,0 +1,256 @@
+#include "EventLoop.hpp"
+
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <algorithm>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "Module.hpp"
+
+namespace
+{
+	// wakeFd's event, no script has this index
+	constexpr std::uint64_t WAKE = ~std::uint64_t{ 0 };
+}
+
+namespace svm
+{
+#ifdef __linux__
+	EventLoop::EventLoop(std::uint64_t registrySize, VM::Dispatch dispatch)
+		: registrySize(registrySize),
+		dispatch(dispatch),
+		epollFd(::epoll_create1(EPOLL_CLOEXEC)),
+		counters{ 0, 0, 0, 0 },
+		wakeFd(-1)
+	{
+		if (epollFd < 0)
+			throw std::system_error(errno, std::generic_category(), "epoll_create1");
+
+		wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.u64 = WAKE;
+
+		if (wakeFd < 0 || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) != 0)
+		{
+			auto error = errno;
+
+			if (wakeFd >= 0)
+				::close(wakeFd);
+
+			::close(epollFd);
+			throw std::system_error(error, std::generic_category(), "eventfd");
+		}
+	}
+
+	EventLoop::~EventLoop()
+	{
+		// nobody can post to us once they're gone
+		for (auto& script : scripts)
+			script.vm.cancelWait();
+
+		::close(wakeFd);
+		::close(epollFd);
+	}
+
+	std::uint64_t EventLoop::add(std::shared_ptr<const Module> module, std::vector<Value> inputs)
+	{
+		auto idx = scripts.size();
+
+		scripts.push_back({ VM(registrySize, dispatch), {}, false, false });
+
+		auto& vm = scripts.back().vm;
+		vm.load(std::move(module));
+		vm.eventLoop = this;
+
+		for (auto& in : inputs)
+			vm.write(in);
+
+		ready.push_back(idx);
+
+		return idx;
+	}
+
+	void EventLoop::run()
+	{
+		constexpr int MAX_EVENTS = 256;
+		epoll_event events[MAX_EVENTS];
+
+		std::uint64_t numWaiting = 0;
+
+		while (!ready.empty() || numWaiting > 0)
+		{
+			// run everyone who can, until they wait or finish
+			// taking the list, since scripts only become ready again through epoll
+			std::vector<std::uint64_t> running;
+			running.swap(ready);
+
+			for (auto idx : running)
+			{
+				if (step(idx))
+				{
+					watch(idx);
+					++numWaiting;
+					++counters.suspensions;
+				}
+			}
+
+			counters.maxWaiting = std::max(counters.maxWaiting, numWaiting);
+
+			if (numWaiting == 0)
+				continue;
+
+			int n = ::epoll_wait(epollFd, events, MAX_EVENTS, -1);
+
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				throw std::system_error(errno, std::generic_category(), "epoll_wait");
+			}
+
+			for (int i = 0; i < n; ++i)
+			{
+				if (events[i].data.u64 != WAKE)
+				{
+					ready.push_back(events[i].data.u64);
+					--numWaiting;
+					continue;
+				}
+
+				// resets it, so it's only readable again once something else is posted
+				std::uint64_t count;
+
+				if (::read(wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+					throw std::system_error(errno, std::generic_category(), "read");
+
+				std::lock_guard<std::mutex> guard(postLock);
+
+				ready.insert(ready.end(), posted.begin(), posted.end());
+				numWaiting -= posted.size();
+				posted.clear();
+			}
+		}
+	}
+
+	bool EventLoop::step(std::uint64_t idx)
+	{
+		auto& script = scripts[idx];
+
+		try
+		{
+			if (script.started)
+			{
+				script.vm.resumeRun();
+			}
+			else
+			{
+				script.started = true;
+				script.vm.run();
+			}
+
+			if (script.vm.waiting())
+				return true;
+		}
+		catch (const std::exception& e)
+		{
+			script.error = e.what();
+			++counters.failed;
+		}
+
+		script.done = true;
+		++counters.finished;
+
+		return false;
+	}
+
+	void EventLoop::watch(std::uint64_t idx)
+	{
+		auto& vm = scripts[idx].vm;
+
+		if (vm.waitChannel.object())
+		{
+			vm.whenReady([this, idx]() { post(idx); });
+			return;
+		}
+
+		// one shot, since the script may wait on something else next time
+		epoll_event event{};
+		event.events = (vm.waitWrite ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+		event.data.u64 = idx;
+
+		if (::epoll_ctl(epollFd, EPOLL_CTL_MOD, vm.waitFd, &event) != 0)
+		{
+			if (errno != ENOENT || ::epoll_ctl(epollFd, EPOLL_CTL_ADD, vm.waitFd, &event) != 0)
+				throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+		}
+	}
+
+	void EventLoop::post(std::uint64_t idx)
+	{
+		{
+			std::lock_guard<std::mutex> guard(postLock);
+			posted.push_back(idx);
+		}
+
+		std::uint64_t one = 1;
+
+		if (::write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+			throw std::system_error(errno, std::generic_category(), "write");
+	}
+#else
+	EventLoop::EventLoop(std::uint64_t registrySize, VM::Dispatch dispatch)
+		: registrySize(registrySize),
+		dispatch(dispatch),
+		epollFd(-1),
+		counters{ 0, 0, 0, 0 },
+		wakeFd(-1)
+	{
+		throw std::runtime_error("EventLoop is not supported on this platform");
+	}
+
+	EventLoop::~EventLoop() = default;
+
+	std::uint64_t EventLoop::add(std::shared_ptr<const Module>, std::vector<Value>)
+	{
+		return 0;
+	}
+
+	void EventLoop::run()
+	{}
+
+	bool EventLoop::step(std::uint64_t)
+	{
+		return false;
+	}
+
+	void EventLoop::watch(std::uint64_t)
+	{}
+
+	void EventLoop::post(std::uint64_t)
+	{}
+#endif
+
+	const VM& EventLoop::script(std::uint64_t idx) const
+	{
+		return scripts.at(idx).vm;
+	}
+
+	const std::string& EventLoop::error(std::uint64_t idx) const
+	{
+		return scripts.at(idx).error;
+	}
+
+	EventLoop::Stats EventLoop::stats() const
+	{
+		return counters;
+	}
+}
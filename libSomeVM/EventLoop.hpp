@@ -0,0 +1,94 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+
+#include "VM.hpp"
+#include "Value.hpp"
+
+namespace svm
+{
+	class Module;
+
+	/*
+		Runs many scripts (each a VM) on one thread. When a script's I/O syscall would block,
+		its VM parks its call stack and returns, and the loop carries on with the others until
+		epoll says the descriptor is ready (see SysCall). Scripts waiting on a channel are woken
+		by whoever (on whichever thread) makes it ready, through an eventfd.
+
+		Descriptors handed to scripts (ie: as inputs) should be non-blocking, or a script waiting on them
+		blocks the whole loop. Only one script can wait on a descriptor at a time.
+
+		Linux only, elsewhere the constructor throws.
+	*/
+	class EventLoop
+	{
+	public:
+		struct Stats
+		{
+			std::uint64_t finished;
+			std::uint64_t failed;
+
+			// times a script had to wait on I/O
+			std::uint64_t suspensions;
+
+			// most scripts waiting on I/O at once
+			std::uint64_t maxWaiting;
+		};
+
+		EventLoop(std::uint64_t registrySize = 256, VM::Dispatch dispatch = VM::Dispatch::Decoded);
+
+		EventLoop(const EventLoop&) = delete;
+		EventLoop& operator=(const EventLoop&) = delete;
+
+		~EventLoop();
+
+		// queues a script running 'module', with 'inputs' written to registers 0, 1, ...
+		// returns its index
+		std::uint64_t add(std::shared_ptr<const Module> module, std::vector<Value> inputs = {});
+
+		// runs until every script has finished (or thrown)
+		void run();
+
+		const VM& script(std::uint64_t idx) const;
+
+		// empty if the script didn't throw
+		const std::string& error(std::uint64_t idx) const;
+
+		Stats stats() const;
+
+	private:
+		struct Script
+		{
+			VM vm;
+			std::string error;
+			bool started;
+			bool done;
+		};
+
+		// runs the script until it finishes or waits. Returns true if it's waiting
+		bool step(std::uint64_t idx);
+
+		void watch(std::uint64_t idx);
+
+		// makes a script waiting on a channel ready, from any thread
+		void post(std::uint64_t idx);
+
+		std::uint64_t registrySize;
+		VM::Dispatch dispatch;
+
+		std::deque<Script> scripts;
+		std::vector<std::uint64_t> ready;
+
+		int epollFd;
+		Stats counters;
+
+		// an eventfd in 'epollFd', for scripts posted from other threads
+		int wakeFd;
+		std::mutex postLock;
+		std::vector<std::uint64_t> posted;
+	};
+}
@@ -4,20 +4,24 @@
 
 namespace svm
 {
-	Frame::Frame(const Function& function, std::uint64_t functionIndex, std::uint64_t argsIdx)
+	Frame::Frame(const Function& function, const DecodedBytecode* decoded, std::uint64_t functionIndex, std::uint64_t argsIdx)
 		: function(function),
 		functionIndex(functionIndex),
+		decoded(decoded),
 		argsIdx(argsIdx),
-		currentInstruction(function.begin())
+		currentInstruction(0),
+		numInstructions(function.length())
 	{}
 
 	Frame::Frame(Frame&& other)
 		: function(other.function),
 		functionIndex(other.functionIndex),
+		decoded(other.decoded),
 		argsIdx(other.argsIdx),
-		currentInstruction(function.begin() + std::distance(other.function.begin(), other.currentInstruction))
+		currentInstruction(other.currentInstruction),
+		numInstructions(other.numInstructions)
 	{
-		other.currentInstruction = other.function.begin();
+		other.currentInstruction = 0;
 	}
 
     Frame& Frame::operator=(Frame&&/* other*/)
@@ -28,28 +32,38 @@ namespace svm
 
 	Bytecode::const_iterator Frame::next()
 	{
-		return currentInstruction++;
+		return function.begin() + currentInstruction++;
 	}
 
 	bool Frame::complete() const
 	{
-		return currentInstruction == function.end();
+		return currentInstruction == numInstructions;
+	}
+
+	const DecodedInstruction& Frame::nextDecoded()
+	{
+		return (*decoded)[currentInstruction++];
+	}
+
+	std::uint64_t Frame::index() const
+	{
+		return currentInstruction;
 	}
 
 	void Frame::jump(std::uint64_t instIdx)
 	{
-		if (instIdx < function.length())
-			currentInstruction = function.begin() + instIdx;
+		if (instIdx < numInstructions)
+			currentInstruction = instIdx;
 		else
 			throw std::out_of_range("Attempt to jump out of bounds");
 	}
 
 	void Frame::rjump(std::int64_t instOff)
 	{
-		auto next = static_cast<std::uint64_t>(std::distance(function.begin(), currentInstruction) + instOff);
+		auto next = static_cast<std::uint64_t>(currentInstruction + instOff);
 
-		if (next < function.length())
-			currentInstruction += instOff;
+		if (next < numInstructions)
+			currentInstruction = next;
 		else
 			throw std::out_of_range("Attempt to relative jump out of bounds");
 	}
@@ -66,6 +80,6 @@ namespace svm
 
 	std::uint64_t Frame::length() const
 	{
-		return function.length();
+		return numInstructions;
 	}
-}
\ No newline at end of file
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stack>
+
 #include "Instruction.hpp"
 #include "Value.hpp"
 
@@ -10,7 +12,8 @@ namespace svm
 	class Frame
 	{
 	public:
-		Frame(const Function& function, std::uint64_t functionIndex, std::uint64_t argsIdx);
+		// 'decoded' is the pre-decoded form of 'function', if the VM is using it. May be null
+		Frame(const Function& function, const DecodedBytecode* decoded, std::uint64_t functionIndex, std::uint64_t argsIdx);
 
 		Frame(Frame&& other);
         Frame& operator=(Frame&& other);
@@ -20,6 +23,12 @@ namespace svm
 		Bytecode::const_iterator next();
 		bool complete() const;
 
+		// only valid if the frame was given decoded bytecode
+		const DecodedInstruction& nextDecoded();
+
+		// index of the instruction next() will return
+		std::uint64_t index() const;
+
 		// absolute jump
 		void jump(std::uint64_t instIdx);
 
@@ -35,7 +44,20 @@ namespace svm
 		std::uint64_t functionIndex;
 
 	private:
+		const DecodedBytecode* decoded;
 		std::uint64_t argsIdx;
-		Bytecode::const_iterator currentInstruction;
+		std::uint64_t currentInstruction;
+		std::uint64_t numInstructions;
+	};
+
+	// a stack that can also be looked through, ie: by the Profiler
+	class CallStack : public std::stack<Frame>
+	{
+	public:
+		// bottom (first call) to top (running)
+		const container_type& frames() const
+		{
+			return c;
+		}
 	};
 }
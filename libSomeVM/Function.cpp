@@ -1,23 +1,56 @@
 #include "Function.hpp"
 
+#include <istream>
+#include <stdexcept>
+
 namespace svm
 {
+	BytecodeSource::BytecodeSource(std::shared_ptr<std::istream> stream)
+		: stream(std::move(stream))
+	{}
+
 	Function::Function(std::uint8_t nrets, std::uint8_t nargs, Bytecode code)
 		: numReturns(nrets),
 		numArgs(nargs),
-		code(code)
+		code(code),
+		source(nullptr),
+		sourceOffset(0),
+		sourceLength(0),
+		sourceSize(0),
+		sourceEncoding(Encoding::Fixed)
+	{}
+
+	Function::Function(std::uint8_t nrets, std::uint8_t nargs, std::uint64_t length, std::shared_ptr<BytecodeSource> source, std::uint64_t offset, std::uint64_t size, Encoding encoding)
+		: numReturns(nrets),
+		numArgs(nargs),
+		code(),
+		source(source),
+		sourceOffset(offset),
+		sourceLength(length),
+		sourceSize(size),
+		sourceEncoding(encoding)
 	{}
 
 	Function::Function(const Function& other)
 		: numReturns(other.numReturns),
 		numArgs(other.numArgs),
-		code(other.code)
+		code(other.code),
+		source(other.source),
+		sourceOffset(other.sourceOffset),
+		sourceLength(other.sourceLength),
+		sourceSize(other.sourceSize),
+		sourceEncoding(other.sourceEncoding)
 	{}
 
 	Function::Function(Function&& other)
 		: numReturns(other.numReturns),
 		numArgs(other.numArgs),
-		code(std::move(other.code))
+		code(std::move(other.code)),
+		source(std::move(other.source)),
+		sourceOffset(other.sourceOffset),
+		sourceLength(other.sourceLength),
+		sourceSize(other.sourceSize),
+		sourceEncoding(other.sourceEncoding)
 	{}
 
 	Function& Function::operator=(const Function& other)
@@ -25,6 +58,11 @@ namespace svm
 		numReturns = other.numReturns;
 		numArgs = other.numArgs;
 		code = other.code;
+		source = other.source;
+		sourceOffset = other.sourceOffset;
+		sourceLength = other.sourceLength;
+		sourceSize = other.sourceSize;
+		sourceEncoding = other.sourceEncoding;
 
 		return *this;
 	}
@@ -34,10 +72,71 @@ namespace svm
 		numReturns = other.numReturns;
 		numArgs = other.numArgs;
 		code = std::move(other.code);
+		source = std::move(other.source);
+		sourceOffset = other.sourceOffset;
+		sourceLength = other.sourceLength;
+		sourceSize = other.sourceSize;
+		sourceEncoding = other.sourceEncoding;
 
 		return *this;
 	}
 
+	void Function::load()
+	{
+		if (loaded())
+			return;
+
+		Bytecode loading;
+
+		{
+			// other functions (maybe in another Module, on another thread) read the same stream
+			std::lock_guard<std::mutex> guard(source->lock);
+
+			auto& stream = *source->stream;
+
+			stream.clear();
+			stream.seekg(sourceOffset);
+
+			if (sourceEncoding == Encoding::Fixed)
+			{
+				// divided, as the length (from the file) * 8 may wrap
+				if (sourceSize % sizeof(Instruction) != 0 || sourceSize / sizeof(Instruction) != sourceLength)
+					throw std::runtime_error("Bytecode size does not match instruction count");
+
+				// already in the in-memory format, read it straight in
+				loading.resize(sourceLength);
+				stream.read(reinterpret_cast<char*>(loading.data()), sourceSize);
+			}
+			else
+			{
+				std::vector<char> bytes(sourceSize);
+				stream.read(bytes.data(), sourceSize);
+
+				if (stream)
+					loading = decode(bytes.data(), sourceSize, sourceLength, sourceEncoding);
+			}
+
+			if (!stream)
+				throw std::runtime_error("Unable to read function bytecode");
+		}
+
+		for (auto& instr : loading)
+		{
+			if (!instr.valid())
+				throw std::runtime_error("Invalid instruction in function bytecode");
+		}
+
+		code = std::move(loading);
+
+		// we don't need the source anymore, let it go if we're the last one using it
+		source.reset();
+	}
+
+	bool Function::loaded() const
+	{
+		return source == nullptr;
+	}
+
 	Bytecode::const_iterator Function::begin() const
 	{
 		return code.begin();
@@ -50,7 +149,7 @@ namespace svm
 
 	std::uint64_t Function::length() const
 	{
-		return code.size();
+		return loaded() ? code.size() : sourceLength;
 	}
 
 	const Bytecode& Function::bytecode() const
@@ -58,6 +157,12 @@ namespace svm
 		return code;
 	}
 
+	Instruction Function::replace(std::uint64_t index, Instruction instr)
+	{
+		std::swap(code.at(index), instr);
+		return instr;
+	}
+
 	std::uint8_t Function::returns() const
 	{
 		return numReturns;
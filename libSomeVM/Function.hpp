@@ -1,20 +1,43 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <iosfwd>
+
 #include "Instruction.hpp"
+#include "Encoding.hpp"
 
 namespace svm
 {
+	// where lazily loaded functions read their bytecode from, shared by all of them (and their copies, ie: in each Module)
+	// they may be loaded from any thread, so the stream is only read while holding 'lock'
+	struct BytecodeSource
+	{
+		explicit BytecodeSource(std::shared_ptr<std::istream> stream);
+
+		std::shared_ptr<std::istream> stream;
+		std::mutex lock;
+	};
+
 	class Function
 	{
 	public:
 		Function(std::uint8_t nrets, std::uint8_t nargs, Bytecode code);
 
+		// lazily loaded function. 'length' instructions, encoded in 'size' bytes, are read from 'source', starting at 'offset', the first time load() is called
+		Function(std::uint8_t nrets, std::uint8_t nargs, std::uint64_t length, std::shared_ptr<BytecodeSource> source, std::uint64_t offset, std::uint64_t size, Encoding encoding);
+
 		Function(const Function& other);
 		Function(Function&& other);
 
 		Function& operator=(const Function& other);
 		Function& operator=(Function&& other);
 
+		// reads and verifies the bytecode of a lazily loaded function. Does nothing if already loaded
+		void load();
+		bool loaded() const;
+
+		// begin(), end(), and bytecode() expect the function to be loaded
 		Bytecode::const_iterator begin() const;
 		Bytecode::const_iterator end() const;
 
@@ -22,6 +45,9 @@ namespace svm
 
 		const Bytecode& bytecode() const;
 
+		// swaps the instruction at 'index' for 'instr', returning the old one. Expects the function to be loaded
+		Instruction replace(std::uint64_t index, Instruction instr);
+
 		std::uint8_t returns() const;
 		std::uint8_t args() const;
 
@@ -29,5 +55,12 @@ namespace svm
 		std::uint8_t numReturns;
 		std::uint8_t numArgs;
 		Bytecode code;
+
+		// only set while the bytecode has not been read yet
+		std::shared_ptr<BytecodeSource> source;
+		std::uint64_t sourceOffset;
+		std::uint64_t sourceLength;
+		std::uint64_t sourceSize;
+		Encoding sourceEncoding;
 	};
 }
@@ -0,0 +1,282 @@
+#include "HardwareCounters.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "Frame.hpp"
+
+namespace
+{
+	using Event = svm::HardwareCounters::Event;
+
+	const char* eventNames[] =
+	{
+		"task-clock",
+		"cycles",
+		"instructions",
+		"branch-misses",
+		"L1d-misses",
+		"LLC-misses",
+	};
+
+#ifdef __linux__
+	int open(Event event, int group)
+	{
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+
+		attr.size = sizeof(attr);
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		// the leader starts disabled, so all of them start counting together
+		attr.disabled = group < 0;
+
+		constexpr auto cacheReadMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+		switch (event)
+		{
+		case Event::TaskClock:
+			attr.type = PERF_TYPE_SOFTWARE;
+			attr.config = PERF_COUNT_SW_TASK_CLOCK;
+			break;
+
+		case Event::Cycles:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CPU_CYCLES;
+			break;
+
+		case Event::Instructions:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+			break;
+
+		case Event::BranchMisses:
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+			break;
+
+		case Event::L1dMisses:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D | cacheReadMiss;
+			break;
+
+		case Event::LlcMisses:
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_LL | cacheReadMiss;
+			break;
+
+		default:
+			return -1;
+		}
+
+		return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC));
+	}
+#endif
+}
+
+namespace svm
+{
+#ifdef __linux__
+	HardwareCounters::HardwareCounters()
+		: last{},
+		numUpdates(0)
+	{
+		fds.fill(-1);
+
+		// task clock leads the group, as it's the only one we can count on
+		fds[TaskClock] = open(TaskClock, -1);
+
+		if (fds[TaskClock] < 0)
+			throw std::system_error(errno, std::generic_category(), "perf_event_open");
+
+		for (int e = TaskClock + 1; e < NumEvents; ++e)
+			fds[e] = open(static_cast<Event>(e), fds[TaskClock]);
+
+		::ioctl(fds[TaskClock], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		last = read();
+	}
+
+	HardwareCounters::~HardwareCounters()
+	{
+		for (auto fd : fds)
+		{
+			if (fd >= 0)
+				::close(fd);
+		}
+	}
+
+	std::array<std::uint64_t, HardwareCounters::NumEvents> HardwareCounters::read()
+	{
+		// PERF_FORMAT_GROUP: the number of events, then each one's value, in the order they joined the group
+		std::uint64_t values[1 + NumEvents] = {};
+
+		if (::read(fds[TaskClock], values, sizeof(values)) < 0)
+			throw std::system_error(errno, std::generic_category(), "Reading performance counters");
+
+		std::array<std::uint64_t, NumEvents> now{};
+
+		std::uint64_t next = 1;
+		for (int e = 0; e < NumEvents && next <= values[0]; ++e)
+		{
+			if (fds[e] >= 0)
+				now[e] = values[next++];
+		}
+
+		return now;
+	}
+#else
+	HardwareCounters::HardwareCounters()
+		: last{},
+		numUpdates(0)
+	{
+		fds.fill(-1);
+		throw std::runtime_error("HardwareCounters is not supported on this platform");
+	}
+
+	HardwareCounters::~HardwareCounters() = default;
+
+	std::array<std::uint64_t, HardwareCounters::NumEvents> HardwareCounters::read()
+	{
+		return {};
+	}
+#endif
+
+	void HardwareCounters::name(std::uint64_t function, std::string name)
+	{
+		if (function >= names.size())
+			names.resize(function + 1);
+
+		names[function] = std::move(name);
+	}
+
+	bool HardwareCounters::available(Event event) const
+	{
+		return fds[event] >= 0;
+	}
+
+	void HardwareCounters::update(const CallStack& callStack, bool called)
+	{
+		finish();
+
+		for (auto& frame : callStack.frames())
+			stack.push_back(frame.functionIndex);
+
+		if (called && !stack.empty())
+			function(stack.back()).calls++;
+	}
+
+	void HardwareCounters::finish()
+	{
+		auto now = read();
+
+		std::array<std::uint64_t, NumEvents> delta;
+		for (int e = 0; e < NumEvents; ++e)
+			delta[e] = now[e] - last[e];
+
+		last = now;
+
+		if (stack.empty())
+			return;
+
+		++numUpdates;
+
+		auto& running = function(stack.back());
+		for (int e = 0; e < NumEvents; ++e)
+			running.self[e] += delta[e];
+
+		for (auto idx : stack)
+		{
+			function(idx);
+
+			if (lastCounted[idx] == numUpdates)
+				continue;
+
+			lastCounted[idx] = numUpdates;
+
+			for (int e = 0; e < NumEvents; ++e)
+				functions[idx].total[e] += delta[e];
+		}
+
+		stack.clear();
+	}
+
+	const std::vector<HardwareCounters::Counts>& HardwareCounters::counts() const
+	{
+		return functions;
+	}
+
+	void HardwareCounters::writeTable(std::ostream& output) const
+	{
+		auto sortBy = available(Cycles) ? Cycles : TaskClock;
+
+		std::vector<std::uint64_t> order;
+		for (std::uint64_t i = 0; i < functions.size(); ++i)
+		{
+			if (functions[i].calls != 0 || functions[i].total[TaskClock] != 0)
+				order.push_back(i);
+		}
+
+		std::sort(order.begin(), order.end(), [&](auto a, auto b) { return functions[a].self[sortBy] > functions[b].self[sortBy]; });
+
+		output << std::setw(12) << "function" << std::setw(10) << "calls";
+		for (int e = 0; e < NumEvents; ++e)
+		{
+			if (available(static_cast<Event>(e)))
+				output << std::setw(20) << std::string("self ") + eventNames[e] << std::setw(20) << std::string("total ") + eventNames[e];
+		}
+		output << '\n';
+
+		for (auto i : order)
+		{
+			auto name = i < names.size() && !names[i].empty() ? names[i] : "f" + std::to_string(i);
+
+			output << std::setw(12) << name << std::setw(10) << functions[i].calls;
+			for (int e = 0; e < NumEvents; ++e)
+			{
+				if (available(static_cast<Event>(e)))
+					output << std::setw(20) << functions[i].self[e] << std::setw(20) << functions[i].total[e];
+			}
+			output << '\n';
+		}
+
+		std::string missing;
+		for (int e = Cycles; e < NumEvents; ++e)
+		{
+			if (!available(static_cast<Event>(e)))
+				missing += std::string(missing.empty() ? "" : ", ") + eventNames[e];
+		}
+
+		if (!missing.empty())
+			output << "not available here: " << missing << '\n';
+	}
+
+	const char* HardwareCounters::eventName(Event event)
+	{
+		return eventNames[event];
+	}
+
+	HardwareCounters::Counts& HardwareCounters::function(std::uint64_t idx)
+	{
+		if (idx >= functions.size())
+		{
+			functions.resize(idx + 1);
+			lastCounted.resize(idx + 1, 0);
+		}
+
+		return functions[idx];
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+namespace svm
+{
+	class CallStack;
+
+	/*
+		Per function counts from the CPU's performance counters (Linux perf_event_open), for a VM
+		using them (see VM::setHardwareCounters).
+
+		The counters are read each time the running function changes (a call, a return, or a coroutine
+		switch). What was counted since the last read goes to the function that was running, its "self"
+		count, and once to each distinct function on the call stack, its "total" count.
+
+		Counts only the thread that created it, in user space. Task clock is always there, the hardware
+		counters only where the CPU (or hypervisor) exposes them, the others are left out of the report.
+		Each read is a syscall, so call heavy code will run a lot slower, and the counts include some of that.
+
+		Linux only, elsewhere the constructor throws.
+	*/
+	class HardwareCounters
+	{
+	public:
+		enum Event
+		{
+			TaskClock,		// nanoseconds
+			Cycles,
+			Instructions,
+			BranchMisses,
+			L1dMisses,		// L1 data cache, reads
+			LlcMisses,		// last level cache, reads
+
+			NumEvents,
+		};
+
+		struct Counts
+		{
+			std::uint64_t calls = 0;
+			std::array<std::uint64_t, NumEvents> self{};
+			std::array<std::uint64_t, NumEvents> total{};
+		};
+
+		HardwareCounters();
+
+		HardwareCounters(const HardwareCounters&) = delete;
+		HardwareCounters& operator=(const HardwareCounters&) = delete;
+
+		~HardwareCounters();
+
+		// used instead of "f<index>" in the report
+		void name(std::uint64_t function, std::string name);
+
+		// true if 'event' could be opened
+		bool available(Event event) const;
+
+		// called by the VM whenever the running function changes. 'called' if it's just been called
+		void update(const CallStack& callStack, bool called);
+
+		// ends the current stretch, when the VM stops running
+		void finish();
+
+		// indexed by function
+		const std::vector<Counts>& counts() const;
+
+		// one row per function run, most self cycles (or task clock) first
+		void writeTable(std::ostream& output) const;
+
+		static const char* eventName(Event event);
+
+	private:
+		// takes what's been counted since the last read
+		std::array<std::uint64_t, NumEvents> read();
+
+		Counts& function(std::uint64_t idx);
+
+		std::array<int, NumEvents> fds;
+		std::array<std::uint64_t, NumEvents> last;
+
+		// the running functions as of the last update, bottom to top
+		std::vector<std::uint64_t> stack;
+
+		// which update last added to a function's total, so recursion only counts once
+		std::vector<std::uint64_t> lastCounted;
+		std::uint64_t numUpdates;
+
+		std::vector<Counts> functions;
+		std::vector<std::string> names;
+	};
+}
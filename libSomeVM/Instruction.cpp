@@ -6,6 +6,8 @@ namespace svm
 {
     static const std::map<std::string, Instruction::Type> stringMap = 
     {
+        {"syscall", Instruction::Type::SysCall},
+        {"nop", Instruction::Type::Nop},
         {"load", Instruction::Type::Load},
         {"loadc", Instruction::Type::LoadC},
         {"add", Instruction::Type::Add},
@@ -38,6 +40,12 @@ namespace svm
         {"rjmp", Instruction::Type::RJmp},
         {"jmpc", Instruction::Type::JmpC},
         {"rjmpc", Instruction::Type::RJmpC},
+        {"spawn", Instruction::Type::Spawn},
+        {"join", Instruction::Type::Join},
+        {"coroutine", Instruction::Type::Coroutine},
+        {"resume", Instruction::Type::Resume},
+        {"yield", Instruction::Type::Yield},
+        {"trap", Instruction::Type::Trap},
     };
 
     bool Instruction::type(const std::string& str, Type& type)
@@ -54,6 +62,17 @@ namespace svm
         }
     }
 
+    std::string Instruction::name(Type type)
+    {
+        for (auto& entry : stringMap)
+        {
+            if (entry.second == type)
+                return entry.first;
+        }
+
+        return "unknown";
+    }
+
 	Instruction::Instruction()
 		: Instruction(Type::Nop, 0)
 	{}
@@ -98,6 +117,12 @@ namespace svm
 		return static_cast<Type>(value >> 56 & 0xff);
 	}
 
+	bool Instruction::valid() const
+	{
+		// Yield is the last instruction type a program may use
+		return type() <= Type::Yield;
+	}
+
 	std::uint64_t Instruction::arg1_56() const
 	{
 		return value & 0x00ffffffffffffff;
@@ -79,10 +79,30 @@ namespace svm
             // constant index versions
             JmpC,
             RJmpC,
+
+            /* tasks */
+            // a task is a function call run on its own registry, possibly on another thread (see Scheduler)
+            // arguments are copied to the task's registers 0, 1, ... and its results are its first registers once its function completes
+            Spawn,		// 1: write-to (task), 2: registry index of start of arguments, 3: function index
+            Join,		// 1: registry index of task, 2x: write-to (start of return values)
+
+            /* coroutines */
+            // a coroutine is a function call with its own registry and call stack, run on this VM, suspended by Yield until resumed
+            // arguments are copied to the coroutine's registers 0, 1, ...
+            Coroutine,	// 1: write-to (coroutine), 2: registry index of start of arguments, 3: function index
+            Resume,		// 1: write-to (false once the coroutine has finished), 2: registry index of coroutine, 3: write-to (start of yielded values)
+            Yield,		// 1: number of values, 2: registry index of start of values
+
+            /* debugging */
+            // only ever patched in by a Debugger, in place of the instruction it breaks on. Never valid in a program
+            Trap,
         };
 
         static bool type(const std::string& str, Type& type);
 
+        // lowercase, as in assembly
+        static std::string name(Type type);
+
         Instruction();
         Instruction(std::uint64_t val);
         Instruction(Type t, std::uint64_t);
@@ -91,6 +111,9 @@ namespace svm
 
         Type type() const;
 
+        // true if the type byte is a known instruction type
+        bool valid() const;
+
         // arg<index>_<size bits>
         // where index is left to right
         std::uint64_t arg1_56() const;
@@ -107,4 +130,28 @@ namespace svm
     };
 
     using Bytecode = std::vector<Instruction>;
+
+    /*
+        An Instruction with its arguments already pulled out and widened, built once when a function is first called.
+
+        Jumps with constant targets have them resolved to an absolute instruction index,
+        relative jumps included, so they all look like absolute jumps:
+            JmpT, JmpF, JmpTC, JmpFC, RJmpT, RJmpF, RJmpTC, RJmpFC: one: registry index, two: instruction index
+            JmpC, RJmpC: one: instruction index
+        An out of range target is left out of range, so it still throws when the jump is taken.
+
+        Everything else:
+            arg1_16, arg2_16, arg3_16 -> one, two, three
+            arg1_24, arg2_32 -> one, two
+            arg1_56 -> one
+     */
+    struct DecodedInstruction
+    {
+        Instruction::Type type;
+        std::uint32_t one;
+        std::uint32_t two;
+        std::uint32_t three;
+    };
+
+    using DecodedBytecode = std::vector<DecodedInstruction>;
 }
@@ -0,0 +1,311 @@
+#include "Metrics.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <limits>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+namespace svm
+{
+	namespace
+	{
+		constexpr std::uint64_t SUB_BUCKETS = std::uint64_t{ 1 } << Histogram::PRECISION;
+		constexpr std::uint64_t HALF = SUB_BUCKETS / 2;
+
+		// exact values, then half a range of sub buckets for each shift up to 64
+		constexpr std::uint64_t NUM_BUCKETS = SUB_BUCKETS + (64 - Histogram::PRECISION + 1) * HALF;
+
+		constexpr double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+		const char* const QUANTILE_NAMES[] = { "p50", "p90", "p99", "p999" };
+
+		unsigned highestBit(std::uint64_t value)
+		{
+			unsigned bit = 0;
+			while (value >>= 1)
+				++bit;
+
+			return bit;
+		}
+
+		std::string label(std::uint64_t function, const std::string& name)
+		{
+			return name.empty() ? "f" + std::to_string(function) : name;
+		}
+
+		// Prometheus and JSON both need quotes and backslashes escaped
+		std::string escape(const std::string& str)
+		{
+			std::string ret;
+
+			for (char c : str)
+			{
+				if (c == '"' || c == '\\')
+					ret += '\\';
+
+				ret += c;
+			}
+
+			return ret;
+		}
+
+		void prometheusSummary(std::ostream& output, const std::string& metric, const std::string& labels, const Histogram& histogram)
+		{
+			auto withLabels = [&](const std::string& extra)
+			{
+				auto all = labels.empty() ? extra : (extra.empty() ? labels : labels + "," + extra);
+				return all.empty() ? metric : metric + "{" + all + "}";
+			};
+
+			for (double q : QUANTILES)
+			{
+				std::ostringstream quantile;
+				quantile << q;
+
+				output << withLabels("quantile=\"" + quantile.str() + "\"") << ' ' << histogram.percentile(q) / 1e9 << '\n';
+			}
+
+			output << metric << "_sum" << (labels.empty() ? "" : "{" + labels + "}") << ' ' << histogram.sum() / 1e9 << '\n';
+			output << metric << "_count" << (labels.empty() ? "" : "{" + labels + "}") << ' ' << histogram.count() << '\n';
+		}
+
+		void jsonLatencies(std::ostream& output, const Histogram& histogram)
+		{
+			output << "\"count\": " << histogram.count() << ", \"sum_ns\": " << histogram.sum()
+				<< ", \"min_ns\": " << histogram.min() << ", \"max_ns\": " << histogram.max();
+
+			for (std::uint64_t i = 0; i < std::size(QUANTILES); ++i)
+				output << ", \"" << QUANTILE_NAMES[i] << "_ns\": " << histogram.percentile(QUANTILES[i]);
+		}
+	}
+
+	Histogram::Histogram()
+		: counts(NUM_BUCKETS),
+		total(0),
+		sumVal(0),
+		minVal(std::numeric_limits<std::uint64_t>::max()),
+		maxVal(0)
+	{}
+
+	std::uint64_t Histogram::bucket(std::uint64_t value)
+	{
+		if (value < SUB_BUCKETS)
+			return value;
+
+		// keep the top PRECISION bits, the leading one among them, so only the other half of the sub buckets are used
+		auto shift = highestBit(value) - (PRECISION - 1);
+		return SUB_BUCKETS + (shift - 1) * HALF + ((value >> shift) - HALF);
+	}
+
+	std::uint64_t Histogram::highest(std::uint64_t bucket)
+	{
+		if (bucket < SUB_BUCKETS)
+			return bucket;
+
+		auto shift = (bucket - SUB_BUCKETS) / HALF + 1;
+		auto top = (bucket - SUB_BUCKETS) % HALF + HALF;
+
+		// the last bucket's top would overflow
+		if (shift + PRECISION >= 64 && top == SUB_BUCKETS - 1)
+			return std::numeric_limits<std::uint64_t>::max();
+
+		return ((top + 1) << shift) - 1;
+	}
+
+	void Histogram::record(std::uint64_t value)
+	{
+		++counts[bucket(value)];
+		++total;
+		sumVal += value;
+		minVal = std::min(minVal, value);
+		maxVal = std::max(maxVal, value);
+	}
+
+	std::uint64_t Histogram::count() const
+	{
+		return total;
+	}
+
+	std::uint64_t Histogram::sum() const
+	{
+		return sumVal;
+	}
+
+	std::uint64_t Histogram::min() const
+	{
+		return total == 0 ? 0 : minVal;
+	}
+
+	std::uint64_t Histogram::max() const
+	{
+		return maxVal;
+	}
+
+	std::uint64_t Histogram::percentile(double p) const
+	{
+		if (total == 0)
+			return 0;
+
+		// nearest rank
+		auto rank = std::max<std::uint64_t>(static_cast<std::uint64_t>(p * total + 0.5), 1);
+
+		std::uint64_t seen = 0;
+		for (std::uint64_t i = 0; i < counts.size(); ++i)
+		{
+			seen += counts[i];
+
+			// the bucket's top can be past anything actually recorded
+			if (seen >= rank)
+				return std::min(highest(i), maxVal);
+		}
+
+		return maxVal;
+	}
+
+	void Histogram::clear()
+	{
+		std::fill(counts.begin(), counts.end(), 0);
+		total = 0;
+		sumVal = 0;
+		minVal = std::numeric_limits<std::uint64_t>::max();
+		maxVal = 0;
+	}
+
+	void Metrics::watch(std::uint64_t function, std::string name)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (function >= watchedFlags.size())
+			watchedFlags.resize(function + 1);
+
+		watchedFlags[function] = true;
+		calls[function].name = std::move(name);
+	}
+
+	bool Metrics::watching(std::uint64_t function) const
+	{
+		return function < watchedFlags.size() && watchedFlags[function];
+	}
+
+	void Metrics::recordRun(std::uint64_t time, bool failed)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		runs.record(time);
+
+		if (failed)
+			++failedRuns;
+	}
+
+	void Metrics::recordCall(std::uint64_t function, std::uint64_t time)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		calls.at(function).latency.record(time);
+	}
+
+	void Metrics::recordInstructions(std::uint64_t count)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		instructions += count;
+	}
+
+	void Metrics::recordAllocation(std::uint64_t bytes, std::uint64_t count)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		allocations += count;
+		allocatedBytes += bytes;
+	}
+
+	void Metrics::writePrometheus(std::ostream& output) const
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		output << "# HELP svm_run_seconds Time taken by each VM::run().\n# TYPE svm_run_seconds summary\n";
+		prometheusSummary(output, "svm_run_seconds", "", runs);
+
+		output << "# HELP svm_runs_failed_total Runs that threw.\n# TYPE svm_runs_failed_total counter\n";
+		output << "svm_runs_failed_total " << failedRuns << '\n';
+
+		if (!calls.empty())
+		{
+			output << "# HELP svm_call_seconds Time taken by each call to a watched function.\n# TYPE svm_call_seconds summary\n";
+
+			for (auto& call : calls)
+				prometheusSummary(output, "svm_call_seconds", "function=\"" + escape(label(call.first, call.second.name)) + "\"", call.second.latency);
+		}
+
+		output << "# HELP svm_instructions_total Instructions run.\n# TYPE svm_instructions_total counter\n";
+		output << "svm_instructions_total " << instructions << '\n';
+
+		output << "# HELP svm_allocations_total Registries allocated for coroutines and tasks, and arrays and channels made while running.\n# TYPE svm_allocations_total counter\n";
+		output << "svm_allocations_total " << allocations << '\n';
+
+		output << "# HELP svm_allocated_bytes_total Bytes of registries, arrays and channels allocated.\n# TYPE svm_allocated_bytes_total counter\n";
+		output << "svm_allocated_bytes_total " << allocatedBytes << '\n';
+	}
+
+	void Metrics::writeJson(std::ostream& output) const
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		output << "{\n\t\"runs\": { ";
+		jsonLatencies(output, runs);
+		output << ", \"failed\": " << failedRuns << " },\n\t\"calls\": [";
+
+		bool first = true;
+		for (auto& call : calls)
+		{
+			output << (first ? "\n" : ",\n") << "\t\t{ \"function\": " << call.first << ", \"name\": \"" << escape(label(call.first, call.second.name)) << "\", ";
+			jsonLatencies(output, call.second.latency);
+			output << " }";
+			first = false;
+		}
+
+		output << (first ? "" : "\n\t") << "],\n\t\"instructions\": " << instructions << ",\n\t\"allocations\": " << allocations
+			<< ",\n\t\"allocated_bytes\": " << allocatedBytes << "\n}\n";
+	}
+
+	void Metrics::save(const std::string& file) const
+	{
+		auto temporary = file + ".tmp";
+
+		{
+			std::ofstream fout{ temporary };
+
+			if (!fout)
+				throw std::runtime_error("Unable to write metrics to " + temporary);
+
+			bool json = file.size() >= 5 && file.compare(file.size() - 5, 5, ".json") == 0;
+
+			if (json)
+				writeJson(fout);
+			else
+				writePrometheus(fout);
+
+			if (!fout.flush())
+				throw std::runtime_error("Unable to write metrics to " + temporary);
+		}
+
+		if (std::rename(temporary.c_str(), file.c_str()) != 0)
+			throw std::runtime_error("Unable to replace " + file + " with " + temporary);
+	}
+
+	void Metrics::clear()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		runs.clear();
+
+		for (auto& call : calls)
+			call.second.latency.clear();
+
+		failedRuns = 0;
+		instructions = 0;
+		allocations = 0;
+		allocatedBytes = 0;
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace svm
+{
+	/*
+		Latencies with a fixed relative error (HdrHistogram style): values under 2^PRECISION are counted exactly,
+		larger ones in buckets 1/2^(PRECISION - 1) of their power of two wide, so under 0.8% off.
+		Covers every std::uint64_t, in a fixed 59 KiB.
+	*/
+	class Histogram
+	{
+	public:
+		// bits of each value that are kept
+		static constexpr unsigned PRECISION = 8;
+
+		Histogram();
+
+		void record(std::uint64_t value);
+
+		std::uint64_t count() const;
+		std::uint64_t sum() const;
+		std::uint64_t min() const;
+		std::uint64_t max() const;
+
+		// the largest value that would have gone in the same bucket as the one at 'p' (0 - 1), 0 if empty
+		std::uint64_t percentile(double p) const;
+
+		void clear();
+
+	private:
+		static std::uint64_t bucket(std::uint64_t value);
+		static std::uint64_t highest(std::uint64_t bucket);
+
+		std::vector<std::uint64_t> counts;
+		std::uint64_t total;
+		std::uint64_t sumVal;
+		std::uint64_t minVal;
+		std::uint64_t maxVal;
+	};
+
+	/*
+		What an embedding application wants to know of the scripts it runs, for a VM using it (see VM::setMetrics):
+		the latency of every run(), and of every call to the functions it watches, along with how many instructions
+		were run, and what the VM allocated: registries for coroutines and tasks, and arrays and channels made while running.
+		Runs that throw are counted (and timed) too, and separately as failed.
+
+		A VM with no watched functions spends one increment per instruction on its metrics, watching some adds
+		a check whenever the running function changes, and reading the clock when they're called and return.
+		Calls end with the frame they made, so a watched function's time includes whatever it called, or resumed.
+
+		Any number of VMs, on any threads, can share one, and it can be written out while they run.
+		Functions can only be watched before it's used.
+	*/
+	class Metrics
+	{
+	public:
+		Metrics() = default;
+
+		Metrics(const Metrics&) = delete;
+		Metrics& operator=(const Metrics&) = delete;
+
+		// times every call to 'function', reported as 'name' ("f<index>" if empty)
+		void watch(std::uint64_t function, std::string name = {});
+		bool watching(std::uint64_t function) const;
+
+		// times are in nanoseconds
+		void recordRun(std::uint64_t time, bool failed);
+		void recordCall(std::uint64_t function, std::uint64_t time);
+		void recordInstructions(std::uint64_t count);
+		void recordAllocation(std::uint64_t bytes, std::uint64_t count = 1);
+
+		/*
+			Prometheus text format: latencies as summaries (in seconds, with 0.5, 0.9, 0.99 and 0.999 quantiles),
+			svm_run_seconds and svm_call_seconds{function="name"}, and the counters
+			svm_runs_failed_total, svm_instructions_total, svm_allocations_total and svm_allocated_bytes_total
+		*/
+		void writePrometheus(std::ostream& output) const;
+
+		/*
+			{
+				"runs": { "count": n, "failed": n, "sum_ns": ns, "min_ns": ns, "max_ns": ns, "p50_ns": ns, "p90_ns": ns, "p99_ns": ns, "p999_ns": ns },
+				"calls": [ { "function": index, "name": "name", "count": n, ... }, ... ],
+				"instructions": n, "allocations": n, "allocated_bytes": n
+			}
+		*/
+		void writeJson(std::ostream& output) const;
+
+		// writes to a temporary file next to 'file', then renames it over 'file', so readers never see half of it
+		// as JSON if 'file' ends in ".json", otherwise in the Prometheus text format (ie: for node_exporter's textfile collector)
+		void save(const std::string& file) const;
+
+		// forgets everything recorded, but not what's watched
+		void clear();
+
+	private:
+		struct Watched
+		{
+			std::string name;
+			Histogram latency;
+		};
+
+		mutable std::mutex lock;
+
+		// indexed by function, for checking without the lock. Only changed by watch()
+		std::vector<bool> watchedFlags;
+		std::map<std::uint64_t, Watched> calls;
+
+		Histogram runs;
+		std::uint64_t failedRuns = 0;
+		std::uint64_t instructions = 0;
+		std::uint64_t allocations = 0;
+		std::uint64_t allocatedBytes = 0;
+	};
+}
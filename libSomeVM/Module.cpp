@@ -0,0 +1,108 @@
+#include "Module.hpp"
+
+#include <stdexcept>
+
+#include "Program.hpp"
+#include "VM.hpp"
+
+namespace svm
+{
+	Module::Module(std::vector<Value> constants, std::vector<Function> functions)
+		: constantTable(std::move(constants)),
+		functionTable(std::move(functions)),
+		decodedTable(functionTable.size()),
+		loadedFlags(new std::atomic<bool>[functionTable.size()]),
+		decodedFlags(new std::atomic<bool>[functionTable.size()])
+	{
+		for (std::uint64_t i = 0; i < functionTable.size(); ++i)
+		{
+			loadedFlags[i].store(functionTable[i].loaded(), std::memory_order_relaxed);
+			decodedFlags[i].store(false, std::memory_order_relaxed);
+		}
+	}
+
+	Module::Module(const Program& program)
+		: Module(program.constants, program.functions)
+	{}
+
+	Module::~Module() = default;
+
+	const std::vector<Value>& Module::constants() const
+	{
+		return constantTable;
+	}
+
+	std::uint64_t Module::numFunctions() const
+	{
+		return functionTable.size();
+	}
+
+	const Function& Module::function(std::uint64_t idx) const
+	{
+		Function& function = functionTable.at(idx);
+
+		if (!loadedFlags[idx].load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> guard(lock);
+
+			// someone else may have loaded it while we waited
+			if (!loadedFlags[idx].load(std::memory_order_relaxed))
+			{
+				function.load();
+				loadedFlags[idx].store(true, std::memory_order_release);
+			}
+		}
+
+		return function;
+	}
+
+	const DecodedBytecode& Module::decoded(std::uint64_t idx) const
+	{
+		const Function& func = function(idx);
+		DecodedBytecode& code = decodedTable[idx];
+
+		if (!decodedFlags[idx].load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> guard(lock);
+
+			if (!decodedFlags[idx].load(std::memory_order_relaxed))
+			{
+				code.reserve(func.length());
+
+				std::uint64_t instrIdx = 0;
+				for (auto& instr : func)
+					code.push_back(VM::predecode(instr, instrIdx++, constantTable));
+
+				decodedFlags[idx].store(true, std::memory_order_release);
+			}
+		}
+
+		return code;
+	}
+
+	void Module::loadAll() const
+	{
+		for (std::uint64_t i = 0; i < functionTable.size(); ++i)
+			function(i);
+	}
+
+	const std::vector<Function>& Module::functions() const
+	{
+		return functionTable;
+	}
+
+	Instruction Module::patch(std::uint64_t idx, std::uint64_t index, Instruction instr)
+	{
+		// before taking the lock, loading takes it too
+		function(idx);
+
+		std::lock_guard<std::mutex> guard(lock);
+
+		auto old = functionTable[idx].replace(index, instr);
+
+		if (decodedFlags[idx].load(std::memory_order_relaxed))
+			decodedTable[idx][index] = VM::predecode(instr, index, constantTable);
+
+		return old;
+	}
+}
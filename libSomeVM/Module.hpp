@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "Function.hpp"
+#include "Value.hpp"
+
+namespace svm
+{
+	struct Program;
+
+	/*
+		A loaded program: constants, functions, and anything derived from them (pre-decoded bytecode).
+		Shared between any number of VMs (which only own their registry and call stack), so it's
+		handed around as a std::shared_ptr<const Module>.
+
+		Once constructed, it is only changed by lazily loading/decoding functions, which happens
+		once per function, under a lock. Every other access is read-only, and safe to do from any thread.
+	*/
+	class Module
+	{
+	public:
+		Module(std::vector<Value> constants, std::vector<Function> functions);
+
+		// copies the program's constants and functions. Lazily loaded functions share the program's source
+		explicit Module(const Program& program);
+
+		Module(const Module&) = delete;
+		Module& operator=(const Module&) = delete;
+
+		~Module();
+
+		const std::vector<Value>& constants() const;
+
+		std::uint64_t numFunctions() const;
+
+		// loads the function if need be
+		const Function& function(std::uint64_t idx) const;
+
+		// loads and decodes the function if need be
+		const DecodedBytecode& decoded(std::uint64_t idx) const;
+
+		// loads every function (ie: before writing them out). After this, functions() is fully loaded
+		void loadAll() const;
+
+		// functions that haven't been called yet may not be loaded
+		const std::vector<Function>& functions() const;
+
+		// swaps an instruction for 'instr', in its decoded form too, and returns the old one
+		// the one exception to being immutable, so only for a module no other thread is running (ie: a Debugger's own copy)
+		Instruction patch(std::uint64_t function, std::uint64_t index, Instruction instr);
+
+	private:
+		std::vector<Value> constantTable;
+
+		// elements are only modified while holding 'lock', before their flag is set
+		mutable std::vector<Function> functionTable;
+		mutable std::vector<DecodedBytecode> decodedTable;
+
+		// set (with release) once the function at that index is loaded/decoded, for lock-free checks
+		std::unique_ptr<std::atomic<bool>[]> loadedFlags;
+		std::unique_ptr<std::atomic<bool>[]> decodedFlags;
+
+		// each function is only loaded/decoded once (reading a shared stream is serialized by its BytecodeSource)
+		mutable std::mutex lock;
+	};
+}
@@ -0,0 +1,144 @@
+#include "PerfMap.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#include <unistd.h>
+#include <sys/mman.h>
+#define SVM_PERF_TRAMPOLINES
+#endif
+
+namespace
+{
+#if defined(__x86_64__)
+	// calls its third argument with the first two untouched, keeping a frame pointer so perf can walk past it
+	const unsigned char trampolineCode[] =
+	{
+		0x55,				// push rbp
+		0x48, 0x89, 0xe5,	// mov rbp, rsp
+		0xff, 0xd2,			// call rdx
+		0x5d,				// pop rbp
+		0xc3,				// ret
+	};
+#elif defined(__aarch64__)
+	const unsigned char trampolineCode[] =
+	{
+		0xfd, 0x7b, 0xbf, 0xa9,		// stp x29, x30, [sp, #-16]!
+		0xfd, 0x03, 0x00, 0x91,		// mov x29, sp
+		0x40, 0x00, 0x3f, 0xd6,		// blr x2
+		0xfd, 0x7b, 0xc1, 0xa8,		// ldp x29, x30, [sp], #16
+		0xc0, 0x03, 0x5f, 0xd6,		// ret
+	};
+#else
+	const unsigned char trampolineCode[] = { 0 };
+#endif
+
+	// keeps each trampoline on its own cache line
+	constexpr std::size_t TRAMPOLINE_SIZE = 32;
+	static_assert(sizeof(trampolineCode) <= TRAMPOLINE_SIZE, "trampoline doesn't fit");
+
+	constexpr std::size_t CODE_CHUNK = 1 << 16;
+}
+
+namespace svm
+{
+#ifdef SVM_PERF_TRAMPOLINES
+	PerfMap::PerfMap()
+		: file(nullptr),
+		filePath("/tmp/perf-" + std::to_string(::getpid()) + ".map"),
+		code(nullptr),
+		codeUsed(0),
+		codeSize(0)
+	{
+		file = std::fopen(filePath.c_str(), "a");
+
+		if (!file)
+			throw std::system_error(errno, std::generic_category(), "Unable to open " + filePath);
+	}
+
+	PerfMap::~PerfMap()
+	{
+		// trampolines may still be on some thread's stack, so their memory is left be
+		std::fclose(file);
+	}
+
+	PerfMap::Trampoline PerfMap::trampoline(std::uint64_t function)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (function < trampolines.size() && trampolines[function])
+			return trampolines[function];
+
+		if (codeUsed + TRAMPOLINE_SIZE > codeSize)
+		{
+			// made writable and filled all at once, then never written again
+			void* chunk = ::mmap(nullptr, CODE_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+			if (chunk == MAP_FAILED)
+				throw std::system_error(errno, std::generic_category(), "mmap");
+
+			auto* bytes = static_cast<unsigned char*>(chunk);
+			for (std::size_t i = 0; i + TRAMPOLINE_SIZE <= CODE_CHUNK; i += TRAMPOLINE_SIZE)
+				std::memcpy(bytes + i, trampolineCode, sizeof(trampolineCode));
+
+			if (::mprotect(chunk, CODE_CHUNK, PROT_READ | PROT_EXEC) != 0)
+				throw std::system_error(errno, std::generic_category(), "mprotect");
+
+			__builtin___clear_cache(reinterpret_cast<char*>(bytes), reinterpret_cast<char*>(bytes + CODE_CHUNK));
+
+			code = bytes;
+			codeUsed = 0;
+			codeSize = CODE_CHUNK;
+		}
+
+		auto* start = code + codeUsed;
+		codeUsed += TRAMPOLINE_SIZE;
+
+		auto name = function < names.size() && !names[function].empty() ? names[function] : "f" + std::to_string(function);
+
+		// out right away, so it's there even if we crash
+		std::fprintf(file, "%lx %zx svm::%s\n", reinterpret_cast<unsigned long>(start), sizeof(trampolineCode), name.c_str());
+		std::fflush(file);
+
+		if (function >= trampolines.size())
+			trampolines.resize(function + 1, nullptr);
+
+		trampolines[function] = reinterpret_cast<Trampoline>(start);
+		return trampolines[function];
+	}
+#else
+	PerfMap::PerfMap()
+		: file(nullptr),
+		code(nullptr),
+		codeUsed(0),
+		codeSize(0)
+	{
+		throw std::runtime_error("PerfMap is not supported on this platform");
+	}
+
+	PerfMap::~PerfMap() = default;
+
+	PerfMap::Trampoline PerfMap::trampoline(std::uint64_t)
+	{
+		return nullptr;
+	}
+#endif
+
+	void PerfMap::name(std::uint64_t function, std::string name)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (function >= names.size())
+			names.resize(function + 1);
+
+		names[function] = std::move(name);
+	}
+
+	const std::string& PerfMap::path() const
+	{
+		return filePath;
+	}
+}
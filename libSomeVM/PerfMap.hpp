@@ -0,0 +1,61 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+namespace svm
+{
+	/*
+		Makes interpreted functions show up by name in Linux perf, with no external tools.
+
+		Each function gets a tiny native trampoline, that just calls back into the interpreter, listed in
+		/tmp/perf-<pid>.map (which perf reads to symbolize code it has no other information on). A VM using
+		the map (see VM::setPerfMap) runs each function through its trampoline, so any sample taken in the
+		interpreter has the running function's trampoline right above it on the native stack.
+
+		Only the running function is shown, not the whole interpreted call stack, as the interpreter doesn't
+		recurse on calls. perf needs to walk frame pointers for this ("perf record -g"). Trampolines are
+		never freed, and can be shared by any number of VMs on any number of threads.
+
+		Linux on x86-64 and AArch64 only, elsewhere the constructor throws.
+	*/
+	class PerfMap
+	{
+	public:
+		// what trampolines call, with their first 2 arguments
+		using Entry = void (*)(void*, void*);
+		using Trampoline = void (*)(void*, void*, Entry);
+
+		PerfMap();
+
+		PerfMap(const PerfMap&) = delete;
+		PerfMap& operator=(const PerfMap&) = delete;
+
+		// the map file is left for perf to read afterwards
+		~PerfMap();
+
+		// used instead of "f<index>". Only affects trampolines not made yet
+		void name(std::uint64_t function, std::string name);
+
+		// makes one the first time it's asked for
+		Trampoline trampoline(std::uint64_t function);
+
+		const std::string& path() const;
+
+	private:
+		std::mutex mutex;
+
+		std::FILE* file;
+		std::string filePath;
+
+		std::vector<Trampoline> trampolines;
+		std::vector<std::string> names;
+
+		// executable memory trampolines are copied into
+		unsigned char* code;
+		std::size_t codeUsed;
+		std::size_t codeSize;
+	};
+}
@@ -0,0 +1,12 @@
+#include "Probes.hpp"
+
+#ifdef SVM_PROBES
+// what tracers raise while attached to a probe, in the section <sys/sdt.h> tells them to look in
+extern "C"
+{
+	__attribute__((section(".probes"))) volatile unsigned short svm_function__entry_semaphore = 0;
+	__attribute__((section(".probes"))) volatile unsigned short svm_function__return_semaphore = 0;
+	__attribute__((section(".probes"))) volatile unsigned short svm_array__alloc_semaphore = 0;
+	__attribute__((section(".probes"))) volatile unsigned short svm_program__load_semaphore = 0;
+}
+#endif
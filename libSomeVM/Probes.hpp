@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+	USDT probes, for bpftrace, perf or SystemTap to attach to a running VM, under the provider "svm":
+
+		function__entry		function index, call stack depth (counting it), number of arguments
+		function__return	function index, call stack depth (counting it)
+		array__alloc		element size, length, bytes allocated
+		program__load		number of functions, number of constants, nanoseconds taken (0 for an already loaded Module)
+
+	ie: bpftrace -e 'usdt:./build/release/libSomeVM.so:svm:function__entry { @calls[arg0] = count(); }'
+
+	Time spent in a function is left to the tracer to work out, from its entry and return.
+
+	A probe is a single nop until something attaches to it. Each has a semaphore (see Probes.cpp) that tracers
+	raise while attached, and the probe's arguments are only worked out while it's up. They're only there when
+	<sys/sdt.h> is (ie: systemtap-sdt-dev), and SVM_NO_PROBES isn't defined, otherwise the macros do nothing.
+*/
+
+#if !defined(SVM_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define SVM_PROBES
+#endif
+#endif
+
+#ifdef SVM_PROBES
+extern "C"
+{
+	extern volatile unsigned short svm_function__entry_semaphore;
+	extern volatile unsigned short svm_function__return_semaphore;
+	extern volatile unsigned short svm_array__alloc_semaphore;
+	extern volatile unsigned short svm_program__load_semaphore;
+}
+
+// true while something is attached to the probe
+#define SVM_PROBE_ENABLED(name) __builtin_expect(svm_##name##_semaphore != 0, 0)
+
+#define SVM_PROBE2(name, one, two) do { if (SVM_PROBE_ENABLED(name)) DTRACE_PROBE2(svm, name, one, two); } while (false)
+#define SVM_PROBE3(name, one, two, three) do { if (SVM_PROBE_ENABLED(name)) DTRACE_PROBE3(svm, name, one, two, three); } while (false)
+#else
+#define SVM_PROBE_ENABLED(name) false
+// the arguments are never worked out, but still count as used (ie: a parameter only a probe takes)
+#define SVM_PROBE2(name, one, two) do { if (false) { (void)(one); (void)(two); } } while (false)
+#define SVM_PROBE3(name, one, two, three) do { if (false) { (void)(one); (void)(two); (void)(three); } } while (false)
+#endif
@@ -0,0 +1,245 @@
+#include "Profiler.hpp"
+
+#include <map>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <sys/time.h>
+#define SVM_PROFILER_SIGPROF
+#endif
+
+#include "Frame.hpp"
+
+namespace
+{
+	using namespace svm;
+
+	// the timer signal has nowhere else to look
+	std::atomic<Profiler*> active{ nullptr };
+
+#ifdef SVM_PROFILER_SIGPROF
+	struct sigaction previousAction;
+#endif
+}
+
+namespace svm
+{
+	Profiler::Profiler(std::chrono::microseconds interval, std::uint64_t capacity)
+		: buffer(new std::uint64_t[capacity]),
+		capacity(capacity),
+		used(0),
+		numSamples(0),
+		numDropped(0),
+		ticks(0),
+		interval(interval),
+		running(false),
+		startClock(0),
+		cpuTime(0)
+	{}
+
+	Profiler::~Profiler()
+	{
+		stop();
+	}
+
+	void Profiler::start()
+	{
+		if (running)
+			return;
+
+		Profiler* expected = nullptr;
+		if (!active.compare_exchange_strong(expected, this))
+			throw std::logic_error("Another profiler is already running");
+
+		running = true;
+		startClock = std::clock();
+
+#ifdef SVM_PROFILER_SIGPROF
+		struct sigaction action{};
+		action.sa_handler = &Profiler::onTimer;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGPROF, &action, &previousAction);
+
+		itimerval timerVal{};
+		timerVal.it_interval.tv_sec = interval.count() / 1000000;
+		timerVal.it_interval.tv_usec = interval.count() % 1000000;
+		timerVal.it_value = timerVal.it_interval;
+		setitimer(ITIMER_PROF, &timerVal, nullptr);
+#else
+		timer = std::thread([this]()
+		{
+			while (active.load() == this)
+			{
+				std::this_thread::sleep_for(this->interval);
+				onTimer(0);
+			}
+		});
+#endif
+	}
+
+	void Profiler::stop()
+	{
+		if (!running)
+			return;
+
+#ifdef SVM_PROFILER_SIGPROF
+		itimerval timerVal{};
+		setitimer(ITIMER_PROF, &timerVal, nullptr);
+		sigaction(SIGPROF, &previousAction, nullptr);
+#endif
+
+		active.store(nullptr);
+		running = false;
+		cpuTime += std::clock() - startClock;
+
+		if (timer.joinable())
+			timer.join();
+	}
+
+	void Profiler::name(std::uint64_t function, std::string name)
+	{
+		if (function >= names.size())
+			names.resize(function + 1);
+
+		names[function] = std::move(name);
+	}
+
+	void Profiler::record(const CallStack& callStack)
+	{
+		auto& frames = callStack.frames();
+		auto depth = std::min<std::uint64_t>(frames.size(), MAX_DEPTH);
+
+		auto pos = used.fetch_add(depth + 1, std::memory_order_relaxed);
+
+		if (pos + depth + 1 > capacity)
+		{
+			// everything after here is dropped too, let readers know where to stop
+			if (pos < capacity)
+				buffer[pos] = END;
+
+			++numDropped;
+			return;
+		}
+
+		buffer[pos] = depth;
+
+		auto first = frames.size() - depth;
+		for (std::uint64_t i = 0; i < depth; ++i)
+		{
+			auto& frame = frames[first + i];
+			buffer[pos + 1 + i] = (frame.functionIndex << 32) | (frame.index() & 0xffffffffu);
+		}
+
+		++numSamples;
+	}
+
+	void Profiler::writeFolded(std::ostream& output) const
+	{
+		std::map<std::string, std::uint64_t> stacks;
+
+		auto end = std::min(used.load(), capacity);
+		for (std::uint64_t pos = 0; pos < end && buffer[pos] != END; pos += buffer[pos] + 1)
+		{
+			std::string stack;
+
+			for (std::uint64_t i = 0; i < buffer[pos]; ++i)
+			{
+				if (i != 0)
+					stack += ';';
+
+				stack += functionName(buffer[pos + 1 + i] >> 32);
+			}
+
+			++stacks[stack];
+		}
+
+		for (auto& s : stacks)
+			output << s.first << ' ' << s.second << '\n';
+	}
+
+	void Profiler::writeTable(std::ostream& output) const
+	{
+		struct Counts
+		{
+			std::uint64_t self = 0;
+			std::uint64_t total = 0;
+		};
+
+		std::map<std::uint64_t, Counts> functions;
+		std::vector<std::uint64_t> seen;
+
+		auto end = std::min(used.load(), capacity);
+		for (std::uint64_t pos = 0; pos < end && buffer[pos] != END; pos += buffer[pos] + 1)
+		{
+			auto depth = buffer[pos];
+
+			if (depth == 0)
+				continue;
+
+			functions[buffer[pos + depth] >> 32].self++;
+
+			// recursive functions only count once per sample
+			seen.clear();
+			for (std::uint64_t i = 0; i < depth; ++i)
+			{
+				auto function = buffer[pos + 1 + i] >> 32;
+
+				if (std::find(seen.begin(), seen.end(), function) == seen.end())
+				{
+					seen.push_back(function);
+					functions[function].total++;
+				}
+			}
+		}
+
+		std::vector<std::pair<std::uint64_t, Counts>> sorted(functions.begin(), functions.end());
+		std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) { return a.second.self > b.second.self; });
+
+		auto total = std::max<std::uint64_t>(numSamples.load(), 1);
+
+		auto numTicks = ticks.load();
+		auto period = numTicks != 0 ? 1000.0 * cpuTime / CLOCKS_PER_SEC / numTicks : interval.count() / 1000.0;
+		auto ms = [&](std::uint64_t n) { return n * period; };
+
+		output << numSamples.load() << " samples, " << numDropped.load() << " dropped, one per " << std::fixed << std::setprecision(2) << period << " ms of CPU time\n";
+		output << std::setw(10) << "self ms" << std::setw(8) << "self%" << std::setw(10) << "total ms" << std::setw(8) << "total%" << "  function\n";
+
+		for (auto& f : sorted)
+		{
+			output << std::fixed << std::setprecision(1)
+				<< std::setw(10) << ms(f.second.self) << std::setw(8) << 100.0 * f.second.self / total
+				<< std::setw(10) << ms(f.second.total) << std::setw(8) << 100.0 * f.second.total / total
+				<< "  " << functionName(f.first) << '\n';
+		}
+	}
+
+	std::string Profiler::functionName(std::uint64_t function) const
+	{
+		if (function < names.size() && !names[function].empty())
+			return names[function];
+
+		return "f" + std::to_string(function);
+	}
+
+	std::uint64_t Profiler::samples() const
+	{
+		return numSamples.load();
+	}
+
+	std::uint64_t Profiler::dropped() const
+	{
+		return numDropped.load();
+	}
+
+	void Profiler::onTimer(int)
+	{
+		// only lock-free atomics in here, it may be a signal handler
+		if (auto* profiler = active.load(std::memory_order_relaxed))
+			profiler->ticks.fetch_add(1, std::memory_order_relaxed);
+	}
+}
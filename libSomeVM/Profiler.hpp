@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace svm
+{
+	class CallStack;
+
+	/*
+		Sampling profiler. A timer (SIGPROF, so CPU time, where available) bumps a tick count,
+		and every VM using the profiler (see VM::setProfiler) records its call stack, function and
+		instruction index per frame, the next time it goes to run an instruction.
+
+		Samples go into one fixed size buffer, appended to without locking, so any number of VMs
+		on any number of threads can share a profiler. Once it's full, further samples are dropped.
+
+		Only one profiler can be running at a time. Results should only be written once the VMs are done with it.
+	*/
+	class Profiler
+	{
+	public:
+		// 'capacity' is in frames, across all samples
+		Profiler(std::chrono::microseconds interval = std::chrono::milliseconds(1), std::uint64_t capacity = 1 << 22);
+
+		Profiler(const Profiler&) = delete;
+		Profiler& operator=(const Profiler&) = delete;
+
+		~Profiler();
+
+		void start();
+		void stop();
+
+		// used instead of "f<index>" in the output
+		void name(std::uint64_t function, std::string name);
+
+		// one line per distinct stack, root first: "f0;f3;f7 42", as flamegraph.pl expects
+		void writeFolded(std::ostream& output) const;
+
+		// samples (and estimated time) per function, in itself, and in total (including what it called)
+		void writeTable(std::ostream& output) const;
+
+		std::uint64_t samples() const;
+		std::uint64_t dropped() const;
+
+		// changes each time a sample is due
+		std::uint64_t tick() const
+		{
+			return ticks.load(std::memory_order_relaxed);
+		}
+
+		void record(const CallStack& callStack);
+
+	private:
+		// deeper stacks only keep their innermost frames
+		static constexpr std::uint64_t MAX_DEPTH = 256;
+
+		// marks where samples stopped fitting
+		static constexpr std::uint64_t END = ~0ull;
+
+		static void onTimer(int);
+
+		std::string functionName(std::uint64_t function) const;
+
+		// each sample is its depth, followed by (function << 32 | instruction) for each frame, bottom to top
+		std::unique_ptr<std::uint64_t[]> buffer;
+		std::uint64_t capacity;
+		std::atomic<std::uint64_t> used;
+
+		std::atomic<std::uint64_t> numSamples;
+		std::atomic<std::uint64_t> numDropped;
+
+		std::atomic<std::uint64_t> ticks;
+		std::chrono::microseconds interval;
+		bool running;
+
+		// the timer may fire less often than asked (it's often rounded up to the kernel's tick), so time
+		// per sample is worked out from the CPU time spent while running
+		std::clock_t startClock;
+		std::clock_t cpuTime;
+
+		// where there's no SIGPROF
+		std::thread timer;
+
+		std::vector<std::string> names;
+	};
+}
@@ -2,18 +2,103 @@
 
 #include <istream>
 #include <ostream>
+#include <algorithm>
+#include <limits>
+#include <string>
 
-namespace svm
+namespace
 {
+	using namespace svm;
+
 	constexpr auto* BINARY_ID = ".svm";
-	constexpr std::uint32_t VERSION = 0;
+	constexpr std::uint32_t VERSION = 4;
 
-	std::uint64_t Program::load(std::istream& input)
+	// from version 4, each constant starts with one of these
+	constexpr std::uint8_t VALUE_CONSTANT = 0;
+
+	// followed by the element size (std::uint32_t), the length (std::uint64_t), then the elements
+	constexpr std::uint8_t ARRAY_CONSTANT = 1;
+
+	struct TableEntry
+	{
+		std::uint8_t nrets;
+		std::uint8_t nargs;
+		std::uint64_t numInstrs;
+		std::uint64_t offset;
+		std::uint64_t size;
+	};
+
+	struct Header
 	{
+		Encoding encoding;
+		std::vector<TableEntry> table;
+
+		// bytecode of each function is at 'codeStart + offset'
+		std::uint64_t codeStart;
+		std::uint64_t codeSize;
+	};
+
+	void writeArray(std::ostream& output, const Value& array)
+	{
+		auto view = array.arrayView();
+
+		output.write(reinterpret_cast<const char*>(&view.elementSize), sizeof(view.elementSize));
+		output.write(reinterpret_cast<const char*>(&view.length), sizeof(view.length));
+		output.write(static_cast<const char*>(view.data), view.length * view.elementSize);
+	}
+
+	// 'size' bytes, read a chunk at a time, so a made up size runs out of input before it runs out of memory
+	std::vector<char> readBytes(std::istream& input, std::uint64_t size, const char* what)
+	{
+		constexpr std::uint64_t CHUNK = 1 << 16;
+
+		std::vector<char> bytes;
+
+		for (std::uint64_t left = size; left > 0;)
+		{
+			auto chunk = std::min(left, CHUNK);
+			bytes.resize(bytes.size() + chunk);
+			input.read(bytes.data() + bytes.size() - chunk, chunk);
+
+			if (!input)
+				throw std::runtime_error(std::string("Unable to read ") + what);
+
+			left -= chunk;
+		}
+
+		return bytes;
+	}
+
+	Value readArray(std::istream& input)
+	{
+		std::uint32_t elementSize = 0;
+		std::uint64_t length = 0;
+
+		input.read(reinterpret_cast<char*>(&elementSize), sizeof(elementSize));
+		input.read(reinterpret_cast<char*>(&length), sizeof(length));
+
 		if (!input)
-			throw std::runtime_error("Unable to access input stream");
+			throw std::runtime_error("Unable to read array constant");
 
-		auto startPos = input.tellg();
+		// Value::array() turns down any other size
+		if (elementSize != 1 && elementSize != 2 && elementSize != 4 && elementSize != 8)
+			throw std::runtime_error("Array constant of " + std::to_string(elementSize) + " byte elements");
+
+		if (length > std::numeric_limits<std::uint64_t>::max() / elementSize)
+			throw std::runtime_error("Array constant too long");
+
+		auto bytes = readBytes(input, length * elementSize, "array constant");
+
+		return Value::array(elementSize, length, bytes.data());
+	}
+
+	// reads everything up to the start of the code: constants are added to 'program', functions are left to the caller
+	Header readHeader(std::istream& input, Program& program)
+	{
+		auto& constants = program.constants;
+
+		if (!input)
+			throw std::runtime_error("Unable to access input stream");
 
 		std::string identifier(4, 0);
 		input.read(&identifier[0], std::strlen(BINARY_ID));
@@ -22,94 +107,157 @@ namespace svm
 			throw std::runtime_error("Input file is not a valid svm binary");
 
 		// check version...
+		// version 1 is the same, minus the encoding and the code sizes (always Fixed)
+		// versions 1 and 2 don't have the constants' values, version 3 has no array constants
 		std::uint32_t version = 0;
 		input.read(reinterpret_cast<char*>(&version), sizeof(version));
 
-		if (version != VERSION)
+		if (version > VERSION || version == 0)
 			throw std::runtime_error("Incompatible version");
 
+		Header header;
+		header.encoding = Encoding::Fixed;
+
+		if (version >= 2)
+		{
+			input.read(reinterpret_cast<char*>(&header.encoding), sizeof(header.encoding));
+
+			if (header.encoding != Encoding::Fixed && header.encoding != Encoding::Compact)
+				throw std::runtime_error("Unknown bytecode encoding");
+		}
+
 		// constants
+		// counts are only trusted as far as there's input to back them, so nothing is reserved from them
 		std::uint64_t numConstants = 0;
 		input.read(reinterpret_cast<char*>(&numConstants), sizeof(numConstants));
 
-		for (std::uint64_t i = 0; i < numConstants; ++i)
+		// before version 3, constants were counted, but not written
+		if (version >= 3)
 		{
-			/* TODO: better to do a 4 (?) byte number of bytes, followed by that many bytes, no matter the type
-             * We are statically-typed after all
-            Type type;
-			input.read(reinterpret_cast<char*>(&type), sizeof(type));
-
-			switch (type)
+			for (std::uint64_t i = 0; i < numConstants && input; ++i)
 			{
-			case Type::Nil:
-				constants.emplace_back();
-				break;
+				std::uint8_t kind = VALUE_CONSTANT;
 
-			case Type::Bool:
-			{
-				Bool val;
-				input.read(reinterpret_cast<char*>(&val), sizeof(val));
-				constants.emplace_back(val);
-				break;
-			}
+				if (version >= 4)
+					input.read(reinterpret_cast<char*>(&kind), sizeof(kind));
 
-			case Type::Float:
-			{
-				Float val;
-				input.read(reinterpret_cast<char*>(&val), sizeof(val));
-				constants.emplace_back(val);
-				break;
-			}
+				if (kind == ARRAY_CONSTANT)
+				{
+					constants.push_back(readArray(input));
+					continue;
+				}
 
-			// constant arrays are assumed to be Strings
-			case Type::Array:
-			{
-				std::uint64_t len = 0;
-				input.read(reinterpret_cast<char*>(&len), sizeof(len));
+				if (kind != VALUE_CONSTANT)
+					throw std::runtime_error("Unknown constant kind");
 
-				Array<char> val(len);
-				input.read(reinterpret_cast<char*>(&val[0]), len);
+				std::uint64_t bits = 0;
+				input.read(reinterpret_cast<char*>(&bits), sizeof(bits));
 
-				constants.emplace_back(val);
-				break;
-			}
+				// a pointer from whatever process wrote it (ie: an array written by version 3), or made up
+				if (Value::isArrayBits(bits))
+					throw std::runtime_error("Constant is a pointer");
 
-			default:
-			{
-				std::string msg = "Unknown type: ";
-				msg += static_cast<std::uint8_t>(type);
-
-				throw std::runtime_error(msg);
+				constants.push_back(Value::fromBits(bits));
 			}
-			}*/
+
+			if (!input)
+				throw std::runtime_error("Unable to read constants");
 		}
 
-		// functions
+		// function table
 		std::uint64_t numFunctions = 0;
 		input.read(reinterpret_cast<char*>(&numFunctions), sizeof(numFunctions));
 
+		header.codeSize = 0;
+
 		for (std::uint64_t i = 0; i < numFunctions; ++i)
 		{
-			std::uint8_t nrets;
-			std::uint8_t nargs;
+			TableEntry entry;
 
-			input.read(reinterpret_cast<char*>(&nrets), sizeof(nrets));
-			input.read(reinterpret_cast<char*>(&nargs), sizeof(nargs));
+			input.read(reinterpret_cast<char*>(&entry.nrets), sizeof(entry.nrets));
+			input.read(reinterpret_cast<char*>(&entry.nargs), sizeof(entry.nargs));
+			input.read(reinterpret_cast<char*>(&entry.numInstrs), sizeof(entry.numInstrs));
+			input.read(reinterpret_cast<char*>(&entry.offset), sizeof(entry.offset));
 
-			std::uint64_t numInstrs;
-			input.read(reinterpret_cast<char*>(&numInstrs), sizeof(numInstrs));
+			if (version >= 2)
+			{
+				input.read(reinterpret_cast<char*>(&entry.size), sizeof(entry.size));
+			}
+			else
+			{
+				if (entry.numInstrs > std::numeric_limits<std::uint64_t>::max() / sizeof(Instruction))
+					throw std::runtime_error("Function bytecode out of bounds");
+
+				entry.size = entry.numInstrs * sizeof(Instruction);
+			}
 
-			Bytecode code(numInstrs);
+			if (!input)
+				throw std::runtime_error("Unable to read function table");
 
-			input.read(reinterpret_cast<char*>(code.data()), numInstrs * sizeof(Instruction));
+			// the sum would wrap, and pass for a small one
+			if (entry.size > std::numeric_limits<std::uint64_t>::max() - entry.offset)
+				throw std::runtime_error("Function bytecode out of bounds");
 
-			functions.emplace_back(nrets, nargs, code);
+			header.codeSize = std::max(header.codeSize, entry.offset + entry.size);
+			header.table.push_back(entry);
+		}
+
+		header.codeStart = input.tellg();
+
+		return header;
+	}
+}
+
+namespace svm
+{
+	std::uint64_t Program::load(std::istream& input)
+	{
+		auto startPos = input.tellg();
+		auto header = readHeader(input, *this);
+
+		// all the code is together, so read it in one go, and split it up after
+		auto code = readBytes(input, header.codeSize, "bytecode");
+
+		functions.reserve(functions.size() + header.table.size());
+
+		for (auto& entry : header.table)
+		{
+			if (entry.size > code.size() || entry.offset > code.size() - entry.size)
+				throw std::runtime_error("Function bytecode out of bounds");
+
+			auto bytecode = decode(code.data() + entry.offset, entry.size, entry.numInstrs, header.encoding);
+
+			for (auto& instr : bytecode)
+			{
+				if (!instr.valid())
+					throw std::runtime_error("Invalid instruction in function bytecode");
+			}
+
+			functions.emplace_back(entry.nrets, entry.nargs, std::move(bytecode));
 		}
 
 		return input.tellg() - startPos;
 	}
 
-	std::uint64_t Program::write(std::ostream& output) const
+	std::uint64_t Program::load(std::shared_ptr<std::istream> source)
+	{
+		std::istream& input = *source;
+
+		auto startPos = input.tellg();
+		auto header = readHeader(input, *this);
+
+		// each function reads its own bytecode when it's first needed, taking turns with the stream
+		auto shared = std::make_shared<BytecodeSource>(source);
+
+		functions.reserve(functions.size() + header.table.size());
+
+		for (auto& entry : header.table)
+			functions.emplace_back(entry.nrets, entry.nargs, entry.numInstrs, shared, header.codeStart + entry.offset, entry.size, header.encoding);
+
+		return input.tellg() - startPos;
+	}
+
+	std::uint64_t Program::write(std::ostream& output, Encoding encoding) const
 	{
 		if (!output)
 			throw std::runtime_error("Unable to access output stream");
@@ -121,57 +269,90 @@ namespace svm
 
 		// TODO: need to figure out how I want to do versioning
 		// version
-		std::uint32_t version = 0;
+		std::uint32_t version = VERSION;
 		output.write(reinterpret_cast<char*>(&version), sizeof(version));
 
+		output.write(reinterpret_cast<const char*>(&encoding), sizeof(encoding));
+
 		// constants
 		std::uint64_t numConstants = constants.size();
 		output.write(reinterpret_cast<char*>(&numConstants), sizeof(numConstants));
 
+		// each as it's stored, but arrays (which are stored as pointers) by their elements
 		for (auto& c : constants)
 		{
-			/* TODO: better to do a 4 (?) byte number of bytes, followed by that many bytes, no matter the type
-             * We are statically-typed after all
-			auto type = c.type();
+			if (c.object())
+				throw std::runtime_error("Channels, or any other objects, can't be written to a binary");
+
+			auto kind = c.isArray() ? ARRAY_CONSTANT : VALUE_CONSTANT;
+			output.write(reinterpret_cast<const char*>(&kind), sizeof(kind));
+
+			if (c.isArray())
+			{
+				writeArray(output, c);
+				continue;
+			}
 
-			output.write(reinterpret_cast<char*>(&type), sizeof(type));
+			std::uint64_t bits = c.bits();
+			output.write(reinterpret_cast<const char*>(&bits), sizeof(bits));
+		}
+
+		// encode all the code first, the table needs to know where each function ends up
+		std::vector<char> code;
+		std::vector<std::uint64_t> offsets;
+		offsets.reserve(functions.size() + 1);
+
+		// once, for every function (see encode()). Compact instructions end up around 4 bytes
+		std::uint64_t numInstrs = 0;
+		for (auto& f : functions)
+			numInstrs += f.length();
+
+		code.reserve(numInstrs * (encoding == Encoding::Fixed ? sizeof(Instruction) : 4));
+
+		for (auto& f : functions)
+		{
+			offsets.push_back(code.size());
 
-			if (type != Type::Array)
+			if (f.loaded())
 			{
-				Bytes bytes = c;
-				output.write(reinterpret_cast<const char*>(bytes.data()), bytes.length());
+				encode(f.bytecode(), encoding, code);
 			}
 			else
 			{
-				// constant arrays are assumed to be Strings
-				Array<char> str = c;
-				std::uint64_t len = str.length();
-
-				output.write(reinterpret_cast<char*>(&len), sizeof(len));
-				output.write(str.data(), len);
-			} */
+				Function copy = f;
+				copy.load();
+				encode(copy.bytecode(), encoding, code);
+			}
 		}
 
-		// functions
+		offsets.push_back(code.size());
+
+		// function table
 		std::uint64_t numFunctions = functions.size();
 		output.write(reinterpret_cast<char*>(&numFunctions), sizeof(numFunctions));
 
-		for (auto& f : functions)
+		for (std::uint64_t i = 0; i < numFunctions; ++i)
 		{
+			auto& f = functions[i];
+
 			std::uint8_t nrets = f.returns();
 			std::uint8_t nargs = f.args();
+			std::uint64_t numInstrs = f.length();
+
+			// offsets are from the start of the code, which follows the table
+			std::uint64_t offset = offsets[i];
+			std::uint64_t size = offsets[i + 1] - offsets[i];
 
 			output.write(reinterpret_cast<const char*>(&nrets), sizeof(nrets));
 			output.write(reinterpret_cast<const char*>(&nargs), sizeof(nargs));
-
-			std::uint64_t numInstrs = f.length();
-
-			auto& code = f.bytecode();
 			output.write(reinterpret_cast<const char*>(&numInstrs), sizeof(numInstrs));
-			output.write(reinterpret_cast<const char*>(code.data()), numInstrs * sizeof(Instruction));
+			output.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+			output.write(reinterpret_cast<const char*>(&size), sizeof(size));
 		}
 
+		// code
+		output.write(code.data(), code.size());
+
 		return output.tellp() - startPos;
 	}
 }
-
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include <iosfwd>
 
 #include "Function.hpp"
+#include "Encoding.hpp"
 #include "Value.hpp"
 
 namespace svm
@@ -15,7 +17,11 @@ namespace svm
 
 		// return the amount of bytes read/written
 		std::uint64_t load(std::istream& input);
-		std::uint64_t write(std::ostream& output) const;
+		std::uint64_t write(std::ostream& output, Encoding encoding = Encoding::Fixed) const;
+
+		// only reads the constants and the function table. Each function's bytecode is read from 'source' the first time it is loaded
+		// (from any thread, by any Module made from us, reads are serialized). Returns the amount of bytes read up front
+		std::uint64_t load(std::shared_ptr<std::istream> source);
 	};
 }
 
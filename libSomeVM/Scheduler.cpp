@@ -0,0 +1,345 @@
+#include "Scheduler.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+#include "Module.hpp"
+#include "Channel.hpp"
+
+namespace
+{
+	using namespace svm;
+
+	// which scheduler, and which of its workers, the current thread is
+	thread_local const Scheduler* currentScheduler = nullptr;
+	thread_local std::uint64_t currentWorker = 0;
+
+	// xorshift64, only used for picking who to steal from
+	std::uint64_t nextRandom(std::uint64_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+}
+
+namespace svm
+{
+	Scheduler::Scheduler(std::uint64_t numWorkers)
+		: workerStates(new Worker[std::max<std::uint64_t>(numWorkers, 1)]),
+		numWorkers(std::max<std::uint64_t>(numWorkers, 1)),
+		spawned(0),
+		queued(0),
+		stopping(false)
+	{
+		for (std::uint64_t i = 0; i < this->numWorkers; ++i)
+			workerStates[i].randomState = 0x9e3779b97f4a7c15ull * (i + 1);
+
+		// worker 0 is whoever created us
+		threads.reserve(this->numWorkers - 1);
+
+		for (std::uint64_t i = 1; i < this->numWorkers; ++i)
+			threads.emplace_back(&Scheduler::work, this, i);
+	}
+
+	Scheduler::~Scheduler()
+	{
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			stopping = true;
+		}
+
+		wake.notify_all();
+
+		for (auto& t : threads)
+			t.join();
+	}
+
+	std::uint64_t Scheduler::spawn(std::shared_ptr<const Module> module, std::uint64_t function, std::vector<Value> args,
+								   std::uint64_t registrySize, VM::Dispatch dispatch)
+	{
+		if (function >= module->numFunctions())
+			throw std::out_of_range("Attempt to spawn a function that doesn't exist");
+
+		auto owned = std::make_unique<Task>();
+		auto* task = owned.get();
+
+		task->module = std::move(module);
+		task->function = function;
+		task->args = std::move(args);
+		task->registrySize = std::max<std::uint64_t>(registrySize, task->args.size());
+		task->dispatch = dispatch;
+
+		std::uint64_t id;
+
+		{
+			std::lock_guard<std::mutex> guard(tasksLock);
+
+			id = spawned++;
+			tasks.emplace(id, std::move(owned));
+		}
+
+		requeue(*task);
+
+		return id;
+	}
+
+	std::vector<Value> Scheduler::join(std::uint64_t id)
+	{
+		Task* task;
+
+		{
+			std::lock_guard<std::mutex> guard(tasksLock);
+
+			auto found = tasks.find(id);
+
+			if (found == tasks.end())
+			{
+				if (id < spawned)
+					throw std::logic_error("Attempt to join a task more than once");
+
+				throw std::out_of_range("Attempt to join a task that doesn't exist");
+			}
+
+			task = found->second.get();
+
+			if (task->joined)
+				throw std::logic_error("Attempt to join a task more than once");
+
+			task->joined = true;
+		}
+
+		helpUntil(task->done);
+
+		auto error = task->error;
+		auto results = std::move(task->results);
+
+		{
+			std::lock_guard<std::mutex> guard(tasksLock);
+			tasks.erase(id);
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+
+		return results;
+	}
+
+	void Scheduler::wait(Channel& channel, bool send)
+	{
+		std::atomic<bool> ready{ false };
+
+		channel.whenReady(send, std::make_shared<Channel::Waiter>([&]()
+		{
+			{
+				std::lock_guard<std::mutex> guard(sleepLock);
+				ready = true;
+			}
+
+			wake.notify_all();
+		}));
+
+		helpUntil(ready);
+	}
+
+	bool Scheduler::runOne()
+	{
+		auto worker = self();
+
+		if (auto* task = find(worker))
+		{
+			execute(*task, worker);
+			return true;
+		}
+
+		++workerStates[worker].idle;
+		return false;
+	}
+
+	std::uint64_t Scheduler::workers() const
+	{
+		return numWorkers;
+	}
+
+	Scheduler::Stats Scheduler::stats() const
+	{
+		Stats stats{ spawned.load(), 0, 0, 0 };
+
+		for (std::uint64_t i = 0; i < numWorkers; ++i)
+		{
+			stats.executed += workerStates[i].executed.load(std::memory_order_relaxed);
+			stats.steals += workerStates[i].steals.load(std::memory_order_relaxed);
+			stats.idle += workerStates[i].idle.load(std::memory_order_relaxed);
+		}
+
+		return stats;
+	}
+
+	std::uint64_t Scheduler::self() const
+	{
+		return currentScheduler == this ? currentWorker : 0;
+	}
+
+	Scheduler::Task* Scheduler::find(std::uint64_t worker)
+	{
+		auto& own = workerStates[worker];
+
+		{
+			std::lock_guard<std::mutex> guard(own.lock);
+
+			if (!own.tasks.empty())
+			{
+				auto* task = own.tasks.back();
+				own.tasks.pop_back();
+				--queued;
+				return task;
+			}
+		}
+
+		// start at a random victim, so thieves don't all pile onto the same one
+		auto start = nextRandom(own.randomState) % numWorkers;
+
+		for (std::uint64_t i = 0; i < numWorkers; ++i)
+		{
+			auto victimIdx = (start + i) % numWorkers;
+
+			if (victimIdx == worker)
+				continue;
+
+			auto& victim = workerStates[victimIdx];
+			std::lock_guard<std::mutex> guard(victim.lock);
+
+			if (!victim.tasks.empty())
+			{
+				auto* task = victim.tasks.front();
+				victim.tasks.pop_front();
+				--queued;
+
+				++own.steals;
+				return task;
+			}
+		}
+
+		return nullptr;
+	}
+
+	void Scheduler::execute(Task& task, std::uint64_t worker)
+	{
+		try
+		{
+			if (task.vm)
+			{
+				task.vm->resumeRun();
+			}
+			else
+			{
+				task.vm = std::make_unique<VM>(task.registrySize, task.dispatch);
+				task.vm->load(task.module);
+				task.vm->taskScheduler = this;
+				task.vm->isTask = true;
+
+				for (auto& arg : task.args)
+					task.vm->write(arg);
+
+				task.vm->execute(task.function);
+			}
+
+			if (task.vm->waiting())
+			{
+				// whoever wakes it queues it again, maybe even before this returns, so it's not ours to touch after
+				task.vm->whenReady([this, &task]() { requeue(task); });
+				return;
+			}
+
+			auto nrets = task.module->function(task.function).returns();
+
+			task.results.reserve(nrets);
+
+			for (std::uint64_t i = 0; i < nrets; ++i)
+				task.results.push_back(task.vm->read(i));
+		}
+		catch (...)
+		{
+			task.error = std::current_exception();
+		}
+
+		task.vm.reset();
+		task.args.clear();
+		task.args.shrink_to_fit();
+
+		++workerStates[worker].executed;
+
+		// a joiner may free the task as soon as it sees this
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			task.done.store(true, std::memory_order_release);
+		}
+
+		wake.notify_all();
+	}
+
+	void Scheduler::requeue(Task& task)
+	{
+		auto& worker = workerStates[self()];
+
+		{
+			std::lock_guard<std::mutex> guard(worker.lock);
+			worker.tasks.push_back(&task);
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			++queued;
+		}
+
+		wake.notify_one();
+	}
+
+	void Scheduler::helpUntil(const std::atomic<bool>& done)
+	{
+		auto worker = self();
+
+		// help out until it's done, and sleep when there's nothing to help with
+		while (!done.load(std::memory_order_acquire))
+		{
+			if (auto* other = find(worker))
+			{
+				execute(*other, worker);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepLock);
+
+			if (done || queued > 0)
+				continue;
+
+			++workerStates[worker].idle;
+			wake.wait(lock, [&]() { return done || queued > 0; });
+		}
+	}
+
+	void Scheduler::work(std::uint64_t worker)
+	{
+		currentScheduler = this;
+		currentWorker = worker;
+
+		while (!stopping.load(std::memory_order_relaxed))
+		{
+			if (auto* task = find(worker))
+			{
+				execute(*task, worker);
+				continue;
+			}
+
+			// nothing to do. Sleep until something is spawned
+			std::unique_lock<std::mutex> lock(sleepLock);
+
+			if (stopping || queued > 0)
+				continue;
+
+			++workerStates[worker].idle;
+			wake.wait(lock, [this]() { return stopping || queued > 0; });
+		}
+	}
+}
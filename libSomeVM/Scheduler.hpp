@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+
+#include "Value.hpp"
+#include "VM.hpp"
+
+namespace svm
+{
+	class Module;
+	class Channel;
+
+	/*
+		Runs Spawn'd tasks on a fixed set of worker threads, each task in its own VM sharing the spawner's Module.
+
+		Each worker has its own deque of tasks: it pushes and pops at the back, while idle workers
+		steal from the front of a randomly picked victim. The thread that created the scheduler counts
+		as worker 0, and only runs tasks while it's waiting in join().
+
+		A join() on a task that isn't done yet runs other tasks until it is, so workers are never blocked
+		waiting on each other. With nothing left to run, it sleeps until a task is spawned or finishes.
+
+		A task waiting on a channel is parked, freeing its worker, and queued again once the channel might be ready.
+	*/
+	class Scheduler
+	{
+	public:
+		struct Stats
+		{
+			std::uint64_t spawned;
+			std::uint64_t executed;
+
+			// tasks taken from another worker's deque
+			std::uint64_t steals;
+
+			// times a worker looked everywhere, found nothing to do, and went to sleep
+			std::uint64_t idle;
+		};
+
+		// 'numWorkers' includes the calling thread
+		explicit Scheduler(std::uint64_t numWorkers);
+
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator=(const Scheduler&) = delete;
+
+		// tasks that were never joined may not be run
+		~Scheduler();
+
+		// queues 'function' of 'module' to be called with 'args' (written to registers 0, 1, ...) and returns the task's id
+		// 'registrySize' and 'dispatch' are passed to the VM that runs the task
+		std::uint64_t spawn(std::shared_ptr<const Module> module, std::uint64_t function, std::vector<Value> args,
+							std::uint64_t registrySize, VM::Dispatch dispatch);
+
+		// waits for the task to finish, and returns its results (registers 0 to its function's number of returns)
+		// rethrows anything the task threw. Each task can only be joined once
+		std::vector<Value> join(std::uint64_t task);
+
+		// runs one queued task on the calling thread, if there is one. For waiting without holding up a worker
+		bool runOne();
+
+		// runs queued tasks until a send (or receive) on 'channel' might go through. For VMs that aren't tasks
+		void wait(Channel& channel, bool send);
+
+		std::uint64_t workers() const;
+
+		Stats stats() const;
+
+	private:
+		struct Task
+		{
+			std::shared_ptr<const Module> module;
+			std::uint64_t function;
+			std::vector<Value> args;
+			std::uint64_t registrySize;
+			VM::Dispatch dispatch;
+
+			// while parked, waiting on a channel
+			std::unique_ptr<VM> vm;
+
+			std::vector<Value> results;
+			std::exception_ptr error;
+
+			// set under sleepLock, so a joiner can't miss it
+			std::atomic<bool> done{ false };
+			bool joined = false;
+		};
+
+		// everything one worker touches, kept to its own cache lines
+		struct alignas(64) Worker
+		{
+			std::mutex lock;
+			std::deque<Task*> tasks;
+
+			std::uint64_t randomState;
+
+			std::atomic<std::uint64_t> executed{ 0 };
+			std::atomic<std::uint64_t> steals{ 0 };
+			std::atomic<std::uint64_t> idle{ 0 };
+		};
+
+		// the worker the calling thread is, 0 if it isn't one of ours
+		std::uint64_t self() const;
+
+		// pops from our own deque, or steals from someone else's. Null if there's nothing to do
+		Task* find(std::uint64_t worker);
+
+		// runs (or resumes) the task until it's done, or parks
+		void execute(Task& task, std::uint64_t worker);
+
+		// queues a parked task again, from any thread
+		void requeue(Task& task);
+
+		// runs tasks until 'done' is set (under sleepLock)
+		void helpUntil(const std::atomic<bool>& done);
+
+		void work(std::uint64_t worker);
+
+		std::unique_ptr<Worker[]> workerStates;
+		std::uint64_t numWorkers;
+		std::vector<std::thread> threads;
+
+		// tasks not yet joined, by id. Joining one removes it
+		std::unordered_map<std::uint64_t, std::unique_ptr<Task>> tasks;
+		mutable std::mutex tasksLock;
+
+		std::atomic<std::uint64_t> spawned;
+
+		// tasks sitting in a deque (briefly -1, when one is taken before it was counted). Only raised under sleepLock,
+		// so a worker about to sleep can't miss one
+		std::atomic<std::int64_t> queued;
+
+		std::atomic<bool> stopping;
+		std::mutex sleepLock;
+
+		// a task was queued or finished, or we're stopping
+		std::condition_variable wake;
+	};
+}
@@ -0,0 +1,420 @@
+#include "Snapshot.hpp"
+
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <stdexcept>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Function.hpp"
+
+namespace
+{
+	using namespace svm;
+
+	constexpr char SNAPSHOT_ID[4] = { '.', 's', 'v', 's' };
+	// version 0 stored arrays as the pointers they were
+	constexpr std::uint32_t SNAPSHOT_VERSION = 1;
+
+	// no type information
+	constexpr std::uint8_t UNKNOWN_TYPE = 0xff;
+
+	// the bits are the offset of a StoredArray, from arraysOffset
+	constexpr std::uint8_t ARRAY_TYPE = 0xfe;
+
+	/*
+		[Header]
+		[StoredValue x numConstants]	at constantsOffset
+		[StoredValue x numRegisters]	at registryOffset
+		[StoredFunction x numFunctions]	at functionsOffset
+		[Instruction x ...]				at codeOffset
+		[StoredArray, elements ...]		at arraysOffset, each padded to 8 bytes
+	 */
+	struct Header
+	{
+		char id[4];
+		std::uint32_t version;
+
+		std::uint64_t numConstants;
+		std::uint64_t constantsOffset;
+
+		std::uint64_t numRegisters;
+		std::uint64_t registryOffset;
+		std::uint64_t nextFree;
+
+		std::uint64_t numFunctions;
+		std::uint64_t functionsOffset;
+
+		std::uint64_t codeOffset;
+		std::uint64_t codeLength;
+
+		// in bytes
+		std::uint64_t arraysOffset;
+		std::uint64_t arraysSize;
+	};
+
+	struct StoredValue
+	{
+		std::uint64_t bits;
+		std::uint8_t type;
+		std::uint8_t padding[7];
+	};
+
+	struct StoredFunction
+	{
+		std::uint8_t nrets;
+		std::uint8_t nargs;
+		std::uint8_t padding[6];
+
+		// in instructions, from codeOffset
+		std::uint64_t offset;
+		std::uint64_t length;
+	};
+
+	struct StoredArray
+	{
+		std::uint32_t elementSize;
+		std::uint32_t padding;
+		std::uint64_t length;
+	};
+
+	static_assert(sizeof(Header) % 8 == 0, "Snapshot tables must stay 8 byte aligned");
+	static_assert(sizeof(StoredValue) == 16, "Unexpected padding in StoredValue");
+	static_assert(sizeof(StoredFunction) == 24, "Unexpected padding in StoredFunction");
+	static_assert(sizeof(StoredArray) == 16, "Unexpected padding in StoredArray");
+	static_assert(sizeof(Instruction) == 8, "Unexpected Instruction size");
+
+	std::uint64_t padded(std::uint64_t bytes)
+	{
+		return (bytes + 7) / 8 * 8;
+	}
+
+	// arrays are appended to 'arrays', to be written after everything else
+	StoredValue store(const Value& val, std::vector<char>& arrays)
+	{
+		StoredValue ret{};
+
+		if (val.isArray())
+		{
+			auto view = val.arrayView();
+
+			StoredArray stored{ view.elementSize, 0, view.length };
+			auto bytes = view.length * view.elementSize;
+
+			ret.bits = arrays.size();
+			ret.type = ARRAY_TYPE;
+
+			arrays.insert(arrays.end(), reinterpret_cast<const char*>(&stored), reinterpret_cast<const char*>(&stored + 1));
+			arrays.insert(arrays.end(), static_cast<const char*>(view.data), static_cast<const char*>(view.data) + bytes);
+			arrays.resize(padded(arrays.size()));
+
+			return ret;
+		}
+
+		if (val.object())
+			throw std::runtime_error("Unable to snapshot a channel, or any other object");
+
+		ret.bits = val.bits();
+
+#ifdef DEBUG
+		ret.type = static_cast<std::uint8_t>(val.type());
+#else
+		ret.type = UNKNOWN_TYPE;
+#endif
+
+		return ret;
+	}
+
+	// 'arrays' is the snapshot's arrays section, only what's in it is trusted to be an array
+	Value restore(const StoredValue& stored, const char* arrays, std::uint64_t arraysSize)
+	{
+		if (stored.type == ARRAY_TYPE)
+		{
+			if (stored.bits % alignof(StoredArray) != 0 || stored.bits > arraysSize || arraysSize - stored.bits < sizeof(StoredArray))
+				throw std::runtime_error("Snapshot array out of bounds");
+
+			StoredArray array;
+			std::memcpy(&array, arrays + stored.bits, sizeof(array));
+
+			auto available = arraysSize - stored.bits - sizeof(StoredArray);
+
+			if (array.elementSize == 0 || array.length > available / array.elementSize)
+				throw std::runtime_error("Snapshot array out of bounds");
+
+			return Value::array(array.elementSize, array.length, arrays + stored.bits + sizeof(StoredArray));
+		}
+
+		// a pointer from whatever process wrote it, or made up
+		if (Value::isArrayBits(stored.bits))
+			throw std::runtime_error("Snapshot value is a pointer");
+
+#ifdef DEBUG
+		if (stored.type != UNKNOWN_TYPE)
+			return Value::fromBits(stored.bits, static_cast<Type>(stored.type));
+#endif
+		return Value::fromBits(stored.bits);
+	}
+
+	// reads directly from memory
+	class MemoryBuffer : public std::streambuf
+	{
+	public:
+		MemoryBuffer(const char* data, std::uint64_t size)
+		{
+			char* begin = const_cast<char*>(data);
+			setg(begin, begin, begin + size);
+		}
+
+	protected:
+		pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode) override
+		{
+			char* pos = dir == std::ios::beg ? eback() : dir == std::ios::cur ? gptr() : egptr();
+			pos += off;
+
+			if (pos < eback() || pos > egptr())
+				return pos_type(off_type(-1));
+
+			setg(eback(), pos, egptr());
+			return pos_type(pos - eback());
+		}
+
+		pos_type seekpos(pos_type pos, std::ios::openmode which) override
+		{
+			return seekoff(off_type(pos), std::ios::beg, which);
+		}
+	};
+
+	class SnapshotStream : public std::istream
+	{
+	public:
+		SnapshotStream(std::shared_ptr<const Snapshot> snapshot, const char* data, std::uint64_t size)
+			: std::istream(nullptr),
+			snapshot(snapshot),
+			buffer(data, size)
+		{
+			rdbuf(&buffer);
+		}
+
+	private:
+		std::shared_ptr<const Snapshot> snapshot;
+		MemoryBuffer buffer;
+	};
+
+	void writeValues(std::ostream& output, const std::vector<Value>& values, std::vector<char>& arrays)
+	{
+		for (auto& v : values)
+		{
+			auto stored = store(v, arrays);
+			output.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+		}
+	}
+}
+
+namespace svm
+{
+	Snapshot::Snapshot(const std::string& path)
+		: data(nullptr),
+		size(0)
+	{
+#ifndef _WIN32
+		int fd = ::open(path.c_str(), O_RDONLY);
+
+		if (fd == -1)
+			throw std::runtime_error("Unable to open snapshot: " + path);
+
+		struct stat info;
+		if (::fstat(fd, &info) == 0 && info.st_size > 0)
+		{
+			void* mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (mapped != MAP_FAILED)
+			{
+				data = static_cast<const char*>(mapped);
+				size = info.st_size;
+			}
+		}
+
+		::close(fd);
+#endif
+
+		// no mmap, read the whole thing instead
+		if (data == nullptr)
+		{
+			std::ifstream fin(path, std::ios::binary);
+
+			if (!fin)
+				throw std::runtime_error("Unable to open snapshot: " + path);
+
+			buffer.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+			data = buffer.data();
+			size = buffer.size();
+		}
+
+		if (size < sizeof(Header))
+			throw std::runtime_error("Snapshot is too small: " + path);
+
+		auto& header = *reinterpret_cast<const Header*>(data);
+
+		if (std::memcmp(header.id, SNAPSHOT_ID, sizeof(SNAPSHOT_ID)) != 0)
+			throw std::runtime_error("Not a snapshot: " + path);
+
+		if (header.version != SNAPSHOT_VERSION)
+			throw std::runtime_error("Incompatible snapshot version");
+
+		// check everything is in bounds up front, so the accessors don't have to
+		table<StoredValue>(header.constantsOffset, header.numConstants);
+		table<StoredValue>(header.registryOffset, header.numRegisters);
+		table<Instruction>(header.codeOffset, header.codeLength);
+		// arrays are checked one by one as they're restored, the section just has to be aligned for them
+		table<StoredArray>(header.arraysOffset, 0);
+		table<char>(header.arraysOffset, header.arraysSize);
+
+		auto functions = table<StoredFunction>(header.functionsOffset, header.numFunctions);
+
+		for (std::uint64_t i = 0; i < header.numFunctions; ++i)
+		{
+			auto& f = functions[i];
+
+			if (f.offset > header.codeLength || f.length > header.codeLength - f.offset)
+				throw std::runtime_error("Snapshot function code out of bounds");
+		}
+	}
+
+	Snapshot::~Snapshot()
+	{
+#ifndef _WIN32
+		if (buffer.empty() && data != nullptr)
+			::munmap(const_cast<char*>(data), size);
+#endif
+	}
+
+	std::uint64_t Snapshot::numConstants() const
+	{
+		return reinterpret_cast<const Header*>(data)->numConstants;
+	}
+
+	Value Snapshot::constant(std::uint64_t idx) const
+	{
+		auto& header = *reinterpret_cast<const Header*>(data);
+		return restore(table<StoredValue>(header.constantsOffset, header.numConstants)[idx], data + header.arraysOffset, header.arraysSize);
+	}
+
+	std::uint64_t Snapshot::numRegisters() const
+	{
+		return reinterpret_cast<const Header*>(data)->numRegisters;
+	}
+
+	Value Snapshot::registry(std::uint64_t idx) const
+	{
+		auto& header = *reinterpret_cast<const Header*>(data);
+		return restore(table<StoredValue>(header.registryOffset, header.numRegisters)[idx], data + header.arraysOffset, header.arraysSize);
+	}
+
+	std::uint64_t Snapshot::nextFree() const
+	{
+		return reinterpret_cast<const Header*>(data)->nextFree;
+	}
+
+	std::uint64_t Snapshot::numFunctions() const
+	{
+		return reinterpret_cast<const Header*>(data)->numFunctions;
+	}
+
+	Snapshot::FunctionView Snapshot::function(std::uint64_t idx) const
+	{
+		auto& header = *reinterpret_cast<const Header*>(data);
+		auto& stored = table<StoredFunction>(header.functionsOffset, header.numFunctions)[idx];
+
+		return{ stored.nrets, stored.nargs, header.codeOffset + stored.offset * sizeof(Instruction), stored.length };
+	}
+
+	std::shared_ptr<std::istream> Snapshot::stream(std::shared_ptr<const Snapshot> snapshot)
+	{
+		return std::make_shared<SnapshotStream>(snapshot, snapshot->data, snapshot->size);
+	}
+
+	std::uint64_t Snapshot::write(std::ostream& output, const std::vector<Value>& constants, const std::vector<Value>& registry,
+								  std::uint64_t nextFree, const std::vector<Function>& functions)
+	{
+		if (!output)
+			throw std::runtime_error("Unable to access output stream");
+
+		Header header{};
+		std::memcpy(header.id, SNAPSHOT_ID, sizeof(SNAPSHOT_ID));
+		header.version = SNAPSHOT_VERSION;
+
+		header.numConstants = constants.size();
+		header.constantsOffset = sizeof(Header);
+
+		header.numRegisters = registry.size();
+		header.registryOffset = header.constantsOffset + header.numConstants * sizeof(StoredValue);
+		header.nextFree = nextFree;
+
+		header.numFunctions = functions.size();
+		header.functionsOffset = header.registryOffset + header.numRegisters * sizeof(StoredValue);
+
+		header.codeOffset = header.functionsOffset + header.numFunctions * sizeof(StoredFunction);
+		header.codeLength = 0;
+
+		for (auto& f : functions)
+			header.codeLength += f.length();
+
+		// the arrays' contents go last, but their offsets are needed as the values are written
+		std::vector<char> arrays;
+		std::ostringstream values;
+
+		writeValues(values, constants, arrays);
+		writeValues(values, registry, arrays);
+
+		header.arraysOffset = header.codeOffset + header.codeLength * sizeof(Instruction);
+		header.arraysSize = arrays.size();
+
+		auto startPos = output.tellp();
+
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		output << values.str();
+
+		std::uint64_t offset = 0;
+
+		for (auto& f : functions)
+		{
+			if (!f.loaded())
+				throw std::logic_error("Functions must be loaded to be stored in a snapshot");
+
+			StoredFunction stored{};
+			stored.nrets = f.returns();
+			stored.nargs = f.args();
+			stored.offset = offset;
+			stored.length = f.length();
+
+			output.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+
+			offset += stored.length;
+		}
+
+		for (auto& f : functions)
+			output.write(reinterpret_cast<const char*>(f.bytecode().data()), f.length() * sizeof(Instruction));
+
+		output.write(arrays.data(), arrays.size());
+
+		return output.tellp() - startPos;
+	}
+
+	template<typename T>
+	const T* Snapshot::table(std::uint64_t offset, std::uint64_t count) const
+	{
+		if (offset % alignof(T) != 0 || offset > size || count > (size - offset) / sizeof(T))
+			throw std::runtime_error("Snapshot table out of bounds");
+
+		return reinterpret_cast<const T*>(data + offset);
+	}
+}
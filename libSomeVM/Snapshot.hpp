@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iosfwd>
+
+#include "Instruction.hpp"
+#include "Value.hpp"
+
+namespace svm
+{
+	class Function;
+
+	/*
+		A snapshot of a loaded (and possibly already run) VM: constants, functions, and registry.
+
+		Laid out so it can be used straight from a memory mapped file: a fixed header, followed by
+		8 byte aligned tables of plain data (see Snapshot.cpp). Restoring is a validation of the header,
+		and copying the constants and registry out of the mapping, no parsing. Functions are restored
+		as lazily loaded functions, so their bytecode is only copied out the first time they're called.
+
+		Values are stored as their bits, but for arrays, whose elements are stored after the code, and copied
+		back out into new arrays when restored. Any other value that would be a pointer is refused.
+	 */
+	class Snapshot
+	{
+	public:
+		struct FunctionView
+		{
+			std::uint8_t nrets;
+			std::uint8_t nargs;
+
+			// from the start of the snapshot, in bytes
+			std::uint64_t offset;
+			std::uint64_t length;
+		};
+
+		// maps the snapshot at 'path' into memory
+		explicit Snapshot(const std::string& path);
+
+		Snapshot(const Snapshot&) = delete;
+		Snapshot& operator=(const Snapshot&) = delete;
+
+		~Snapshot();
+
+		std::uint64_t numConstants() const;
+		Value constant(std::uint64_t idx) const;
+
+		std::uint64_t numRegisters() const;
+		Value registry(std::uint64_t idx) const;
+
+		// index of the first register VM::write(Value) would write to
+		std::uint64_t nextFree() const;
+
+		std::uint64_t numFunctions() const;
+		FunctionView function(std::uint64_t idx) const;
+
+		// a stream over the whole snapshot, which keeps it alive. Function bytecode is read from here
+		static std::shared_ptr<std::istream> stream(std::shared_ptr<const Snapshot> snapshot);
+
+		// all functions must be loaded
+		static std::uint64_t write(std::ostream& output, const std::vector<Value>& constants, const std::vector<Value>& registry,
+								   std::uint64_t nextFree, const std::vector<Function>& functions);
+
+	private:
+		template<typename T>
+		const T* table(std::uint64_t offset, std::uint64_t count) const;
+
+		const char* data;
+		std::uint64_t size;
+
+		// only used when we can't map the file
+		std::vector<char> buffer;
+	};
+}
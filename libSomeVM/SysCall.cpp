@@ -0,0 +1,457 @@
+#include "VM.hpp"
+
+#include <cmath>
+#include <cerrno>
+#include <string>
+#include <cstring>
+#include <system_error>
+
+#include "Channel.hpp"
+#include "Scheduler.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#endif
+
+namespace
+{
+	using namespace svm;
+
+	std::system_error systemError(const char* what)
+	{
+		return std::system_error(errno, std::generic_category(), what);
+	}
+}
+
+namespace svm
+{
+	bool VM::channelCall(SysCall call, std::int64_t nargs, std::int64_t argIdx, Frame& frame)
+	{
+		auto arg = [&](std::int64_t i) -> Value&
+		{
+			if (i >= nargs)
+				throw std::out_of_range("Too few syscall arguments");
+
+			return registry.at(argIdx + i);
+		};
+
+		auto result = [&](std::int64_t i) -> Value&
+		{
+			return registry.at(argIdx + i);
+		};
+
+		auto channel = [&]()
+		{
+			auto* chan = Channel::get(arg(0));
+
+			if (!chan)
+				throw std::out_of_range("Not a channel");
+
+			return chan;
+		};
+
+		switch (call)
+		{
+		case SysCall::NewChannel:
+		{
+			auto capacity = getInteger(arg(0));
+			Bool multi = nargs > 1 ? static_cast<Bool>(arg(1)) : true;
+
+			if (capacity <= 0)
+				throw std::out_of_range("Channel capacity must be positive");
+
+			result(0) = Channel::create(capacity, multi ? Channel::Kind::Multi : Channel::Kind::Single);
+			return true;
+		}
+
+		case SysCall::Send:
+		{
+			auto* chan = channel();
+
+			if (chan->trySend(arg(1)))
+				result(0) = true;
+			else if (chan->closed())
+				result(0) = false;
+			else
+				waitFor(frame, arg(0), true);
+
+			return true;
+		}
+
+		case SysCall::Recv:
+		{
+			auto* chan = channel();
+
+			Value value;
+			bool received = chan->tryRecv(value);
+
+			// anything sent before closing is still received
+			if (!received && chan->closed())
+				received = chan->tryRecv(value);
+
+			if (!received && !chan->closed())
+			{
+				waitFor(frame, arg(0), false);
+				return true;
+			}
+
+			result(0) = std::move(value);
+			result(1) = received;
+			return true;
+		}
+
+		case SysCall::CloseChannel:
+			channel()->close();
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	void VM::waitFor(Frame& frame, const Value& channel, bool send)
+	{
+		// run the syscall again once we might get through
+		frame.jump(frame.index() - 1);
+
+		auto* chan = Channel::get(channel);
+
+		if (eventLoop || isTask)
+		{
+			// parking the call stack makes the run loop return, whoever runs us then calls whenReady()
+			waitChannel = channel;
+			waitWrite = send;
+			std::swap(callStack, parked);
+		}
+		else if (taskScheduler)
+		{
+			taskScheduler->wait(*chan, send);
+		}
+		else
+		{
+			chan->wait(send);
+		}
+	}
+
+	void VM::whenReady(std::function<void()> wake)
+	{
+		auto* chan = Channel::get(waitChannel);
+
+		// may be woken (and resumed, on another thread) before this returns, so it mustn't touch us after
+		auto waiter = std::make_shared<Channel::Waiter>(std::move(wake));
+		channelWaiter = waiter;
+
+		chan->whenReady(waitWrite, std::move(waiter));
+	}
+
+	void VM::cancelWait()
+	{
+		if (channelWaiter)
+		{
+			channelWaiter->cancel();
+			channelWaiter.reset();
+		}
+
+		waitChannel = Value{};
+	}
+
+#ifdef __linux__
+	void VM::sysCall(SysCall call, std::int64_t nargs, std::int64_t argIdx, Frame& frame)
+	{
+		if (channelCall(call, nargs, argIdx, frame))
+			return;
+
+		auto arg = [&](std::int64_t i) -> Value&
+		{
+			if (i >= nargs)
+				throw std::out_of_range("Too few syscall arguments");
+
+			return registry.at(argIdx + i);
+		};
+
+		auto result = [&](std::int64_t i) -> Value&
+		{
+			return registry.at(argIdx + i);
+		};
+
+		switch (call)
+		{
+		case SysCall::Pipe:
+		{
+			int fds[2];
+
+			if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+				throw systemError("pipe");
+
+			result(0) = fromInteger(fds[0]);
+			result(1) = fromInteger(fds[1]);
+			break;
+		}
+
+		case SysCall::SocketPair:
+		{
+			int fds[2];
+
+			if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0)
+				throw systemError("socketpair");
+
+			result(0) = fromInteger(fds[0]);
+			result(1) = fromInteger(fds[1]);
+			break;
+		}
+
+		case SysCall::Open:
+		{
+			auto path = arg(0).arrayView();
+
+			if (path.elementSize != 1)
+				throw std::runtime_error("Open takes a path of 1 byte elements");
+
+			std::string name(static_cast<const char*>(path.data), path.length);
+
+			if (name.find('\0') != std::string::npos)
+				throw std::runtime_error("Open's path has a null in it");
+
+			auto flags = getInteger(arg(1));
+
+			// anything past Append
+			if (flags < 0 || flags >= static_cast<std::int64_t>(OpenFlag::Append) * 2)
+				throw std::runtime_error("Unknown Open flags: " + std::to_string(flags));
+
+			auto has = [&](OpenFlag flag)
+			{
+				return (flags & static_cast<std::int64_t>(flag)) != 0;
+			};
+
+			int mode = O_NONBLOCK | O_CLOEXEC;
+
+			if (has(OpenFlag::Write))
+				mode |= has(OpenFlag::Read) ? O_RDWR : O_WRONLY;
+			else
+				mode |= O_RDONLY;
+
+			if (has(OpenFlag::Create))
+				mode |= O_CREAT;
+			if (has(OpenFlag::Truncate))
+				mode |= O_TRUNC;
+			if (has(OpenFlag::Append))
+				mode |= O_APPEND;
+
+			int fd = ::open(name.c_str(), mode, 0666);
+
+			if (fd < 0)
+				throw systemError("open");
+
+			result(0) = fromInteger(fd);
+			break;
+		}
+
+		case SysCall::Read:
+		{
+			int fd = static_cast<int>(getInteger(arg(0)));
+
+			// a value may arrive a few bytes at a time (ie: from a socket), what we have so far waits in ioPartial
+			auto n = ::read(fd, ioPartial + ioDone, sizeof(ioPartial) - ioDone);
+
+			if (n > 0)
+			{
+				ioDone += n;
+
+				if (ioDone < sizeof(ioPartial))
+				{
+					waitFor(frame, fd, false);
+					break;
+				}
+
+				std::uint64_t bits;
+				std::memcpy(&bits, ioPartial, sizeof(bits));
+				ioDone = 0;
+
+				result(0) = Value::fromBits(bits);
+				result(1) = true;
+			}
+			else if (n == 0)
+			{
+				// end of file, dropping a partial value at the end of a file
+				ioDone = 0;
+
+				result(0) = Value{};
+				result(1) = false;
+			}
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				waitFor(frame, fd, false);
+			}
+			else
+			{
+				ioDone = 0;
+				throw systemError("read");
+			}
+
+			break;
+		}
+
+		case SysCall::Write:
+		{
+			int fd = static_cast<int>(getInteger(arg(0)));
+			std::uint64_t bits = arg(1).bits();
+			auto* bytes = reinterpret_cast<const char*>(&bits) + ioDone;
+			auto size = sizeof(bits) - ioDone;
+
+			// sockets say EPIPE without raising SIGPIPE, for pipes that's up to whoever embeds us (see SysCall.hpp)
+			auto n = ::send(fd, bytes, size, MSG_NOSIGNAL);
+
+			if (n < 0 && errno == ENOTSOCK)
+				n = ::write(fd, bytes, size);
+
+			if (n >= 0)
+			{
+				// a short write goes on from where it stopped once there's room
+				ioDone += n;
+
+				if (ioDone < sizeof(bits))
+				{
+					waitFor(frame, fd, true);
+					break;
+				}
+
+				ioDone = 0;
+				result(0) = true;
+			}
+			else if (errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				waitFor(frame, fd, true);
+			}
+			else
+			{
+				auto error = errno;
+				ioDone = 0;
+
+				if (error != EPIPE)
+					throw std::system_error(error, std::generic_category(), "write");
+
+				result(0) = false;
+			}
+
+			break;
+		}
+
+		case SysCall::Close:
+		{
+			int fd = static_cast<int>(getInteger(arg(0)));
+
+			if (::close(fd) != 0)
+				throw systemError("close");
+
+			break;
+		}
+
+		case SysCall::Sleep:
+		{
+			// the first time through starts the timer, after that we're being retried because it expired
+			if (sleepTimer < 0)
+			{
+				Float seconds = arg(0);
+
+				if (!(seconds > 0))
+					break;
+
+				sleepTimer = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+				if (sleepTimer < 0)
+					throw systemError("timerfd_create");
+
+				itimerspec spec{};
+				spec.it_value.tv_sec = static_cast<time_t>(seconds);
+				spec.it_value.tv_nsec = static_cast<long>((seconds - std::floor(seconds)) * 1e9);
+
+				// less than a nanosecond would disarm the timer
+				if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+					spec.it_value.tv_nsec = 1;
+
+				if (::timerfd_settime(sleepTimer, 0, &spec, nullptr) != 0)
+				{
+					cancelSleep();
+					throw systemError("timerfd_settime");
+				}
+			}
+
+			std::uint64_t expirations = 0;
+
+			if (::read(sleepTimer, &expirations, sizeof(expirations)) == sizeof(expirations))
+				cancelSleep();
+			else
+				waitFor(frame, sleepTimer, false);
+
+			break;
+		}
+
+		default:
+			// ignore unknown syscall ids for now
+			break;
+		}
+	}
+
+	void VM::waitFor(Frame& frame, int fd, bool write)
+	{
+		// run the syscall again once we're ready
+		frame.jump(frame.index() - 1);
+
+		if (eventLoop)
+		{
+			// parking the call stack makes the run loop return
+			waitFd = fd;
+			waitWrite = write;
+			std::swap(callStack, parked);
+		}
+		else
+		{
+			pollfd p{ fd, static_cast<short>(write ? POLLOUT : POLLIN), 0 };
+
+			if (::poll(&p, 1, -1) < 0 && errno != EINTR)
+				throw systemError("poll");
+		}
+	}
+
+	void VM::cancelSleep()
+	{
+		if (sleepTimer >= 0)
+		{
+			::close(sleepTimer);
+			sleepTimer = -1;
+		}
+	}
+#else
+	void VM::sysCall(SysCall call, std::int64_t nargs, std::int64_t argIdx, Frame& frame)
+	{
+		if (channelCall(call, nargs, argIdx, frame))
+			return;
+
+		switch (call)
+		{
+		case SysCall::Pipe:
+		case SysCall::SocketPair:
+		case SysCall::Open:
+		case SysCall::Read:
+		case SysCall::Write:
+		case SysCall::Close:
+		case SysCall::Sleep:
+			throw std::runtime_error("I/O syscalls are not supported on this platform");
+
+		default:
+			// ignore unknown syscall ids for now
+			break;
+		}
+	}
+
+	void VM::waitFor(Frame&, int, bool)
+	{}
+
+	void VM::cancelSleep()
+	{}
+#endif
+}
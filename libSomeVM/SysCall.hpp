@@ -4,8 +4,53 @@
 
 namespace svm
 {
+	/*
+		Arguments are read from the registers starting at the syscall's argument index, and results
+		are written back over them. File descriptors are integers, like function indices.
+
+		I/O is framed as Values, not bytes: every Write sends exactly the 8 raw bytes of one Value (its bits,
+		in the machine's byte order), and every Read takes exactly 8 bytes and gives them back as one Value.
+		There's no length, and no way to move fewer bytes, so only files written by Write (or in the same
+		framing) read back as anything meaningful, and Array values (which are pointers) mean nothing once read.
+		A file whose size isn't a multiple of 8 ends in a partial value, which Read drops at the end of the file.
+
+		Descriptors made by Pipe, SocketPair and Open are non-blocking: a syscall that would block waits
+		until the descriptor is ready, suspending just this VM when it's run by an EventLoop (which then
+		watches the descriptor for it). Regular files never block, so they're always read and written directly.
+		A value split over several reads or writes (as sockets may) is put back together before Read returns.
+		Writes to sockets never raise SIGPIPE, but writes to a pipe whose read end is closed do: embedders
+		using pipes should ignore it (std::signal(SIGPIPE, SIG_IGN)), for Write to return false instead.
+		Linux only, elsewhere I/O syscalls throw.
+
+		Channels (see Channel) work everywhere. A Send/Recv that can't go through yet parks this VM when it's run
+		by an EventLoop, or is a Scheduler's task, until the channel might be ready. Any other VM blocks, running
+		queued tasks in the meantime if it has a Scheduler.
+	*/
 	enum class SysCall : std::int64_t
 	{
-		Print = 0,
+		Print = 0,	// args: values, written to stdout on one line, separated by spaces
+		Pipe,		// results: read end, write end
+		SocketPair,	// Unix stream sockets. results: one end, other end
+		Read,		// args: fd. results: value, false if at end of file
+		Write,		// args: fd, value. results: false if the other end is closed
+		Close,		// args: fd
+		Sleep,		// args: seconds
+
+		NewChannel,		// args: capacity, true if it may have more than one sender or receiver. results: channel (freed with the last copy)
+		Send,			// args: channel, value (moved, leaving Nil). results: false if the channel is closed
+		Recv,			// args: channel. results: value, false if the channel is closed and empty
+		CloseChannel,	// args: channel
+
+		Open,		// args: path (an array of 1 byte elements, ie: a string constant), OpenFlag's or'd together. results: fd
+	};
+
+	// for Open, as integers. Neither Read nor Write opens for reading
+	enum class OpenFlag : std::int64_t
+	{
+		Read = 1,
+		Write = 2,
+		Create = 4,		// if it doesn't exist, readable and writable by everyone (less the umask)
+		Truncate = 8,
+		Append = 16,
 	};
 }
@@ -0,0 +1,196 @@
+#include "Trace.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#define SVM_TRACE_SIGNAL
+#endif
+
+namespace
+{
+	using namespace svm;
+
+	const char MAGIC[8] = { 'S', 'V', 'M', 'T', 'R', 'A', 'C', 'E' };
+
+	// the signal handler has nowhere else to look
+	constexpr std::size_t MAX_DUMPED = 64;
+	std::atomic<Trace*> dumped[MAX_DUMPED];
+
+	Trace::Entry unpack(std::uint64_t packed)
+	{
+		return { packed >> 40, packed >> 8 & 0xffffffff, static_cast<Instruction::Type>(packed & 0xff) };
+	}
+
+	std::uint64_t roundUp(std::uint64_t capacity)
+	{
+		std::uint64_t size = 1;
+		while (size < capacity)
+			size <<= 1;
+
+		return size;
+	}
+}
+
+namespace svm
+{
+	Trace::Trace(std::uint64_t capacity, std::string dumpFile)
+		: buffer(new std::uint64_t[roundUp(capacity)]),
+		mask(roundUp(capacity) - 1),
+		next(0),
+		dumpPath(std::move(dumpFile))
+	{
+		if (dumpPath.empty())
+			return;
+
+		for (auto& slot : dumped)
+		{
+			Trace* expected = nullptr;
+			if (slot.compare_exchange_strong(expected, this))
+				break;
+		}
+	}
+
+	Trace::~Trace()
+	{
+		for (auto& slot : dumped)
+		{
+			Trace* expected = this;
+			slot.compare_exchange_strong(expected, nullptr);
+		}
+	}
+
+	std::vector<Trace::Entry> Trace::entries() const
+	{
+		auto entries = window();
+
+		std::vector<Entry> ret;
+		ret.reserve(entries.size);
+
+		for (auto i = entries.first; i < entries.first + entries.size; ++i)
+			ret.push_back(unpack(buffer[i & mask]));
+
+		return ret;
+	}
+
+	void Trace::write(std::ostream& output) const
+	{
+		auto entries = window();
+		std::uint64_t count = entries.size;
+
+		output.write(MAGIC, sizeof(MAGIC));
+		output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+		for (auto i = entries.first; i < entries.first + count; ++i)
+			output.write(reinterpret_cast<const char*>(&buffer[i & mask]), sizeof(std::uint64_t));
+	}
+
+	void Trace::dump() const
+	{
+		if (dumpPath.empty())
+			return;
+
+		std::ofstream fout{ dumpPath, std::ios::binary };
+
+		if (!fout)
+			throw std::runtime_error("Unable to open trace dump file: " + dumpPath);
+
+		write(fout);
+	}
+
+	const std::string& Trace::file() const
+	{
+		return dumpPath;
+	}
+
+	std::vector<Trace::Entry> Trace::read(std::istream& input)
+	{
+		char magic[sizeof(MAGIC)];
+		std::uint64_t count = 0;
+
+		input.read(magic, sizeof(magic));
+		input.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+		if (!input || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+			throw std::runtime_error("Not a trace file");
+
+		std::vector<Entry> ret;
+
+		std::uint64_t packed;
+		while (ret.size() < count && input.read(reinterpret_cast<char*>(&packed), sizeof(packed)))
+			ret.push_back(unpack(packed));
+
+		if (ret.size() != count)
+			throw std::runtime_error("Trace file is truncated");
+
+		return ret;
+	}
+
+	Trace::Window Trace::window() const
+	{
+		auto n = next.load(std::memory_order_relaxed);
+		auto count = n < mask + 1 ? n : mask + 1;
+
+		return{ n - count, count };
+	}
+
+#ifdef SVM_TRACE_SIGNAL
+	void Trace::dumpOnSignal(int signal)
+	{
+		struct sigaction action{};
+		action.sa_handler = &Trace::onSignal;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		sigaction(signal, &action, nullptr);
+	}
+
+	void Trace::onSignal(int)
+	{
+		// only async-signal-safe calls in here. The VM may still be running, so the oldest entries may be overwritten as we go
+		auto savedErrno = errno;
+
+		for (auto& slot : dumped)
+		{
+			auto* trace = slot.load();
+			if (!trace)
+				continue;
+
+			int fd = ::open(trace->dumpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (fd < 0)
+				continue;
+
+			auto entries = trace->window();
+			std::uint64_t start = entries.first;
+			std::uint64_t count = entries.size;
+			bool ok = ::write(fd, MAGIC, sizeof(MAGIC)) == sizeof(MAGIC) && ::write(fd, &count, sizeof(count)) == sizeof(count);
+
+			// in at most 2 pieces, either side of the end of the buffer
+			for (std::uint64_t done = 0; ok && done < count;)
+			{
+				auto pos = (start + done) & trace->mask;
+				auto len = std::min(count - done, trace->mask + 1 - pos);
+				auto bytes = static_cast<ssize_t>(len * sizeof(std::uint64_t));
+
+				ok = ::write(fd, &trace->buffer[pos], bytes) == bytes;
+				done += len;
+			}
+
+			::close(fd);
+		}
+
+		errno = savedErrno;
+	}
+#else
+	void Trace::dumpOnSignal(int)
+	{}
+
+	void Trace::onSignal(int)
+	{}
+#endif
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+#include "Instruction.hpp"
+
+namespace svm
+{
+	/*
+		The last instructions a VM ran (see VM::setTrace): which function, where in it, and what type.
+		Each one is packed into 8 bytes of a ring buffer, function indices past 24 bits are cut short.
+
+		The dump file is written by dump(), when the VM throws, and when the signal given to
+		dumpOnSignal() is raised (from the signal handler, so even a VM stuck in a loop can be looked at).
+		Up to 64 traces with dump files can be dumped by the signal at once.
+
+		File format, in host byte order:
+			8 bytes: "SVMTRACE"
+			8 bytes: number of entries
+			8 bytes each: an entry, oldest first, function << 40 | offset << 8 | type
+		SomeLang --trace <file> prints one.
+	*/
+	class Trace
+	{
+	public:
+		struct Entry
+		{
+			std::uint64_t function;
+			std::uint64_t offset;
+			Instruction::Type type;
+		};
+
+		// 'capacity' is rounded up to a power of 2
+		explicit Trace(std::uint64_t capacity = 1 << 16, std::string dumpFile = "");
+
+		Trace(const Trace&) = delete;
+		Trace& operator=(const Trace&) = delete;
+
+		~Trace();
+
+		void record(std::uint64_t function, std::uint64_t offset, Instruction::Type type)
+		{
+			auto n = next.load(std::memory_order_relaxed);
+
+			buffer[n & mask] = function << 40 | (offset & 0xffffffff) << 8 | static_cast<std::uint8_t>(type);
+			next.store(n + 1, std::memory_order_relaxed);
+		}
+
+		// oldest first
+		std::vector<Entry> entries() const;
+
+		void write(std::ostream& output) const;
+
+		// writes to the dump file, if there is one
+		void dump() const;
+
+		const std::string& file() const;
+
+		static std::vector<Entry> read(std::istream& input);
+
+		// dumps every trace with a dump file whenever 'signal' is raised. POSIX only, elsewhere it does nothing
+		static void dumpOnSignal(int signal);
+
+	private:
+		static void onSignal(int);
+
+		// the oldest entry, and the number of them, as of one read of 'next' (which the VM may be moving on)
+		struct Window
+		{
+			std::uint64_t first;
+			std::uint64_t size;
+		};
+
+		Window window() const;
+
+		std::unique_ptr<std::uint64_t[]> buffer;
+		std::uint64_t mask;
+		std::atomic<std::uint64_t> next;
+
+		std::string dumpPath;
+	};
+}
@@ -2,15 +2,73 @@
 
 #include <iterator>
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <utility>
+#include <chrono>
+#include <iostream>
 
 #include "Program.hpp"
+#include "Module.hpp"
+#include "Snapshot.hpp"
+#include "Scheduler.hpp"
+#include "Profiler.hpp"
+#include "PerfMap.hpp"
+#include "HardwareCounters.hpp"
+#include "Trace.hpp"
+#include "Metrics.hpp"
 #include "SysCall.hpp"
+#include "Probes.hpp"
 
 namespace
 {
-	using namespace svm;
+	std::uint64_t nanoseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
 
-	int64_t getInteger(Float f)
+	// arrays are printed as strings, only debug builds know what anything else is, otherwise it's printed as a number
+	void print(std::ostream& output, const svm::Value& value)
+	{
+		if (value.isArray())
+		{
+			auto str = value.arrayView();
+			output.write(static_cast<const char*>(str.data), str.length * str.elementSize);
+			return;
+		}
+
+#ifdef DEBUG
+		switch (value.type())
+		{
+		case svm::Type::Nil:
+			output << "nil";
+			return;
+
+		case svm::Type::Bool:
+			output << (static_cast<svm::Bool>(value) ? "true" : "false");
+			return;
+
+		default:
+			break;
+		}
+#endif
+		auto bits = value.bits();
+
+		svm::Float f;
+		std::memcpy(&f, &bits, sizeof(f));
+
+		// enough digits to tell results apart, without every double's noise in the last digits
+		auto precision = output.precision(15);
+		output << f;
+		output.precision(precision);
+	}
+}
+
+namespace svm
+{
+	std::int64_t VM::getInteger(Float f)
 	{
 		constexpr uint64_t VALUE_MASK = 0x000fffffffffffffu;
         constexpr uint64_t SIGN_BIT = 1ull << 63;
@@ -22,41 +80,540 @@ namespace
 
 		return (ir & VALUE_MASK) * (sign ? -1 : 1);
 	}
-}
 
-namespace svm
-{
-	VM::VM(std::uint64_t initialRegistrySize)
-		: registry(initialRegistrySize),
-		nextFree(registry.begin())
+	Float VM::fromInteger(std::uint64_t i)
+	{
+		constexpr uint64_t VALUE_MASK = 0x000fffffffffffffu;
+		constexpr uint64_t EXPONENT_ONE = 0x3ff0000000000000u;
+
+		std::uint64_t bits = EXPONENT_ONE | (i & VALUE_MASK);
+
+		Float f;
+		std::memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	VM::VM(std::uint64_t initialRegistrySize, Dispatch dispatch)
+		: dispatch(dispatch),
+		registry(initialRegistrySize),
+		nextFree(registry.begin()),
+		currentCoroutine(NO_COROUTINE),
+		eventLoop(nullptr),
+		profiler(nullptr),
+		lastTick(0),
+		trace(nullptr),
+		perfMap(nullptr),
+		hardwareCounters(nullptr),
+		metrics(nullptr),
+		instructionsRun(0),
+		arraysBefore{ 0, 0 },
+		runStart(0),
+		pausedAtTrap(false),
+		waitFd(-1),
+		waitWrite(false),
+		sleepTimer(-1),
+		ioPartial{},
+		ioDone(0),
+		taskScheduler(nullptr),
+		numWorkers(std::max(std::thread::hardware_concurrency(), 1u)),
+		isTask(false)
 	{}
 
+	VM::~VM()
+	{
+		cancelWait();
+	}
+
 	void VM::load(const Program& program)
 	{
-		// make sure we only need to do 1 allocation while inserting
-		constants.reserve(constants.size() + program.constants.size());
-		std::copy(program.constants.begin(), program.constants.end(), std::back_inserter(constants));
+		if (!SVM_PROBE_ENABLED(program__load))
+		{
+			install(std::make_shared<const Module>(program), 0);
+			return;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		auto loaded = std::make_shared<const Module>(program);
+		std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+
+		install(std::move(loaded), elapsed.count());
+	}
+
+	void VM::load(std::shared_ptr<const Module> module)
+	{
+		install(std::move(module), 0);
+	}
+
+	void VM::install(std::shared_ptr<const Module> module, std::uint64_t loadTime)
+	{
+		if (!callStack.empty())
+			throw std::logic_error("Can't load a program while running");
+
+		this->module = std::move(module);
+		taskModule = this->module;
+
+		SVM_PROBE3(program__load, this->module->numFunctions(), this->module->constants().size(), loadTime);
+	}
+
+	void VM::snapshot(std::ostream& output)
+	{
+		if (coroutines.size() != freeCoroutines.size())
+			throw std::logic_error("Can't snapshot while coroutines are suspended");
+
+		module->loadAll();
+		Snapshot::write(output, module->constants(), registry, std::distance(registry.begin(), nextFree), module->functions());
+	}
+
+	void VM::restore(std::shared_ptr<const Snapshot> snapshot)
+	{
+		if (!callStack.empty())
+			throw std::logic_error("Can't restore a snapshot while running");
 
-		// make sure we only need to do 1 allocation while inserting
-		functions.reserve(functions.size() + program.functions.size());
-		std::copy(program.functions.begin(), program.functions.end(), std::back_inserter(functions));
+		std::vector<Value> constants;
+		constants.reserve(snapshot->numConstants());
+
+		for (std::uint64_t i = 0; i < snapshot->numConstants(); ++i)
+			constants.push_back(snapshot->constant(i));
+
+		auto source = std::make_shared<BytecodeSource>(Snapshot::stream(snapshot));
+
+		std::vector<Function> functions;
+		functions.reserve(snapshot->numFunctions());
+
+		for (std::uint64_t i = 0; i < snapshot->numFunctions(); ++i)
+		{
+			auto f = snapshot->function(i);
+			functions.emplace_back(f.nrets, f.nargs, f.length, source, f.offset, f.length * sizeof(Instruction), Encoding::Fixed);
+		}
+
+		module = std::make_shared<const Module>(std::move(constants), std::move(functions));
+		taskModule = module;
+
+		registry.clear();
+		registry.reserve(snapshot->numRegisters());
+
+		for (std::uint64_t i = 0; i < snapshot->numRegisters(); ++i)
+			registry.push_back(snapshot->registry(i));
+
+		nextFree = registry.begin() + std::min(snapshot->nextFree(), registry.size());
 	}
 
 	void VM::run()
 	{
-		callStack.emplace(functions.front(), 0, 0);
+		if (!metrics)
+		{
+			execute(0);
+			return;
+		}
+
+		runStart = nanoseconds();
 
-		while (!callStack.empty())
+		try
+		{
+			execute(0);
+		}
+		catch (...)
+		{
+			finishRun(true);
+			throw;
+		}
+
+		// otherwise it's only done once resumeRun() gets it there
+		if (!waiting() && !paused())
+			finishRun(false);
+	}
+
+	void VM::finishRun(bool failed)
+	{
+		metrics->recordRun(nanoseconds() - runStart, failed);
+
+		// whatever didn't return never will
+		watchedCalls.clear();
+	}
+
+	void VM::finishCalls()
+	{
+		auto now = nanoseconds();
+
+		for (auto it = watchedCalls.begin(); it != watchedCalls.end();)
+		{
+			if (it->coroutine == currentCoroutine && it->depth > callStack.size())
+			{
+				metrics->recordCall(it->function, now - it->start);
+				it = watchedCalls.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	void VM::execute(std::uint64_t functionIndex)
+	{
+		if (!module || functionIndex >= module->numFunctions())
+			throw std::logic_error("No program loaded");
+
+		if (waiting() || paused())
+			throw std::logic_error("Attempt to run a VM that is waiting on I/O, or paused");
+
+		callStack.emplace(module->function(functionIndex), prepare(functionIndex), functionIndex, 0);
+		SVM_PROBE3(function__entry, functionIndex, callStack.size(), 0);
+
+		interpretAll();
+	}
+
+	bool VM::waiting() const
+	{
+		return waitFd >= 0 || waitChannel.object();
+	}
+
+	bool VM::paused() const
+	{
+		return pausedAtTrap;
+	}
+
+	void VM::resumeRun()
+	{
+		if (!waiting() && !paused())
+			throw std::logic_error("Attempt to resume a VM that isn't waiting or paused");
+
+		std::swap(callStack, parked);
+		waitFd = -1;
+		waitChannel = Value{};
+		channelWaiter.reset();
+		pausedAtTrap = false;
+
+		if (!metrics)
+		{
+			interpretAll();
+			return;
+		}
+
+		try
+		{
+			interpretAll();
+		}
+		catch (...)
+		{
+			finishRun(true);
+			throw;
+		}
+
+		if (!waiting() && !paused())
+			finishRun(false);
+	}
+
+	void VM::step()
+	{
+		if (!paused())
+			throw std::logic_error("Attempt to step a VM that isn't paused");
+
+		std::swap(callStack, parked);
+		pausedAtTrap = false;
+
+		if (!callStack.empty() || unwind())
 		{
 			Frame& frame = callStack.top();
 
-			if (!frame.complete())
-				interpret(*frame.next(), frame);
+			if (dispatch == Dispatch::Decoded)
+			{
+				interpret(frame.nextDecoded(), frame);
+			}
 			else
-				callStack.pop();
+			{
+				auto idx = frame.index();
+				interpret(predecode(*frame.next(), idx, module->constants()), frame);
+			}
+		}
+
+		// returns (and finished coroutines) are part of the step that led to them
+		while (!paused() && !waiting())
+		{
+			if (callStack.empty())
+			{
+				if (!unwind())
+					return;
+			}
+			else if (callStack.top().complete())
+			{
+				popFrame();
+			}
+			else
+			{
+				std::swap(callStack, parked);
+				pausedAtTrap = true;
+				return;
+			}
+		}
+	}
+
+	void VM::interpretAll()
+	{
+		if (profiler || trace || perfMap || hardwareCounters || metrics)
+		{
+			interpretHooked();
+			return;
+		}
+
+		if (dispatch == Dispatch::Decoded)
+		{
+			while (!callStack.empty() || unwind())
+			{
+				Frame& frame = callStack.top();
+
+				if (!frame.complete())
+					interpret(frame.nextDecoded(), frame);
+				else
+					popFrame();
+			}
+		}
+		else
+		{
+			auto& constants = module->constants();
+
+			while (!callStack.empty() || unwind())
+			{
+				Frame& frame = callStack.top();
+
+				if (!frame.complete())
+				{
+					auto idx = frame.index();
+					interpret(predecode(*frame.next(), idx, constants), frame);
+				}
+				else
+				{
+					popFrame();
+				}
+			}
 		}
 	}
 
+	void VM::interpretHooked()
+	{
+		const Frame* running = nullptr;
+		instructionsRun = 0;
+		arraysBefore = Value::allocated();
+
+		try
+		{
+			while (!callStack.empty() || unwind())
+			{
+				Frame& frame = callStack.top();
+
+				if (&frame != running)
+				{
+					running = &frame;
+
+					// a frame that hasn't run anything yet was just called, rather than returned to
+					bool called = frame.index() == 0;
+
+					if (hardwareCounters)
+						hardwareCounters->update(callStack, called);
+
+					if (metrics && called && metrics->watching(frame.functionIndex))
+						watchedCalls.push_back({ currentCoroutine, callStack.size(), frame.functionIndex, nanoseconds() });
+				}
+
+				auto depth = callStack.size();
+
+				if (frame.complete())
+				{
+					popFrame();
+				}
+				else if (perfMap)
+				{
+					// runs until something else is on top, so the hooks above still see every change
+					auto function = frame.functionIndex;
+
+					// asking the map takes its lock, so each is only asked for once
+					if (function >= trampolines.size())
+						trampolines.resize(function + 1, nullptr);
+
+					if (!trampolines[function])
+						trampolines[function] = perfMap->trampoline(function);
+
+					trampolines[function](this, &frame, &VM::runFrame);
+
+					if (perfError)
+						std::rethrow_exception(std::exchange(perfError, nullptr));
+				}
+				else
+				{
+					runInstruction(frame);
+				}
+
+				if (callStack.size() < depth && !watchedCalls.empty())
+					finishCalls();
+			}
+		}
+		catch (...)
+		{
+			// the error that got us here matters more than not being able to write the dump
+			if (trace)
+			{
+				try
+				{
+					trace->dump();
+				}
+				catch (...)
+				{}
+			}
+
+			finishHooks();
+			throw;
+		}
+
+		finishHooks();
+	}
+
+	void VM::runInstruction(Frame& frame)
+	{
+		if (profiler)
+		{
+			auto tick = profiler->tick();
+
+			if (tick != lastTick)
+			{
+				lastTick = tick;
+				profiler->record(callStack);
+			}
+		}
+
+		auto idx = frame.index();
+		auto instr = dispatch == Dispatch::Decoded ? frame.nextDecoded() : predecode(*frame.next(), idx, module->constants());
+
+		if (trace)
+			trace->record(frame.functionIndex, idx, instr.type);
+
+		++instructionsRun;
+		interpret(instr, frame);
+	}
+
+	void VM::finishHooks()
+	{
+		// what ran up to an error still counts
+		if (hardwareCounters)
+			hardwareCounters->finish();
+
+		if (metrics)
+		{
+			metrics->recordInstructions(std::exchange(instructionsRun, 0));
+
+			// arrays aren't made by any one instruction, but by whatever allocates them on this thread meanwhile
+			auto arrays = Value::allocated();
+
+			if (arrays.count != arraysBefore.count)
+				metrics->recordAllocation(arrays.bytes - arraysBefore.bytes, arrays.count - arraysBefore.count);
+
+			arraysBefore = arrays;
+		}
+	}
+
+	void VM::runFrame(void* vm, void* frame)
+	{
+		auto& self = *static_cast<VM*>(vm);
+		auto& current = *static_cast<Frame*>(frame);
+
+		try
+		{
+			// a Call, Ret, coroutine switch, or parking on I/O all leave something else on top (or nothing)
+			// 'current' may be gone by then, so that's checked first
+			do
+			{
+				self.runInstruction(current);
+			}
+			while (!self.callStack.empty() && &self.callStack.top() == &current && !current.complete());
+		}
+		catch (...)
+		{
+			self.perfError = std::current_exception();
+		}
+	}
+
+	void VM::reset()
+	{
+		// the root is always the one at the bottom
+		if (currentCoroutine != NO_COROUTINE)
+		{
+			auto* root = &coroutines[currentCoroutine];
+			while (root->resumer != NO_COROUTINE)
+				root = &coroutines[root->resumer];
+
+			switchTo(*root);
+			currentCoroutine = NO_COROUTINE;
+		}
+
+		coroutines.clear();
+		freeCoroutines.clear();
+
+		callStack = {};
+		parked = {};
+		watchedCalls.clear();
+		pausedAtTrap = false;
+		waitFd = -1;
+		ioDone = 0;
+		cancelWait();
+		cancelSleep();
+
+		std::fill(registry.begin(), registry.end(), Value{});
+		nextFree = registry.begin();
+	}
+
+	void VM::setWorkers(std::uint64_t numWorkers)
+	{
+		this->numWorkers = std::max<std::uint64_t>(numWorkers, 1);
+	}
+
+	const Scheduler* VM::scheduler() const
+	{
+		return taskScheduler;
+	}
+
+	Counters& VM::counters()
+	{
+		return instructionCounts;
+	}
+
+	void VM::setTrace(Trace* trace)
+	{
+		this->trace = trace;
+	}
+
+	void VM::setHardwareCounters(HardwareCounters* counters)
+	{
+		hardwareCounters = counters;
+	}
+
+	void VM::setMetrics(Metrics* metrics)
+	{
+		this->metrics = metrics;
+		watchedCalls.clear();
+	}
+
+	void VM::setPerfMap(PerfMap* perfMap)
+	{
+		this->perfMap = perfMap;
+		trampolines.clear();
+	}
+
+	void VM::setProfiler(Profiler* profiler)
+	{
+		this->profiler = profiler;
+		lastTick = profiler ? profiler->tick() : 0;
+	}
+
+	Scheduler& VM::tasks()
+	{
+		if (!taskScheduler)
+		{
+			ownedScheduler = std::make_shared<Scheduler>(numWorkers);
+			taskScheduler = ownedScheduler.get();
+		}
+
+		return *taskScheduler;
+	}
+
 	std::uint64_t VM::callStackSize() const
 	{
 		return callStack.size();
@@ -90,342 +647,576 @@ namespace svm
 		return registry.at(idx);
 	}
 
-	void VM::interpret(Instruction instr, Frame& frame)
+	void VM::switchTo(Coroutine& coroutine)
+	{
+		// vectors and deques keep their elements when swapped, so 'nextFree' and any Frame references stay valid
+		std::swap(registry, coroutine.registry);
+		std::swap(nextFree, coroutine.nextFree);
+		std::swap(callStack, coroutine.callStack);
+	}
+
+	void VM::resume(std::uint64_t idx, std::uint64_t aliveDest, std::uint64_t valuesDest)
+	{
+		auto& coroutine = coroutines.at(idx);
+
+		if (coroutine.finished)
+		{
+			registry.at(aliveDest) = false;
+			return;
+		}
+
+		// it's running, or somewhere down the chain of resumers
+		if (coroutine.resumer != NO_COROUTINE || idx == currentCoroutine)
+			throw std::logic_error("Attempt to resume a running coroutine");
+
+		// check now, rather than once the values are yielded
+		registry.at(aliveDest);
+
+		coroutine.resumer = currentCoroutine;
+		coroutine.aliveDest = aliveDest;
+		coroutine.valuesDest = valuesDest;
+
+		switchTo(coroutine);
+		currentCoroutine = idx;
+
+		if (!coroutine.started)
+		{
+			coroutine.started = true;
+			callStack.emplace(module->function(coroutine.function), prepare(coroutine.function), coroutine.function, 0);
+			SVM_PROBE3(function__entry, coroutine.function, callStack.size(), module->function(coroutine.function).args());
+		}
+	}
+
+	void VM::yield(std::uint64_t num, std::uint64_t start)
+	{
+		if (currentCoroutine == NO_COROUTINE)
+			throw std::logic_error("Attempt to yield outside of a coroutine");
+
+		auto& coroutine = coroutines[currentCoroutine];
+
+		if (start + num > registry.size())
+			throw std::out_of_range("Yielded values out of range");
+
+		// the resumer's registry is the one stored in the coroutine while it runs
+		for (std::uint64_t i = 0; i < num; ++i)
+			coroutine.registry.at(coroutine.valuesDest + i) = registry[start + i];
+
+		coroutine.registry.at(coroutine.aliveDest) = true;
+
+		switchTo(coroutine);
+		currentCoroutine = coroutine.resumer;
+		coroutine.resumer = NO_COROUTINE;
+	}
+
+	bool VM::unwind()
+	{
+		// the call stack was parked by a syscall or breakpoint, not finished
+		if (waiting() || paused())
+			return false;
+
+		if (currentCoroutine == NO_COROUTINE)
+			return false;
+
+		auto idx = currentCoroutine;
+		auto& coroutine = coroutines[idx];
+
+		coroutine.registry.at(coroutine.aliveDest) = false;
+
+		switchTo(coroutine);
+		currentCoroutine = coroutine.resumer;
+
+		coroutine.resumer = NO_COROUTINE;
+		coroutine.finished = true;
+
+		// let go of its registry now, so finished coroutines don't pile up
+		coroutine.registry = {};
+		coroutine.callStack = {};
+		freeCoroutines.push_back(idx);
+
+		return true;
+	}
+
+	const DecodedBytecode* VM::prepare(std::uint64_t functionIndex)
+	{
+		// functions are only read in (and decoded) the first time any VM calls them
+		if (dispatch != Dispatch::Decoded)
+		{
+			module->function(functionIndex);
+			return nullptr;
+		}
+
+		return &module->decoded(functionIndex);
+	}
+
+	DecodedInstruction VM::predecode(Instruction instr, std::uint64_t index, const std::vector<Value>& constants)
+	{
+		// out of range targets stay out of range (but fit in 32 bits), so taking the jump still throws
+		constexpr std::uint32_t BAD_TARGET = std::numeric_limits<std::uint32_t>::max();
+
+		auto constantTarget = [&](std::uint64_t constIdx, std::int64_t base) -> std::uint32_t
+		{
+			if (constIdx >= constants.size())
+				return BAD_TARGET;
+
+			auto target = static_cast<std::uint64_t>(base + getInteger(constants[constIdx]));
+			return target < BAD_TARGET ? static_cast<std::uint32_t>(target) : BAD_TARGET;
+		};
+
+		// relative jumps are relative to the instruction after them
+		auto next = static_cast<std::int64_t>(index + 1);
+
+		DecodedInstruction ret{ instr.type(), 0, 0, 0 };
+
+		switch (ret.type)
+		{
+		case Instruction::Type::JmpT:
+		case Instruction::Type::JmpF:
+		case Instruction::Type::JmpTC:
+		case Instruction::Type::JmpFC:
+			ret.one = instr.arg1_24();
+			ret.two = constantTarget(instr.arg2_32(), 0);
+			break;
+
+		case Instruction::Type::RJmpT:
+		case Instruction::Type::RJmpF:
+		case Instruction::Type::RJmpTC:
+		case Instruction::Type::RJmpFC:
+			ret.one = instr.arg1_24();
+			ret.two = constantTarget(instr.arg2_32(), next);
+			break;
+
+		case Instruction::Type::JmpC:
+			ret.one = constantTarget(instr.arg1_56(), 0);
+			break;
+
+		case Instruction::Type::RJmpC:
+			ret.one = constantTarget(instr.arg1_56(), next);
+			break;
+
+		case Instruction::Type::Jmp:
+		case Instruction::Type::RJmp:
+			// a registry index that doesn't fit still needs to be out of range
+			ret.one = static_cast<std::uint32_t>(std::min<std::uint64_t>(instr.arg1_56(), BAD_TARGET));
+			break;
+
+		case Instruction::Type::Load:
+		case Instruction::Type::LoadC:
+		case Instruction::Type::Not:
+		case Instruction::Type::Ret:
+		case Instruction::Type::Join:
+		case Instruction::Type::Yield:
+			ret.one = instr.arg1_24();
+			ret.two = instr.arg2_32();
+			break;
+
+		default:
+			ret.one = instr.arg1_16();
+			ret.two = instr.arg2_16();
+			ret.three = instr.arg3_16();
+			break;
+		}
+
+		return ret;
+	}
+
+	void VM::popFrame()
+	{
+		SVM_PROBE2(function__return, callStack.top().functionIndex, callStack.size());
+		callStack.pop();
+	}
+
+	void VM::interpret(const DecodedInstruction& instr, Frame& frame)
 	{
-		switch (instr.type())
+#ifdef SVM_INSTRUMENT
+		// the frame has already moved on to the next instruction
+		instructionCounts.count(instr.type, frame.functionIndex, frame.index() - 1, frame.length());
+
+		// taken now, the instruction may pop the frame
+		Counters::Scope scope(instructionCounts, frame.functionIndex);
+#endif
+
+		switch (instr.type)
 		{
 			/* memory ops */
 		case Instruction::Type::Load:
 		{
-			auto dest = instr.arg1_24();
-			auto src = instr.arg2_32();
+			auto dest = instr.one;
+			auto src = instr.two;
 			registry.at(dest) = registry.at(src);
 			break;
 		}
 
 		case Instruction::Type::LoadC:
 		{
-			auto dest = instr.arg1_24();
-			auto src = instr.arg2_32();
-			registry.at(dest) = constants.at(src);
+			auto dest = instr.one;
+			auto src = instr.two;
+			registry.at(dest) = module->constants().at(src);
 			break;
 		}
 
 		/* math ops */
 		case Instruction::Type::Add:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one + two };
+			registry.at(instr.one) = { one + two };
 			break;
 		}
 
 		case Instruction::Type::Sub:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one - two };
+			registry.at(instr.one) = { one - two };
 			break;
 		}
 
 		case Instruction::Type::Mult:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one * two };
+			registry.at(instr.one) = { one * two };
 			break;
 		}
 
 		case Instruction::Type::Div:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one / two };
+			registry.at(instr.one) = { one / two };
 			break;
 		}
 
 		case Instruction::Type::Mod:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = std::fmod(one, two);
+			registry.at(instr.one) = std::fmod(one, two);
 			break;
 		}
 
 		case Instruction::Type::Neg:
 		{
-			Float one = registry.at(instr.arg2_16());
+			Float one = registry.at(instr.two);
 
-			registry.at(instr.arg1_16()) = { -one };
+			registry.at(instr.one) = { -one };
 			break;
 		}
 
 		/* comparison ops */
 		case Instruction::Type::Lt:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one < two };
+			registry.at(instr.one) = { one < two };
 			break;
 		}
 
 		case Instruction::Type::LtEq:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one <= two };
+			registry.at(instr.one) = { one <= two };
 			break;
 		}
 
 		case Instruction::Type::Gt:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one > two };
+			registry.at(instr.one) = { one > two };
 			break;
 		}
 
 		case Instruction::Type::GtEq:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one >= two };
+			registry.at(instr.one) = { one >= two };
 			break;
 		}
 
 		case Instruction::Type::Eq:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one == two };
+			registry.at(instr.one) = { one == two };
 			break;
 		}
 
 		case Instruction::Type::Neq:
 		{
-			Float one = registry.at(instr.arg2_16());
-			Float two = registry.at(instr.arg3_16());
+			Float one = registry.at(instr.two);
+			Float two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one != two };
+			registry.at(instr.one) = { one != two };
 			break;
 		}
 
 		/* logical ops */
 		case Instruction::Type::Not:
 		{
-			Bool one = registry.at(instr.arg2_32());
+			Bool one = registry.at(instr.two);
 
-			registry.at(instr.arg1_24()) = { !one };
+			registry.at(instr.one) = { !one };
 			break;
 		}
 
 		case Instruction::Type::And:
 		{
-			Bool one = registry.at(instr.arg2_16());
-			Bool two = registry.at(instr.arg3_16());
+			Bool one = registry.at(instr.two);
+			Bool two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one && two };
+			registry.at(instr.one) = { one && two };
 			break;
 		}
 
 		case Instruction::Type::Or:
 		{
-			Bool one = registry.at(instr.arg2_16());
-			Bool two = registry.at(instr.arg3_16());
+			Bool one = registry.at(instr.two);
+			Bool two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one || two };
+			registry.at(instr.one) = { one || two };
 			break;
 		}
 
 		case Instruction::Type::Xor:
 		{
-			Bool one = registry.at(instr.arg2_16());
-			Bool two = registry.at(instr.arg3_16());
+			Bool one = registry.at(instr.two);
+			Bool two = registry.at(instr.three);
 
-			registry.at(instr.arg1_16()) = { one != two };
+			registry.at(instr.one) = { one != two };
 			break;
 		}
 
 		/* conditional branching */
+		// constant targets are already resolved to absolute indices (see DecodedInstruction)
 		case Instruction::Type::JmpT:
+		case Instruction::Type::JmpTC:
+		case Instruction::Type::RJmpT:
+		case Instruction::Type::RJmpTC:
 		{
-			Bool b = registry.at(instr.arg1_24());
-			auto idx = getInteger(constants.at(instr.arg2_32()));
+			Bool b = registry.at(instr.one);
+
+#ifdef SVM_INSTRUMENT
+			instructionCounts.branch(frame.functionIndex, frame.index() - 1, b);
+#endif
 
 			// if true, skip the next instruction (the jump to the "else")
 			if (b)
-				frame.jump(idx);
+				frame.jump(instr.two);
 
 			break;
 		}
 
 		case Instruction::Type::JmpF:
+		case Instruction::Type::JmpFC:
+		case Instruction::Type::RJmpF:
+		case Instruction::Type::RJmpFC:
 		{
-			Bool b = registry.at(instr.arg1_24());
-			auto idx = getInteger(constants.at(instr.arg2_32()));
+			Bool b = registry.at(instr.one);
+
+#ifdef SVM_INSTRUMENT
+			instructionCounts.branch(frame.functionIndex, frame.index() - 1, !b);
+#endif
 
 			// if false, skip the next instruction (the jump to the "else")
 			if (!b)
-				frame.jump(idx);
+				frame.jump(instr.two);
 
 			break;
 		}
 
-		case Instruction::Type::JmpTC:
+		/* branching */
+		case Instruction::Type::Call:
 		{
-			Bool b = registry.at(instr.arg1_24());
-			auto idx = getInteger(constants.at(instr.arg2_32()));
+			auto nargs = getInteger(registry.at(instr.one));
+			auto argIdx = getInteger(registry.at(instr.two));
+			auto funcIdx = getInteger(registry.at(instr.three));
 
-			// if true, skip the next instruction (the jump to the "else")
-			if (b)
-				frame.jump(idx);
+			const Function& callee = module->function(funcIdx);
 
-			break;
-		}
+			if (nargs != callee.args())
+				throw std::logic_error("Invalid number of arguments!");
 
-		case Instruction::Type::JmpFC:
-		{
-			Bool b = registry.at(instr.arg1_24());
-			auto idx = getInteger(constants.at(instr.arg2_32()));
+			callStack.emplace(callee, prepare(funcIdx), funcIdx, argIdx);
 
-			// if false, skip the next instruction (the jump to the "else")
-			if (!b)
-				frame.jump(idx);
+#ifdef SVM_INSTRUMENT
+			instructionCounts.call(funcIdx);
+#endif
 
+			SVM_PROBE3(function__entry, funcIdx, callStack.size(), nargs);
 			break;
 		}
 
-		case Instruction::Type::RJmpT:
+		case Instruction::Type::Spawn:
 		{
-			Bool b = registry.at(instr.arg1_24());
-			auto off = getInteger(constants.at(instr.arg2_32()));
+			auto argIdx = getInteger(registry.at(instr.two));
+			auto funcIdx = getInteger(registry.at(instr.three));
 
-			// if true, skip the next instruction (the jump to the "else")
-			if (b)
-				frame.rjump(off);
+			auto nargs = module->function(funcIdx).args();
 
+			if (argIdx < 0 || static_cast<std::uint64_t>(argIdx) + nargs > registry.size())
+				throw std::out_of_range("Spawn arguments out of range");
+
+			// arguments are copied, the task has its own registry
+			std::vector<Value> args(registry.begin() + argIdx, registry.begin() + argIdx + nargs);
+
+			if (metrics)
+				metrics->recordAllocation(registry.size() * sizeof(Value));
+
+			auto task = tasks().spawn(taskModule, funcIdx, std::move(args), registry.size(), dispatch);
+			registry.at(instr.one) = fromInteger(task);
 			break;
 		}
 
-		case Instruction::Type::RJmpF:
+		case Instruction::Type::Join:
 		{
-			Bool b = registry.at(instr.arg1_24());
-			auto off = getInteger(constants.at(instr.arg2_32()));
+			auto task = getInteger(registry.at(instr.one));
+			auto results = tasks().join(task);
 
-			// if false, skip the next instruction (the jump to the "else")
-			if (!b)
-				frame.rjump(off);
+			for (std::uint64_t i = 0; i < results.size(); ++i)
+				registry.at(instr.two + i) = results[i];
 
 			break;
 		}
 
-		case Instruction::Type::RJmpTC:
+		case Instruction::Type::Coroutine:
 		{
-			Bool b = registry.at(instr.arg1_24());
-			auto off = getInteger(constants.at(instr.arg2_32()));
+			auto argIdx = getInteger(registry.at(instr.two));
+			auto funcIdx = getInteger(registry.at(instr.three));
 
-			// if true, skip the next instruction (the jump to the "else")
-			if (b)
-				frame.rjump(off);
+			auto nargs = module->function(funcIdx).args();
+
+			if (argIdx < 0 || static_cast<std::uint64_t>(argIdx) + nargs > registry.size())
+				throw std::out_of_range("Coroutine arguments out of range");
+
+			std::uint64_t idx;
+
+			if (!freeCoroutines.empty())
+			{
+				idx = freeCoroutines.back();
+				freeCoroutines.pop_back();
+			}
+			else
+			{
+				idx = coroutines.size();
+				coroutines.emplace_back();
+			}
+
+			auto& coroutine = coroutines[idx];
 
+			// a finished coroutine's registry is reused, if it's big enough
+			if (metrics && coroutine.registry.capacity() < registry.size())
+				metrics->recordAllocation(registry.size() * sizeof(Value));
+
+			coroutine.function = funcIdx;
+			coroutine.registry.assign(registry.size(), Value{});
+			std::copy(registry.begin() + argIdx, registry.begin() + argIdx + nargs, coroutine.registry.begin());
+			coroutine.nextFree = coroutine.registry.begin();
+			coroutine.started = false;
+			coroutine.finished = false;
+			coroutine.resumer = NO_COROUTINE;
+
+			registry.at(instr.one) = fromInteger(idx);
 			break;
 		}
 
-		case Instruction::Type::RJmpFC:
+		case Instruction::Type::Resume:
 		{
-			Bool b = registry.at(instr.arg1_24());
-			auto off = getInteger(constants.at(instr.arg2_32()));
-
-			// if false, skip the next instruction (the jump to the "else")
-			if (!b)
-				frame.rjump(off);
-
+			auto idx = getInteger(registry.at(instr.two));
+			resume(idx, instr.one, instr.three);
 			break;
 		}
 
-		/* branching */
-		case Instruction::Type::Call:
+		case Instruction::Type::Trap:
 		{
-			auto nargs = getInteger(registry.at(instr.arg1_16()));
-			auto argIdx = getInteger(registry.at(instr.arg2_16()));
-			auto funcIdx = getInteger(registry.at(instr.arg3_16()));
+			// tasks run the unpatched module, so this is a Trap that never came from a Debugger
+			if (isTask)
+				throw std::runtime_error("Trap in a spawned task");
 
-			const Function& callee = functions[funcIdx];
+			// stop just before it, so the Debugger can put back the instruction it replaced, and carry on from there
+			frame.jump(frame.index() - 1);
 
-			if (nargs != callee.args())
-				throw std::logic_error("Invalid number of arguments!");
+			// parking the call stack makes the run loop return
+			std::swap(callStack, parked);
+			pausedAtTrap = true;
+			break;
+		}
 
-			callStack.emplace(callee, funcIdx, argIdx);
+		case Instruction::Type::Yield:
+		{
+			auto num = getInteger(registry.at(instr.one));
+			auto start = getInteger(registry.at(instr.two));
+			yield(num, start);
 			break;
 		}
 
 		case Instruction::Type::Ret:
 		{
 			// TODO: make work like it should
-//					auto nrets = getInteger(registry.at(instr.arg1_24()));
-//					auto retIdx = getInteger(registry.at(instr.arg2_32()));
+//					auto nrets = getInteger(registry.at(instr.one));
+//					auto retIdx = getInteger(registry.at(instr.two));
 
-			callStack.pop();
+			popFrame();
 			break;
 		}
 
 		case Instruction::Type::Jmp:
 		{
-			auto idx = getInteger(registry.at(instr.arg1_56()));
+			auto idx = getInteger(registry.at(instr.one));
 			frame.jump(idx);
 			break;
 		}
 
 		case Instruction::Type::RJmp:
 		{
-			auto off = getInteger(registry.at(instr.arg1_56()));
+			auto off = getInteger(registry.at(instr.one));
 			frame.rjump(off);
 			break;
 		}
 
 		case Instruction::Type::JmpC:
-		{
-			auto idx = getInteger(constants.at(instr.arg1_56()));
-			frame.jump(idx);
-			break;
-		}
-
 		case Instruction::Type::RJmpC:
 		{
-			auto off = getInteger(constants.at(instr.arg1_56()));
-			frame.rjump(off);
+			frame.jump(instr.one);
 			break;
 		}
 
 		case Instruction::Type::SysCall:
 		{
-			auto nargs = getInteger(registry.at(instr.arg1_16()));
-			auto argIdx = getInteger(registry.at(instr.arg2_16()));
-			auto funcIdx = static_cast<SysCall>(getInteger(registry.at(instr.arg3_16())));
+			auto nargs = getInteger(registry.at(instr.one));
+			auto argIdx = getInteger(registry.at(instr.two));
+			auto funcIdx = static_cast<SysCall>(getInteger(registry.at(instr.three)));
 
 			switch (funcIdx)
 			{
 			case SysCall::Print:
-                for (; argIdx < argIdx + nargs; ++argIdx)
-                {
-                    //auto& s = registry.at(argIdx);
-                    //auto& v = registry.at(++argIdx);
-                    //std::printf(s, v);
-                }
+			{
+				for (std::int64_t i = 0; i < nargs; ++i)
+				{
+					if (i != 0)
+						std::cout << ' ';
+
+					print(std::cout, registry.at(argIdx + i));
+				}
+
+				std::cout << '\n';
 				break;
+			}
 
 			default:
-				// ignore unknown syscall ids for now
+				sysCall(funcIdx, nargs, argIdx, frame);
 				break;
 			}
 
@@ -1,18 +1,46 @@
 #pragma once
 
 #include <stack>
+#include <deque>
+#include <limits>
+#include <iosfwd>
+#include <memory>
+#include <exception>
+#include <functional>
 
 #include "Frame.hpp"
 #include "Registry.hpp"
+#include "SysCall.hpp"
+#include "Channel.hpp"
+#include "PerfMap.hpp"
+#include "Counters.hpp"
 
 namespace svm
 {
 	struct Program;
+	class Module;
+	class Snapshot;
+	class Scheduler;
+	class EventLoop;
+	class Profiler;
+	class HardwareCounters;
+	class Trace;
+	class Metrics;
 
 	class VM
 	{
 	public:
-		VM(std::uint64_t initialRegistrySize = 256);
+		// how instructions are fed to the interpreter
+		enum class Dispatch
+		{
+			// each instruction's arguments are unpacked as it's executed
+			Packed,
+
+			// each function is unpacked once, when first called (see DecodedInstruction)
+			Decoded,
+		};
+
+		VM(std::uint64_t initialRegistrySize = 256, Dispatch dispatch = Dispatch::Decoded);
 
         VM(VM&&) = default;
         VM& operator=(VM&&) = default;
@@ -20,12 +48,70 @@ namespace svm
         VM(const VM&) = delete;
         VM& operator=(const VM&) = delete;
 
-		~VM() = default;
+		// stops waiting on a channel, if we were
+		~VM();
 
+		// replaces any loaded program
 		void load(const Program& program);
 
+		// runs 'module' without copying it, it may be shared with other VMs (even on other threads)
+		void load(std::shared_ptr<const Module> module);
+
+		// writes everything needed to restore this VM as it is now (see Snapshot)
+		// any functions not loaded yet are loaded first
+		void snapshot(std::ostream& output);
+
+		// replaces the loaded program and the registry with that of the snapshot
+		// function bytecode is read from the snapshot as it's called, so it's kept alive until then
+		void restore(std::shared_ptr<const Snapshot> snapshot);
+
 		void run();
 
+		// true if run() returned early, because a syscall would have blocked (only when run by an EventLoop,
+		// or as a Scheduler's task)
+		bool waiting() const;
+
+		// true if run() returned at a breakpoint, or after a step (see Debugger)
+		bool paused() const;
+
+		// carries on with a run() that returned waiting, or paused
+		void resumeRun();
+
+		// clears the registry (keeping its size) and call stack, so the loaded program can be run fresh
+		void reset();
+
+		// threads that Spawn'd tasks run on, counting the one calling run(). Defaults to one per core
+		// only takes effect before the first Spawn
+		void setWorkers(std::uint64_t numWorkers);
+
+		// null until the program first uses Spawn
+		const Scheduler* scheduler() const;
+
+		// samples our call stack whenever 'profiler' ticks. Null to stop. Not passed on to spawned tasks
+		void setProfiler(Profiler* profiler);
+
+		// runs each function through its trampoline from 'perfMap', so perf can tell them apart. Null to stop
+		// not passed on to spawned tasks
+		void setPerfMap(PerfMap* perfMap);
+
+		// reads 'counters' whenever the running function changes, they must have been created on the thread running us
+		// null to stop. Not passed on to spawned tasks
+		void setHardwareCounters(HardwareCounters* counters);
+
+		// records each instruction run into 'trace', dumping it if running throws. Null to stop. Not passed on to spawned tasks
+		void setTrace(Trace* trace);
+
+		// times each run(), and calls to the functions 'metrics' watches, and counts instructions and allocations into it
+		// null to stop. Not passed on to spawned tasks
+		void setMetrics(Metrics* metrics);
+
+		// everything this VM has run (not its spawned tasks), kept across runs until cleared
+		// always there, so the VM is the same whatever the build, but only counted into with SVM_INSTRUMENT
+		Counters& counters();
+
+		// 'index' is the instruction's position in its function, needed for resolving relative jumps
+		static DecodedInstruction predecode(Instruction instr, std::uint64_t index, const std::vector<Value>& constants);
+
 		std::uint64_t callStackSize() const;
 		std::uint64_t registrySize() const;
 
@@ -39,15 +125,184 @@ namespace svm
 		Value read(std::uint64_t idx) const;
 
 	private:
-		void interpret(Instruction instr, Frame& frame);
+		friend class Scheduler;
+		friend class EventLoop;
+		friend class Debugger;
+
+		// integers (indices, file descriptors...) are stored in a Float's mantissa, with an exponent of +1
+		static std::int64_t getInteger(Float f);
+		static Float fromInteger(std::uint64_t i);
+
+		// both load()s, 'loadTime' is how long making 'module' took (in nanoseconds), for the program__load probe
+		void install(std::shared_ptr<const Module> module, std::uint64_t loadTime);
+
+		// runs until 'functionIndex' returns
+		void execute(std::uint64_t functionIndex);
+
+		// runs the call stack until it's empty, or parked by a syscall or breakpoint
+		void interpretAll();
+
+		// interpretAll() with whichever of the profiler, trace, perf map, hardware counters and metrics are set
+		void interpretHooked();
+
+		// the next instruction of 'frame', and the per instruction hooks
+		void runInstruction(Frame& frame);
+
+		// reads the hardware counters, and records the instructions run, at the end of a hooked run (or an error)
+		void finishHooks();
+
+		// runs the next instruction of a paused VM, and any returns it leads to, then pauses again (unless it's done)
+		void step();
+
+		// what perf trampolines call: runs the top frame until it returns, calls, or is switched away from
+		// catches anything thrown into 'perfError', as it can't be thrown through the trampoline
+		static void runFrame(void* vm, void* frame);
+
+		// everything but Print, see SysCall.cpp
+		void sysCall(SysCall call, std::int64_t nargs, std::int64_t argIdx, Frame& frame);
+
+		// Channel syscalls, returns false if 'call' isn't one
+		bool channelCall(SysCall call, std::int64_t nargs, std::int64_t argIdx, Frame& frame);
+
+		// retries the current syscall once 'fd' is ready. With an event loop, the call stack is parked until then,
+		// otherwise we block right here
+		void waitFor(Frame& frame, int fd, bool write);
+
+		// retries the current syscall once a send (or receive) on 'channel' might go through. With an event loop,
+		// or as a task, the call stack is parked until then. Otherwise we block right here, running queued tasks
+		// meanwhile if we have a scheduler
+		void waitFor(Frame& frame, const Value& channel, bool send);
+
+		// for whoever runs a VM waiting on a channel: calls 'wake' once it might be ready, maybe right away
+		void whenReady(std::function<void()> wake);
+
+		// stops waiting on a channel
+		void cancelWait();
 
-		std::stack<Frame> callStack;
+		void cancelSleep();
+
+		// creates our scheduler, if need be
+		Scheduler& tasks();
+
+		// a suspended coroutine's registry and call stack, or while it's running, those of whoever resumed it
+		struct Coroutine
+		{
+			std::uint64_t function;
+
+			Registry registry;
+			Registry::iterator nextFree;
+			CallStack callStack;
+
+			bool started;
+			bool finished;
+
+			// only meaningful while running
+			std::uint64_t resumer;
+			std::uint64_t aliveDest;
+			std::uint64_t valuesDest;
+		};
+
+		static constexpr std::uint64_t NO_COROUTINE = std::numeric_limits<std::uint64_t>::max();
+
+		// exchanges the running registry and call stack with those of 'coroutine'
+		void switchTo(Coroutine& coroutine);
+
+		void resume(std::uint64_t coroutine, std::uint64_t aliveDest, std::uint64_t valuesDest);
+		void yield(std::uint64_t num, std::uint64_t start);
+
+		// called when the call stack empties. If a coroutine finished, returns to its resumer and returns true
+		bool unwind();
+
+		// returns the function's decoded bytecode (null if not using Dispatch::Decoded)
+		const DecodedBytecode* prepare(std::uint64_t functionIndex);
+
+		void interpret(const DecodedInstruction& instr, Frame& frame);
+
+		// after a Ret, or the function running out of instructions
+		void popFrame();
+
+		// records the time of a run() that just finished, or threw
+		void finishRun(bool failed);
+
+		// records the time of every watched call whose frame is gone
+		void finishCalls();
+
+		Dispatch dispatch;
+
+		CallStack callStack;
 
 		Registry registry;
 		Registry::iterator nextFree;
 
-		Registry constants;
+		// finished ones are reused, so a coroutine is only valid until it finishes. A deque, since Frames can't be copied
+		std::deque<Coroutine> coroutines;
+		std::vector<std::uint64_t> freeCoroutines;
+		std::uint64_t currentCoroutine;
+
+		// set by the EventLoop running us, if any
+		EventLoop* eventLoop;
+
+		Profiler* profiler;
+		std::uint64_t lastTick;
+
+		Trace* trace;
+
+		PerfMap* perfMap;
+		std::exception_ptr perfError;
+
+		// perfMap's, by function index, null until first asked for
+		std::vector<PerfMap::Trampoline> trampolines;
+
+		HardwareCounters* hardwareCounters;
+
+		// a call to a watched function, until the call stack of 'coroutine' is no longer 'depth' deep
+		struct WatchedCall
+		{
+			std::uint64_t coroutine;
+			std::uint64_t depth;
+			std::uint64_t function;
+			std::uint64_t start;
+		};
+
+		Metrics* metrics;
+
+		// by interpretHooked(), for 'metrics'
+		std::uint64_t instructionsRun;
+		Value::Allocations arraysBefore;
+		std::uint64_t runStart;
+		std::vector<WatchedCall> watchedCalls;
+
+		Counters instructionCounts;
+
+		// the call stack while waiting on 'waitFd' (-1 when not waiting) or 'waitChannel' (Nil when not), or paused
+		CallStack parked;
+		bool pausedAtTrap;
+		int waitFd;
+		Value waitChannel;
+		std::shared_ptr<Channel::Waiter> channelWaiter;
+
+		// or sending, on a channel
+		bool waitWrite;
+
+		// timerfd of an unfinished Sleep
+		int sleepTimer;
+
+		// the bytes of an unfinished Read (read so far), or Write (written so far)
+		char ioPartial[sizeof(std::uint64_t)];
+		std::uint64_t ioDone;
+
+		std::shared_ptr<const Module> module;
+
+		// what Spawn hands to tasks: 'module' as loaded, before any Debugger swapped in its own copy
+		// so tasks never run into a Trap, nor read an instruction as it's being patched
+		std::shared_ptr<const Module> taskModule;
+
+		// tasks spawned by tasks share the scheduler of whoever spawned them, only the root VM owns it
+		std::shared_ptr<Scheduler> ownedScheduler;
+		Scheduler* taskScheduler;
+		std::uint64_t numWorkers;
 
-		std::vector<Function> functions;
+		// set by the Scheduler running us as a task, so we park rather than block
+		bool isTask;
 	};
 }
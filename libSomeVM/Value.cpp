@@ -1,5 +1,23 @@
 #include "Value.hpp"
 
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "Probes.hpp"
+
+#ifdef SVM_INSTRUMENT
+#include "Counters.hpp"
+#endif
+
+namespace
+{
+	// what hardware gives for 0 / 0, without the sign, so it can't be mistaken for an array
+	constexpr std::uint64_t QUIET_NAN = 0x7ff8000000000000u;
+
+	thread_local svm::Value::Allocations threadAllocations{ 0, 0 };
+}
+
 #ifdef DEBUG
 
 #include <sstream>
@@ -12,9 +30,9 @@ namespace
 	{
 		"Nil",
 		"Bool",
-		"Int",
 		"Float",
 		"Array",
+		"Object",
 	};
 
 	static const char* asString(Type type)
@@ -50,7 +68,10 @@ namespace svm
 		: typeVal(Type::Float)
 #endif
 	{
-		reinterpret_cast<Float&>(value) = f;
+		std::memcpy(&value, &f, sizeof(f));
+
+		if (isPointer(value))
+			value = QUIET_NAN;
 	}
 
 	Value::Value(const Value& other)
@@ -58,7 +79,10 @@ namespace svm
 #ifdef DEBUG
 		, typeVal(other.typeVal)
 #endif
-	{}
+	{
+		if (isPointer(value))
+			header(value)->references.fetch_add(1, std::memory_order_relaxed);
+	}
 
 	Value::Value(Value&& other)
 		: value(other.value)
@@ -75,6 +99,11 @@ namespace svm
 
 	Value& Value::operator=(const Value& other)
 	{
+		// first, in case it's the same array
+		if (isPointer(other.value))
+			header(other.value)->references.fetch_add(1, std::memory_order_relaxed);
+
+		cleanup();
 		value = other.value;
 
 #ifdef DEBUG
@@ -85,6 +114,10 @@ namespace svm
 
 	Value& Value::operator=(Value&& other)
 	{
+		if (this == &other)
+			return *this;
+
+		cleanup();
 		value = other.value;
 		other.value = 0;
 
@@ -116,7 +149,7 @@ namespace svm
 	{
 		cleanup();
 
-		reinterpret_cast<Bool&>(value) = b;
+		value = b;
 #ifdef DEBUG
 		typeVal = Type::Bool;
 #endif
@@ -128,7 +161,10 @@ namespace svm
 	{
 		cleanup();
 
-		reinterpret_cast<Float&>(value) = f;
+		std::memcpy(&value, &f, sizeof(f));
+
+		if (isPointer(value))
+			value = QUIET_NAN;
 #ifdef DEBUG
 		typeVal = Type::Float;
 #endif
@@ -183,10 +219,10 @@ namespace svm
 
 		case Type::Array:
 		{
-			Array<char>* arr = reinterpret_cast<Array<char>*>(value);
+			auto view = arrayView();
 
-			Bytes ret(arr->length());
-			std::memcpy(ret.data(), arr->data(), arr->length());
+			Bytes ret(view.length * view.elementSize);
+			std::memcpy(ret.data(), view.data, ret.length());
 
 			return ret;
 		}
@@ -206,20 +242,172 @@ namespace svm
 	}
 #endif
 
+	bool Value::isArray() const
+	{
+		return isPointer(value) && header(value)->elementSize != 0;
+	}
+
+	Value::ArrayView Value::arrayView() const
+	{
+		if (!isArray())
+			throw std::runtime_error("Value is not an array");
+
+		auto* head = header(value);
+		auto* arr = reinterpret_cast<const Array<std::uint8_t>*>(head + 1);
+
+		return{ head->elementSize, arr->length(), arr->data() };
+	}
+
+	Value Value::array(std::uint32_t elementSize, std::uint64_t length, const void* data)
+	{
+		// copied in byte by byte, 'data' needn't be aligned
+		auto make = [&](auto element)
+		{
+			Array<decltype(element)> arr(length);
+			std::memcpy(arr.data(), data, length * elementSize);
+			return Value{ std::move(arr) };
+		};
+
+		switch (elementSize)
+		{
+		case 1:
+			return make(std::uint8_t{});
+
+		case 2:
+			return make(std::uint16_t{});
+
+		case 4:
+			return make(std::uint32_t{});
+
+		case 8:
+			return make(std::uint64_t{});
+
+		default:
+			throw std::runtime_error("Arrays of " + std::to_string(elementSize) + " byte elements aren't supported");
+		}
+	}
+
+	Value Value::object(void* object, void (*destroy)(void* object))
+	{
+		Value ret;
+		ret.value = allocateArray(0, 0, sizeof(ObjectSlot), [](void* slot)
+		{
+			auto* held = static_cast<ObjectSlot*>(slot);
+			held->destroy(held->object);
+		});
+
+		new (header(ret.value) + 1) ObjectSlot{ object, destroy };
+
+#ifdef DEBUG
+		ret.typeVal = Type::Object;
+#endif
+		return ret;
+	}
+
+	void* Value::object() const
+	{
+		if (!isPointer(value) || header(value)->elementSize != 0)
+			return nullptr;
+
+		return reinterpret_cast<const ObjectSlot*>(header(value) + 1)->object;
+	}
+
+	std::uint64_t Value::bits() const
+	{
+		return value;
+	}
+
+	Value Value::fromBits(std::uint64_t bits)
+	{
+		Value ret;
+		ret.value = isPointer(bits) ? QUIET_NAN : bits;
+
+#ifdef DEBUG
+		// no way to know, assume the most common
+		ret.typeVal = Type::Float;
+#endif
+		return ret;
+	}
+
+#ifdef DEBUG
+	Value Value::fromBits(std::uint64_t bits, Type type)
+	{
+		if (type == Type::Array || type == Type::Object)
+			throw std::logic_error("Arrays and objects can't be made from bits, see Value::array()");
+
+		Value ret = fromBits(bits);
+		ret.typeVal = type;
+		return ret;
+	}
+#endif
+
+	Value::Allocations Value::allocated()
+	{
+		return threadAllocations;
+	}
+
+	bool Value::isArrayBits(std::uint64_t bits)
+	{
+		return isPointer(bits);
+	}
+
 	bool Value::isPointer(std::uint64_t value)
 	{
-		constexpr auto PTR_MASK = 0xfff0000000000000u;
-		return (value & PTR_MASK) == PTR_MASK;
+		return (value & ARRAY_TAG) == ARRAY_TAG;
+	}
+
+	Value::ArrayHeader* Value::header(std::uint64_t value)
+	{
+		return reinterpret_cast<ArrayHeader*>(value & ~ARRAY_TAG);
+	}
+
+	std::uint64_t Value::allocateArray(std::uint32_t elementSize, std::uint64_t length, std::size_t arraySize, void (*destroy)(void* array))
+	{
+		void* memory = std::malloc(sizeof(ArrayHeader) + arraySize);
+
+		if (!memory)
+			throw std::bad_alloc();
+
+		auto address = reinterpret_cast<std::uint64_t>(memory);
+
+		// only if the platform uses more than 48 bits of address
+		if ((address & ARRAY_TAG) != 0)
+		{
+			std::free(memory);
+			throw std::runtime_error("Array allocated outside of a 48 bit address space");
+		}
+
+		new (memory) ArrayHeader{ { 1 }, elementSize, destroy };
+
+		// the elements too, Array<T> allocates them on its own
+		++threadAllocations.count;
+		threadAllocations.bytes += sizeof(ArrayHeader) + arraySize + length * elementSize;
+
+#ifdef SVM_INSTRUMENT
+		// malloc'd, so operator new doesn't see it
+		Counters::allocation(sizeof(ArrayHeader) + arraySize);
+#endif
+
+		// not for objects
+		if (elementSize != 0)
+			SVM_PROBE3(array__alloc, elementSize, length, sizeof(ArrayHeader) + arraySize + length * elementSize);
+
+		return address | ARRAY_TAG;
 	}
 
 	void Value::freeArray(std::uint64_t value)
 	{
-		std::free(reinterpret_cast<void*>(value));
+		auto* head = header(value);
+
+		head->destroy(head + 1);
+		head->~ArrayHeader();
+		std::free(head);
 	}
 
 	void Value::cleanup()
 	{
-		if (isPointer(value))
+		// the last one frees it, after everyone else is done with it
+		if (isPointer(value) && header(value)->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
 			freeArray(value);
 	}
 
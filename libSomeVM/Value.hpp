@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <cstdlib>
 #include <climits>
+#include <atomic>
 #include <limits>
 #include <stdexcept>
 
@@ -37,6 +39,11 @@ namespace svm
 	//
 	// "But wait! That means pointers don't fully fit in the value they should!"
 	// Actually they will! 64-bit machines only use 48-bits for pointers!
+	//
+	// Arrays are tagged with the top 16 bits all set. No arithmetic makes that NaN out of numbers,
+	// and a Float that has it anyway (ie: read in from a file) is taken as a plain NaN instead.
+	// They're reference counted: copying a Value shares its array, the last one frees it.
+	// Other objects (ie: Channels) are held the same way, behind a header with no element size.
 
 #ifdef DEBUG
 	enum class Type : std::uint8_t
@@ -45,6 +52,7 @@ namespace svm
 		Bool = 1,
 		Float = 2,
 		Array = 3,
+		Object = 4,
 	};
 #endif
 
@@ -87,13 +95,81 @@ namespace svm
 		Type type() const;
 #endif
 
+		bool isArray() const;
+
+		// an array's elements, ie: for serializing. Only valid as long as the Value (or a copy of it) is. Throws if not an array
+		struct ArrayView
+		{
+			std::uint32_t elementSize;
+			std::uint64_t length;
+			const void* data;
+		};
+
+		ArrayView arrayView() const;
+
+		// an array of 'length' elements of 'elementSize' bytes (1, 2, 4 or 8), copied from 'data'
+		static Value array(std::uint32_t elementSize, std::uint64_t length, const void* data);
+
+		// a reference counted 'object' (ie: a Channel), handed to 'destroy' once the last Value holding it is gone
+		static Value object(void* object, void (*destroy)(void* object));
+
+		// the object held, null if this isn't one
+		void* object() const;
+
+		// the value exactly as stored, for serializing
+		// arrays are stored as pointers, so they mean nothing outside of this process (see arrayView() instead)
+		std::uint64_t bits() const;
+
+		// bits that are an array's are taken as a NaN
+		static Value fromBits(std::uint64_t bits);
+
+		// true if 'bits' would be an array, which fromBits() won't give (ie: to reject them when loading)
+		static bool isArrayBits(std::uint64_t bits);
+
+		// arrays and objects allocated on the calling thread so far, and their bytes (ie: the difference across a run)
+		struct Allocations
+		{
+			std::uint64_t count;
+			std::uint64_t bytes;
+		};
+
+		static Allocations allocated();
+
+#ifdef DEBUG
+		static Value fromBits(std::uint64_t bits, Type type);
+#endif
+
 	private:
+		static constexpr std::uint64_t ARRAY_TAG = 0xffff000000000000u;
+
+		// what arrays point to, followed by the Array itself (or an ObjectSlot)
+		struct ArrayHeader
+		{
+			std::atomic<std::uint64_t> references;
+
+			// 0 for an object
+			std::uint32_t elementSize;
+			void (*destroy)(void* array);
+		};
+
+		struct ObjectSlot
+		{
+			void* object;
+			void (*destroy)(void* object);
+		};
+
 		static bool isPointer(std::uint64_t value);
+		static ArrayHeader* header(std::uint64_t value);
+
+		// room for an Array of 'arraySize' bytes (holding 'length' elements) after its header, with one reference
+		// returns the tagged pointer
+		static std::uint64_t allocateArray(std::uint32_t elementSize, std::uint64_t length, std::size_t arraySize, void (*destroy)(void* array));
 
 		template<typename T>
 		static std::uint64_t newArray(Array<T> arr);
 		static void freeArray(std::uint64_t value);
 
+		// drops our reference to an array, if we have one. Leaves 'value' as it was
 		void cleanup();
 
 		std::uint64_t value;
@@ -116,8 +192,7 @@ namespace svm
 	template<typename T>
 	Value& Value::operator=(Array<T> arr)
 	{
-		if (isPointer(value))
-			freeArray(value);
+		cleanup();
 
 		value = newArray(arr);
 
@@ -135,14 +210,21 @@ namespace svm
 		if (typeVal != Type::Array)
 			throw errorBuilder(Type::Array, typeVal);
 #endif
-		return *reinterpret_cast<Array<T>*>(value);
+		if (!isArray())
+			throw std::runtime_error("Value is not an array");
+
+		return *reinterpret_cast<const Array<T>*>(header(value) + 1);
 	}
 
 	template<typename T>
 	std::uint64_t Value::newArray(Array<T> arr)
 	{
-		std::uint64_t ret = reinterpret_cast<std::uint64_t>(std::malloc(sizeof(Array<T>)));
-		new (reinterpret_cast<void*>(ret)) Array<T>(arr);
+		auto ret = allocateArray(sizeof(T), arr.length(), sizeof(Array<T>), [](void* array)
+		{
+			static_cast<Array<T>*>(array)->~Array<T>();
+		});
+
+		new (header(ret) + 1) Array<T>(std::move(arr));
 		return ret;
 	}
 }
@@ -0,0 +1,132 @@
+// channels: freed with the last Value holding them, and Send/Recv parking tasks and event loop scripts
+
+#include "libSomeVM/Channel.hpp"
+#include "libSomeVM/EventLoop.hpp"
+#include "libSomeVM/Module.hpp"
+#include "libSomeVM/Scheduler.hpp"
+
+#include "Test.hpp"
+
+namespace
+{
+	using namespace svm;
+	using namespace bench;
+	using Type = Instruction::Type;
+
+	constexpr std::uint64_t COUNT = 10000;
+	constexpr Float SUM = static_cast<Float>(COUNT) * (COUNT - 1) / 2;
+
+	// r0: channel, r1: count. sends 0 to count - 1, then closes
+	void producer(Builder& b)
+	{
+		b.load(2, Float(0));
+		b.load(3, Float(1));
+
+		auto top = b.here();
+		b.op(Type::Lt, 4, 2, 1);
+		auto end = b.jumpIfFalse(4);
+
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 0 });
+		b.code.emplace_back(Type::Load, std::uint32_t{ 11 }, std::uint32_t{ 2 });
+		b.sysCall(SysCall::Send, 2);
+
+		b.op(Type::Add, 2, 2, 3);
+		b.jump(top);
+
+		b.program.constants[end] = integer(b.here());
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 0 });
+		b.sysCall(SysCall::CloseChannel, 1);
+	}
+
+	// r0: channel. sums everything received into r0
+	void consumer(Builder& b)
+	{
+		b.load(5, Float(0));
+
+		auto top = b.here();
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 0 });
+		b.sysCall(SysCall::Recv, 1);
+		auto end = b.jumpIfFalse(11);
+
+		b.op(Type::Add, 5, 5, 10);
+		b.jump(top);
+
+		b.program.constants[end] = integer(b.here());
+		b.code.emplace_back(Type::Load, std::uint32_t{ 0 }, std::uint32_t{ 5 });
+	}
+
+	bool destroyed = false;
+}
+
+int main()
+{
+	// the channel goes with its last Value, and so does what's still in it
+	{
+		Value value = Value::object(&destroyed, [](void* flag) { *static_cast<bool*>(flag) = true; });
+
+		{
+			auto handle = Channel::create(4, Channel::Kind::Multi);
+			auto copy = handle;
+
+			CHECK(Channel::get(copy) == Channel::get(handle));
+			CHECK(Channel::get(copy)->trySend(value));
+			CHECK(value.object() == nullptr);
+		}
+
+		CHECK(destroyed);
+		CHECK(Channel::get(Value{ Float(1) }) == nullptr);
+	}
+
+	// a consumer and a producer as tasks, on just the one worker, through a channel too small to hold everything.
+	// Neither can finish without the other running while it waits, so each has to park rather than block
+	{
+		Builder b;
+		b.load(2, integer(0));
+		b.load(3, integer(1));
+		b.op(Type::Spawn, 6, 2, 3);
+		b.load(3, integer(2));
+		b.op(Type::Spawn, 7, 2, 3);
+
+		// the consumer first, which is the last queued, so it's the first run
+		b.code.emplace_back(Type::Join, std::uint32_t{ 7 }, std::uint32_t{ 8 });
+		b.code.emplace_back(Type::Join, std::uint32_t{ 6 }, std::uint32_t{ 9 });
+		b.endFunction();
+
+		producer(b);
+		b.endFunction(0, 2);
+
+		consumer(b);
+		b.endFunction(1, 2);
+
+		VM vm(32);
+		vm.load(b.finish());
+		vm.setWorkers(1);
+		vm.write(Channel::create(2, Channel::Kind::Multi));
+		vm.write(Float(COUNT));
+		vm.run();
+
+		CHECK(static_cast<Float>(vm.read(8)) == SUM);
+		CHECK(vm.scheduler()->stats().executed == 2);
+	}
+
+	// the same, as two scripts on an event loop
+	{
+		Builder p;
+		producer(p);
+		Builder c;
+		consumer(c);
+
+		auto channel = Channel::create(2, Channel::Kind::Single);
+
+		EventLoop loop(32);
+		loop.add(c.finish(), { channel });
+		loop.add(p.finish(), { channel, Float(COUNT) });
+		loop.run();
+
+		CHECK(loop.error(0).empty() && loop.error(1).empty());
+		CHECK(static_cast<Float>(loop.script(0).read(0)) == SUM);
+		CHECK(loop.stats().suspensions > 0);
+	}
+
+	return test::finish("channel");
+}
@@ -0,0 +1,123 @@
+// breakpoints in a program that spawns tasks: only the VM being debugged breaks, its tasks run (and give) what they would without one
+
+#include <sstream>
+
+#include "libSomeVM/Debugger.hpp"
+#include "libSomeVM/Module.hpp"
+
+#include "Test.hpp"
+
+namespace
+{
+	using namespace svm;
+	using namespace bench;
+	using Type = Instruction::Type;
+
+	constexpr std::uint64_t WORKERS = 4;
+
+	// what bench/workloads/spawn_tree does: the number of nodes in trees 4 to 10 levels deep, every node a task
+	// r40 + n: nodes of the n'th tree (31, 127, 511, 2047)
+	std::shared_ptr<const Module> binaryTrees()
+	{
+		Builder b;
+
+		for (std::uint32_t n = 0; n < 4; ++n)
+		{
+			b.load(0, Float(4 + 2 * n));
+			b.load(4, integer(0));
+			b.load(5, integer(1));
+			b.op(Type::Spawn, 6, 4, 5);
+			b.code.emplace_back(Type::Join, std::uint32_t{ 6 }, std::uint32_t{ 40 + n });
+		}
+
+		b.endFunction();
+
+		// r0: depth. returns the number of nodes in r0
+		b.load(1, Float(0));
+		b.load(3, Float(1));
+		b.op(Type::Gt, 2, 0, 1);
+		auto leaf = b.jumpIfFalse(2);
+
+		b.op(Type::Sub, 4, 0, 3);
+		b.load(5, integer(4));
+		b.load(6, integer(1));
+		b.op(Type::Spawn, 7, 5, 6);
+		b.op(Type::Spawn, 8, 5, 6);
+		b.code.emplace_back(Type::Join, std::uint32_t{ 7 }, std::uint32_t{ 9 });
+		b.code.emplace_back(Type::Join, std::uint32_t{ 8 }, std::uint32_t{ 10 });
+
+		b.op(Type::Add, 0, 9, 10);
+		b.op(Type::Add, 0, 0, 3);
+		auto done = b.constant(integer(0));
+		b.code.emplace_back(Type::JmpC, std::uint64_t{ done });
+
+		b.program.constants[leaf] = integer(b.here());
+		b.load(0, Float(1));
+
+		b.program.constants[done] = integer(b.here());
+		b.endFunction(1, 1);
+
+		return b.finish();
+	}
+
+	bool treesRight(const VM& vm)
+	{
+		bool ok = true;
+
+		for (std::uint64_t n = 0; n < 4; ++n)
+			ok = ok && static_cast<Float>(vm.read(40 + n)) == (1 << (5 + 2 * n)) - 1;
+
+		return ok;
+	}
+}
+
+int main()
+{
+	auto module = binaryTrees();
+
+	// breaking at the start of both functions: the tree function is only ever run by tasks, so we stop just the once
+	{
+		VM vm(64);
+		vm.load(module);
+		vm.setWorkers(WORKERS);
+
+		Debugger debugger(vm);
+		debugger.add({ 0, 0 });
+		debugger.add({ 1, 0 });
+
+		CHECK(debugger.resume());
+		CHECK(debugger.backtrace().size() == 1 && debugger.backtrace().back().functionIndex == 0);
+
+		CHECK(!debugger.resume());
+		CHECK(treesRight(vm));
+	}
+
+	// the same through the command loop, continuing at each stop. It prints one stop, then the trees are all there
+	{
+		VM vm(64);
+		vm.load(module);
+		vm.setWorkers(WORKERS);
+
+		std::istringstream input("c\nc\nc\n");
+		std::ostringstream output;
+
+		Debugger debugger(vm);
+		debugger.run({ { 0, 0 }, { 1, 0 } }, input, output);
+
+		CHECK(output.str() == "f0 +0: loadc\n> ");
+		CHECK(treesRight(vm));
+	}
+
+	// and the module shared with the debugged VM is left as it was, for the next one to run without breaking
+	{
+		VM vm(64);
+		vm.load(module);
+		vm.setWorkers(WORKERS);
+		vm.run();
+
+		CHECK(!vm.paused());
+		CHECK(treesRight(vm));
+	}
+
+	return test::finish("debugger");
+}
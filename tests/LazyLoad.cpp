@@ -0,0 +1,100 @@
+// lazily loaded functions: loading them from several Modules, on several threads, all sharing one stream
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+#include "libSomeVM/Module.hpp"
+
+#include "Test.hpp"
+
+namespace
+{
+	using namespace svm;
+	using Type = Instruction::Type;
+
+	Program generate(std::uint64_t numFunctions)
+	{
+		Program program;
+		program.constants.emplace_back(Float(1));
+
+		for (std::uint64_t f = 0; f < numFunctions; ++f)
+		{
+			Bytecode code;
+
+			// each function different, so a read from the wrong offset shows
+			for (std::uint64_t i = 0; i <= f % 100; ++i)
+				code.emplace_back(Type::Add, static_cast<std::uint16_t>(f % 200), static_cast<std::uint16_t>(i), std::uint16_t{ 0 });
+
+			code.emplace_back(Type::Ret, std::uint32_t{ 0 }, std::uint32_t{ 0 });
+			program.functions.emplace_back(0, 0, code);
+		}
+
+		return program;
+	}
+
+	bool same(const Bytecode& a, const Bytecode& b)
+	{
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](Instruction x, Instruction y)
+		{
+			return std::memcmp(&x, &y, sizeof(Instruction)) == 0;
+		});
+	}
+}
+
+int main()
+{
+	constexpr std::uint64_t FUNCTIONS = 20000;
+
+	auto program = generate(FUNCTIONS);
+
+	for (auto encoding : { Encoding::Fixed, Encoding::Compact })
+	{
+		std::ostringstream out;
+		program.write(out, encoding);
+
+		Program lazy;
+		lazy.load(std::make_shared<std::istringstream>(out.str()));
+
+		// both read from the same stream
+		auto one = std::make_shared<const Module>(lazy);
+		auto two = std::make_shared<const Module>(lazy);
+
+		std::vector<std::thread> threads;
+		std::atomic<int> errors{ 0 };
+
+		for (int t = 0; t < 4; ++t)
+		{
+			threads.emplace_back([&, t]()
+			{
+				auto& module = t % 2 == 0 ? *one : *two;
+
+				// each starting somewhere else, so they collide
+				for (std::uint64_t i = 0; i < FUNCTIONS; ++i)
+				{
+					try
+					{
+						module.decoded((i + t * FUNCTIONS / 4) % FUNCTIONS);
+					}
+					catch (const std::exception&)
+					{
+						++errors;
+					}
+				}
+			});
+		}
+
+		for (auto& t : threads)
+			t.join();
+
+		CHECK(errors == 0);
+
+		for (std::uint64_t f = 0; f < FUNCTIONS; ++f)
+		{
+			CHECK(same(one->function(f).bytecode(), program.functions[f].bytecode()));
+			CHECK(same(two->function(f).bytecode(), program.functions[f].bytecode()));
+		}
+	}
+
+	return test::finish("lazy load");
+}
@@ -0,0 +1,108 @@
+// the lexer's scanners: each one this CPU has gives exactly what the scalar one does, whatever the source,
+// and wherever it ends within a block. And lexing in pieces, on several threads, gives what lexing in one go does
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SomeLang/Lexer.hpp"
+#include "SomeLang/Frontend.hpp"
+
+#include "Test.hpp"
+
+namespace
+{
+	// weighted towards what starts and ends runs, with some bytes over 0x7f (which are never in a run)
+	constexpr char ALPHABET[] = "aZz_09.+-\"\"##  \t\t\r\n\n;:,()$f\x80\xff";
+
+	std::string generate(std::mt19937& random, std::size_t length)
+	{
+		std::uniform_int_distribution<std::size_t> pick(0, sizeof(ALPHABET) - 2);
+		std::uniform_int_distribution<std::size_t> runLength(0, 70);
+
+		std::string ret;
+
+		// runs long enough to cross a block or two, of a single byte
+		while (ret.size() < length)
+			ret.append(runLength(random) % 5 == 0 ? runLength(random) : 1, ALPHABET[pick(random)]);
+
+		ret.resize(length);
+		return ret;
+	}
+
+	bool same(const std::vector<sl::Lexeme>& a, const std::vector<sl::Lexeme>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (std::size_t i = 0; i < a.size(); ++i)
+		{
+			if (a[i].type != b[i].type || a[i].line != b[i].line || a[i].offset != b[i].offset || a[i].length != b[i].length)
+				return false;
+		}
+
+		return true;
+	}
+
+	const sl::Scanner SCANNERS[] = { sl::Scanner::Sse2, sl::Scanner::Avx2 };
+}
+
+int main()
+{
+	std::mt19937 random(42);
+
+	CHECK(sl::available(sl::Scanner::Scalar));
+	CHECK(sl::available(sl::bestScanner()));
+
+	for (auto scanner : SCANNERS)
+	{
+		if (!sl::available(scanner))
+		{
+			CHECK_THROWS(sl::lex(std::string_view("x"), scanner));
+			continue;
+		}
+
+		// every length up to a few blocks, then longer ones
+		bool agree = true;
+
+		for (std::size_t length = 0; length < 4096 && agree; length += length < 200 ? 1 : 97)
+		{
+			auto source = generate(random, length);
+			agree = same(sl::lex(std::string_view(source), scanner), sl::lex(std::string_view(source), sl::Scanner::Scalar));
+		}
+
+		CHECK(agree);
+
+		// ending part way through a run, at every offset into a block, so the scalar tail finishes it
+		std::string run = "a" + std::string(100, 'b') + " \t 123.456 # comment\n\"" + std::string(70, 's') + "\"";
+		bool tails = true;
+
+		for (std::size_t cut = 0; cut <= run.size(); ++cut)
+		{
+			std::string_view source(run.data(), cut);
+			tails = tails && same(sl::lex(source, scanner), sl::lex(source, sl::Scanner::Scalar));
+		}
+
+		CHECK(tails);
+	}
+
+	// split into pieces at each "func" starting a line, some inside strings, on a few threads: the same as in one go
+	{
+		bool agree = true;
+
+		for (std::size_t length = 0; length < 20000 && agree; length += 1999)
+		{
+			auto source = generate(random, length);
+
+			for (std::size_t at = 0; at < source.size(); at += 37)
+				source.replace(at, 0, "\nfunc ");
+
+			for (std::size_t workers = 1; workers <= 4 && agree; ++workers)
+				agree = same(sl::lexParallel(source, workers), sl::lex(std::string_view(source)));
+		}
+
+		CHECK(agree);
+	}
+
+	return test::finish("lexer");
+}
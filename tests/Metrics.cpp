@@ -0,0 +1,73 @@
+// metrics: latencies within the histogram's error, and what a run allocates counted, channels included
+
+#include <sstream>
+
+#include "libSomeVM/Metrics.hpp"
+#include "libSomeVM/Channel.hpp"
+
+#include "Test.hpp"
+
+namespace
+{
+	using namespace svm;
+	using namespace bench;
+	using Type = Instruction::Type;
+
+	std::string json(const Metrics& metrics)
+	{
+		std::ostringstream oss;
+		metrics.writeJson(oss);
+		return oss.str();
+	}
+}
+
+int main()
+{
+	// each value comes back as no less than itself, and under 0.8% more
+	{
+		bool exact = true;
+		bool close = true;
+
+		for (std::uint64_t v = 1; v < (std::uint64_t{ 1 } << 40); v = v * 3 / 2 + 1)
+		{
+			Histogram h;
+			h.record(v);
+
+			auto p = h.percentile(1);
+			exact = exact && (v >= (1u << Histogram::PRECISION) || p == v);
+			close = close && p >= v && static_cast<double>(p - v) / v < 0.008;
+		}
+
+		CHECK(exact);
+		CHECK(close);
+	}
+
+	// three channels made while running, each an allocation
+	{
+		Builder b;
+
+		for (std::uint32_t i = 0; i < 3; ++i)
+		{
+			b.load(10, integer(1));
+			b.load(11, false);
+			b.sysCall(SysCall::NewChannel, 2);
+			b.code.emplace_back(Type::Load, std::uint32_t{ 30 + i }, std::uint32_t{ 10 });
+		}
+
+		Metrics metrics;
+
+		VM vm(64);
+		vm.load(b.finish());
+		vm.setMetrics(&metrics);
+		vm.run();
+
+		CHECK(Channel::get(vm.read(32)) != nullptr);
+		CHECK(json(metrics).find("\"allocations\": 3,") != std::string::npos);
+
+		// and only what's made while running
+		auto made = Channel::create(1, Channel::Kind::Single);
+		CHECK(json(metrics).find("\"allocations\": 3,") != std::string::npos);
+	}
+
+	return test::finish("metrics");
+}
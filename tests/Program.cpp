@@ -0,0 +1,184 @@
+// binaries: constants written and read back, arrays by their elements, and pointers and made up sizes turned down
+
+#include <cstring>
+#include <sstream>
+
+#include "libSomeVM/Channel.hpp"
+
+#include "Test.hpp"
+
+namespace
+{
+	using namespace svm;
+	using Type = Instruction::Type;
+
+	Program generate()
+	{
+		Program program;
+		program.constants.emplace_back(Float(1.5));
+		program.constants.emplace_back(Array<char>("hello, world", 12));
+		program.constants.emplace_back(true);
+
+		std::uint64_t wide[] = { 1, 2, 0xffffffffffffffffu };
+		program.constants.push_back(Value::array(sizeof(std::uint64_t), 3, wide));
+		program.constants.push_back(Value::array(1, 0, ""));
+
+		Bytecode code;
+		code.emplace_back(Type::Ret, std::uint32_t{ 0 }, std::uint32_t{ 0 });
+		program.functions.emplace_back(0, 0, code);
+
+		return program;
+	}
+
+	bool sameArray(const Value& a, const Value& b)
+	{
+		if (!a.isArray() || !b.isArray())
+			return false;
+
+		auto x = a.arrayView();
+		auto y = b.arrayView();
+
+		return x.elementSize == y.elementSize && x.length == y.length && std::memcmp(x.data, y.data, x.length * x.elementSize) == 0;
+	}
+
+	// the first constant of a program with one, 'bits', as version 'version' writes it
+	std::string withConstant(std::uint32_t version, std::uint64_t bits)
+	{
+		std::string ret = ".svm";
+		ret.append(reinterpret_cast<const char*>(&version), sizeof(version));
+
+		auto encoding = Encoding::Fixed;
+		ret.append(reinterpret_cast<const char*>(&encoding), sizeof(encoding));
+
+		std::uint64_t one = 1;
+		ret.append(reinterpret_cast<const char*>(&one), sizeof(one));
+
+		if (version >= 4)
+			ret.push_back(0);
+
+		ret.append(reinterpret_cast<const char*>(&bits), sizeof(bits));
+
+		std::uint64_t none = 0;
+		ret.append(reinterpret_cast<const char*>(&none), sizeof(none));
+		return ret;
+	}
+
+	template<typename T>
+	void append(std::string& out, T value)
+	{
+		out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	// a version 4 binary claiming 'numConstants' constants (with none there) and 'numFunctions' functions,
+	// only the first of them written, followed by one instruction of code
+	std::string withTable(std::uint64_t numConstants, std::uint64_t numFunctions, std::uint64_t numInstrs, std::uint64_t offset, std::uint64_t size)
+	{
+		std::string ret = ".svm";
+		append(ret, std::uint32_t{ 4 });
+		append(ret, Encoding::Fixed);
+		append(ret, numConstants);
+		append(ret, numFunctions);
+
+		append(ret, std::uint8_t{ 0 });
+		append(ret, std::uint8_t{ 0 });
+		append(ret, numInstrs);
+		append(ret, offset);
+		append(ret, size);
+
+		append(ret, Instruction(Type::Nop, std::uint64_t{ 0 }));
+		return ret;
+	}
+
+	bool loads(const std::string& bytes)
+	{
+		std::istringstream in(bytes);
+
+		Program loaded;
+		return !test::throws([&]() { loaded.load(in); });
+	}
+}
+
+int main()
+{
+	auto program = generate();
+
+	std::ostringstream out;
+	program.write(out);
+
+	// read back, and in a process that never had the originals, the arrays would be the same
+	{
+		std::istringstream in(out.str());
+
+		Program loaded;
+		loaded.load(in);
+
+		CHECK(loaded.constants.size() == program.constants.size());
+		CHECK(loaded.constants[0].bits() == program.constants[0].bits());
+		CHECK(sameArray(loaded.constants[1], program.constants[1]));
+		CHECK(loaded.constants[1].arrayView().data != program.constants[1].arrayView().data);
+		CHECK(loaded.constants[2].bits() == program.constants[2].bits());
+		CHECK(sameArray(loaded.constants[3], program.constants[3]));
+		CHECK(sameArray(loaded.constants[4], program.constants[4]));
+		CHECK(loaded.functions.size() == 1);
+
+		auto text = static_cast<Array<char>>(loaded.constants[1]);
+		CHECK(std::string(text.data(), text.length()) == "hello, world");
+	}
+
+	// cut off part way through an array
+	{
+		auto bytes = out.str();
+		auto at = bytes.find("hello");
+
+		std::istringstream in(bytes.substr(0, at + 5));
+
+		Program loaded;
+		CHECK_THROWS(loaded.load(in));
+	}
+
+	// pointers, from any version
+	{
+		for (std::uint32_t version : { 3u, 4u })
+		{
+			std::istringstream in(withConstant(version, 0xffff000012345678u));
+
+			Program loaded;
+			CHECK_THROWS(loaded.load(in));
+		}
+
+		std::istringstream in(withConstant(4, 0x3ff0000000000002u));
+
+		Program loaded;
+		loaded.load(in);
+		CHECK(loaded.constants.size() == 1 && loaded.constants[0].bits() == 0x3ff0000000000002u);
+	}
+
+	// counts, sizes and offsets made up to run past the input, allocate everything, or wrap around
+	{
+		CHECK(loads(withTable(0, 1, 1, 0, 8)));
+		CHECK(!loads(withTable(0, 1, 1, 8, 8)));
+
+		// offset + size wraps to 8
+		CHECK(!loads(withTable(0, 1, 1, 16, 0xfffffffffffffff8u)));
+		CHECK(!loads(withTable(0, 1, 1, 0xfffffffffffffff8u, 16)));
+
+		// instructions * 8 wraps to 8
+		CHECK(!loads(withTable(0, 1, 0x2000000000000001u, 0, 8)));
+
+		// far more than there are
+		CHECK(!loads(withTable(0xffffffffffffffffu, 1, 1, 0, 8)));
+		CHECK(!loads(withTable(0, 0xffffffffffffffffu, 1, 0, 8)));
+		CHECK(!loads(withTable(0, 1, 1, 0, 0xffffffffffffff00u)));
+	}
+
+	// objects only mean anything to the process they're in
+	{
+		Program withChannel = generate();
+		withChannel.constants.push_back(Channel::create(1, Channel::Kind::Single));
+
+		std::ostringstream ignored;
+		CHECK_THROWS(withChannel.write(ignored));
+	}
+
+	return test::finish("program");
+}
@@ -0,0 +1,118 @@
+// snapshots: arrays are stored by their contents, and nothing that looks like a pointer is restored
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "libSomeVM/Snapshot.hpp"
+#include "libSomeVM/Module.hpp"
+
+#include "Test.hpp"
+
+namespace
+{
+	using namespace svm;
+
+	std::string text(const Value& value)
+	{
+		auto view = value.arrayView();
+		return std::string(static_cast<const char*>(view.data), view.length * view.elementSize);
+	}
+
+	std::string path(const char* name)
+	{
+		return std::string("/tmp/svm-test-") + name + ".svs";
+	}
+}
+
+int main()
+{
+	// arrays share their elements between copies, and outlive the Value they were made in
+	{
+		Value copy;
+
+		{
+			Value original{ Array<char>("hello", 5) };
+			copy = original;
+
+			Value other = original;
+			other = Float(2);
+		}
+
+		CHECK(copy.isArray());
+		CHECK(text(copy) == "hello");
+
+		std::uint32_t words[] = { 1, 2, 3 };
+		auto array = Value::array(4, 3, words);
+		CHECK(array.arrayView().elementSize == 4);
+		CHECK(array.arrayView().length == 3);
+		CHECK(static_cast<const std::uint32_t*>(array.arrayView().data)[2] == 3);
+
+		// a NaN that would be a pointer stays a number
+		CHECK(!Value::fromBits(0xffff123456789abcu).isArray());
+		CHECK(!Value(Value::fromBits(0xfff8000000000000u)).isArray());
+		CHECK_THROWS(Value(Float(1)).arrayView());
+	}
+
+	// constants and registers with arrays, through a file, as another process would read them
+	{
+		bench::Builder builder;
+		builder.constant(Array<char>("constant", 8));
+		builder.constant(Float(1.5));
+
+		auto module = builder.finish();
+
+		VM vm;
+		vm.load(module);
+		vm.write(Value{ Array<char>("register", 8) });
+		vm.write(Value{ Float(4) });
+
+		{
+			std::ofstream out(path("arrays"), std::ios::binary);
+			vm.snapshot(out);
+		}
+
+		auto snapshot = std::make_shared<const Snapshot>(path("arrays"));
+
+		VM restored;
+		restored.restore(snapshot);
+
+		CHECK(snapshot->constant(0).isArray() && text(snapshot->constant(0)) == "constant");
+		CHECK(!snapshot->constant(1).isArray() && static_cast<Float>(snapshot->constant(1)) == 1.5);
+		CHECK(restored.read(0).isArray() && text(restored.read(0)) == "register");
+		CHECK(static_cast<Float>(restored.read(1)) == 4);
+	}
+
+	// a value with pointer bits, as an older snapshot (or a made up one) would have
+	{
+		VM vm;
+		bench::Builder builder;
+		vm.load(builder.finish());
+		vm.write(Value{ Float(3) });
+
+		std::ostringstream out;
+		vm.snapshot(out);
+		auto bytes = out.str();
+
+		// the first register's bits, after the header and the constants
+		std::uint64_t registryOffset;
+		std::memcpy(&registryOffset, bytes.data() + 32, sizeof(registryOffset));
+
+		std::uint64_t pointer = 0xffff00007f001000u;
+		std::memcpy(&bytes[registryOffset], &pointer, sizeof(pointer));
+
+		{
+			std::ofstream fout(path("pointer"), std::ios::binary);
+			fout << bytes;
+		}
+
+		Snapshot snapshot(path("pointer"));
+		CHECK_THROWS(snapshot.registry(0));
+	}
+
+	std::remove(path("arrays").c_str());
+	std::remove(path("pointer").c_str());
+
+	return test::finish("snapshot");
+}
@@ -0,0 +1,67 @@
+// what bench/Compare runs on timings, against known values: U's critical values from the tables, and a shift worked out by hand
+
+#include "bench/Stats.hpp"
+
+#include "Test.hpp"
+
+int main()
+{
+	// two sided, alpha = 0.05, as listed in tables of the Mann-Whitney U test
+	{
+		CHECK(bench::criticalU(3, 3, 0.05) == -1);
+		CHECK(bench::criticalU(5, 5, 0.05) == 2);
+		CHECK(bench::criticalU(8, 8, 0.05) == 13);
+		CHECK(bench::criticalU(10, 10, 0.05) == 23);
+		CHECK(bench::criticalU(15, 15, 0.05) == 64);
+		CHECK(bench::criticalU(20, 20, 0.05) == 127);
+		CHECK(bench::criticalU(5, 10, 0.05) == 8);
+		CHECK(bench::criticalU(10, 5, 0.05) == 8);
+
+		// and alpha = 0.01
+		CHECK(bench::criticalU(10, 10, 0.01) == 16);
+		CHECK(bench::criticalU(20, 20, 0.01) == 105);
+
+		// the most the exact counts are used for, worked out with exact fractions
+		CHECK(bench::criticalU(100, 100, 0.05) == 4197);
+
+		// past the exact counts, the normal approximation lands within one of them
+		auto c = bench::criticalU(200, 200, 0.05);
+		CHECK(c >= 17733 && c <= 17735);
+	}
+
+	// 0..9, then the same 5 later. The 100 differences are 5 + t, t from -9 to 9, each 10 - |t| times.
+	// 23 of them are under 2, and 23 over 8, so the interval is [2, 8]
+	{
+		std::vector<double> old, now;
+
+		for (int i = 0; i < 10; ++i)
+		{
+			old.push_back(i);
+			now.push_back(i + 5);
+		}
+
+		auto test = bench::mannWhitney(old, now, 0.05);
+
+		CHECK(test.shift == 5);
+		CHECK(test.low == 2);
+		CHECK(test.high == 8);
+		CHECK(test.p < 0.05);
+
+		// no shift, nothing significant
+		auto same = bench::mannWhitney(old, old, 0.05);
+
+		CHECK(same.shift == 0);
+		CHECK(same.low == -3 && same.high == 3);
+		CHECK(same.p > 0.5);
+	}
+
+	// too few runs for any interval: it's every difference
+	{
+		auto test = bench::mannWhitney({ 1, 2, 3 }, { 4, 5, 6 }, 0.05);
+
+		CHECK(test.low == 1);
+		CHECK(test.high == 5);
+	}
+
+	return test::finish("stats");
+}
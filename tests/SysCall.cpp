@@ -0,0 +1,233 @@
+// I/O syscalls: values split over several reads, the end of a file, writing to a closed pipe or socket, and files opened by path
+
+#include <csignal>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+#include "libSomeVM/EventLoop.hpp"
+#include "libSomeVM/Module.hpp"
+
+#include "Test.hpp"
+
+#ifdef __linux__
+namespace
+{
+	using namespace svm;
+	using Type = Instruction::Type;
+
+	constexpr std::uint64_t VALUE = 0x4045000000000000u;	// 42.0
+
+	// reads 'fd' twice, leaving the values in registers 0 and 2, and whether they were read in 1 and 3
+	std::shared_ptr<const Module> readTwice(int fd)
+	{
+		bench::Builder b;
+
+		for (std::uint32_t i = 0; i < 2; ++i)
+		{
+			b.load(10, bench::integer(fd));
+			b.sysCall(SysCall::Read, 1);
+			b.code.emplace_back(Type::Load, i * 2, std::uint32_t{ 10 });
+			b.code.emplace_back(Type::Load, i * 2 + 1, std::uint32_t{ 11 });
+		}
+
+		return b.finish();
+	}
+
+	// writes a value to 'fd', leaving whether it was written in register 0
+	std::shared_ptr<const Module> writeOnce(int fd)
+	{
+		bench::Builder b;
+		b.load(10, bench::integer(fd));
+		b.load(11, Value::fromBits(VALUE));
+		b.sysCall(SysCall::Write, 2);
+		b.code.emplace_back(Type::Load, std::uint32_t{ 0 }, std::uint32_t{ 10 });
+
+		return b.finish();
+	}
+
+	// opens 'path' with 'flags', leaving the fd in register 12
+	void open(bench::Builder& b, const std::string& path, std::initializer_list<OpenFlag> flags)
+	{
+		std::int64_t bits = 0;
+		for (auto flag : flags)
+			bits |= static_cast<std::int64_t>(flag);
+
+		b.load(10, Value::array(1, path.size(), path.data()));
+		b.load(11, bench::integer(bits));
+		b.sysCall(SysCall::Open, 2);
+		b.code.emplace_back(Type::Load, std::uint32_t{ 12 }, std::uint32_t{ 10 });
+	}
+
+	// writes a value to a new file at 'path' and closes it, then opens it again and reads it twice, as readTwice() does
+	std::shared_ptr<const Module> writeThenRead(const std::string& path)
+	{
+		bench::Builder b;
+
+		open(b, path, { OpenFlag::Write, OpenFlag::Create, OpenFlag::Truncate });
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 12 });
+		b.load(11, Value::fromBits(VALUE));
+		b.sysCall(SysCall::Write, 2);
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 12 });
+		b.sysCall(SysCall::Close, 1);
+
+		open(b, path, { OpenFlag::Read });
+
+		for (std::uint32_t i = 0; i < 2; ++i)
+		{
+			b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 12 });
+			b.sysCall(SysCall::Read, 1);
+			b.code.emplace_back(Type::Load, i * 2, std::uint32_t{ 10 });
+			b.code.emplace_back(Type::Load, i * 2 + 1, std::uint32_t{ 11 });
+		}
+
+		b.code.emplace_back(Type::Load, std::uint32_t{ 10 }, std::uint32_t{ 12 });
+		b.sysCall(SysCall::Close, 1);
+
+		return b.finish();
+	}
+
+	void send(int fd, const char* bytes, std::size_t size)
+	{
+		CHECK(::write(fd, bytes, size) == static_cast<ssize_t>(size));
+	}
+
+	// one value written in two parts, the second after the reader is waiting, and then a partial value before closing
+	void splitValue(bool events)
+	{
+		int fds[2];
+		CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+
+		char bytes[sizeof(VALUE)];
+		std::memcpy(bytes, &VALUE, sizeof(VALUE));
+
+		send(fds[1], bytes, 3);
+
+		std::thread writer([&]()
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			send(fds[1], bytes + 3, sizeof(bytes) - 3);
+			send(fds[1], bytes, 5);
+			::close(fds[1]);
+		});
+
+		auto module = readTwice(fds[0]);
+
+		auto check = [](const VM& vm)
+		{
+			CHECK(vm.read(0).bits() == VALUE);
+			CHECK(static_cast<Bool>(vm.read(1)));
+
+			// the partial value at the end is dropped
+			CHECK(!static_cast<Bool>(vm.read(3)));
+		};
+
+		if (events)
+		{
+			EventLoop loop;
+			loop.add(module);
+			loop.run();
+
+			CHECK(loop.error(0).empty());
+			CHECK(loop.stats().suspensions > 0);
+			check(loop.script(0));
+		}
+		else
+		{
+			VM vm;
+			vm.load(module);
+			vm.run();
+			check(vm);
+		}
+
+		writer.join();
+		::close(fds[0]);
+	}
+
+	bool writeToClosed(int fds[2])
+	{
+		::close(fds[0]);
+
+		VM vm;
+		vm.load(writeOnce(fds[1]));
+		vm.run();
+
+		::close(fds[1]);
+
+		return static_cast<Bool>(vm.read(0));
+	}
+}
+
+int main()
+{
+	splitValue(false);
+	splitValue(true);
+
+	// sockets don't raise SIGPIPE, which would end the test here
+	{
+		int fds[2];
+		CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == 0);
+		CHECK(!writeToClosed(fds));
+	}
+
+	// pipes do, unless it's ignored
+	{
+		std::signal(SIGPIPE, SIG_IGN);
+
+		int fds[2];
+		CHECK(::pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0);
+		CHECK(!writeToClosed(fds));
+	}
+
+	// a value written to a file reads back, then the end of the file, run directly and by an event loop
+	{
+		auto path = "/tmp/svm-syscall-" + std::to_string(::getpid());
+		auto check = [](const VM& vm)
+		{
+			CHECK(vm.read(0).bits() == VALUE);
+			CHECK(static_cast<Bool>(vm.read(1)));
+			CHECK(!static_cast<Bool>(vm.read(3)));
+		};
+
+		{
+			VM vm;
+			vm.load(writeThenRead(path));
+			vm.run();
+			check(vm);
+		}
+
+		{
+			EventLoop loop;
+			loop.add(writeThenRead(path));
+			loop.run();
+
+			CHECK(loop.error(0).empty());
+			check(loop.script(0));
+		}
+
+		::unlink(path.c_str());
+
+		// and a file that isn't there
+		bench::Builder b;
+		open(b, path, { OpenFlag::Read });
+
+		VM vm;
+		vm.load(b.finish());
+		CHECK_THROWS(vm.run());
+	}
+
+	return test::finish("syscall");
+}
+#else
+int main()
+{
+	return test::finish("syscall");
+}
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+// shared by the test programs, each its own program run by "make test", which fails if any of their checks do
+
+#include <cstdio>
+#include <exception>
+
+#include "bench/Bench.hpp"
+
+namespace test
+{
+	inline int& failures()
+	{
+		static int count = 0;
+		return count;
+	}
+
+	// carries on after a failure, so one run shows everything that's wrong
+	inline bool check(bool ok, const char* what, const char* file, int line)
+	{
+		if (!ok)
+		{
+			++failures();
+			std::fprintf(stderr, "%s:%d: failed: %s\n", file, line, what);
+		}
+
+		return ok;
+	}
+
+	// true if 'run' throws
+	template<typename F>
+	bool throws(F run)
+	{
+		try
+		{
+			run();
+		}
+		catch (const std::exception&)
+		{
+			return true;
+		}
+
+		return false;
+	}
+
+	// what main() should return
+	inline int finish(const char* name)
+	{
+		if (failures() == 0)
+			std::printf("%-24s passed\n", name);
+		else
+			std::printf("%-24s %d failed\n", name, failures());
+
+		return failures() == 0 ? 0 : 1;
+	}
+}
+
+#define CHECK(cond) test::check((cond), #cond, __FILE__, __LINE__)
+#define CHECK_THROWS(expr) test::check(test::throws([&]() { expr; }), "throws: " #expr, __FILE__, __LINE__)